@@ -4,6 +4,11 @@
 // for the lazy people
 #include "GLSH_Math.h"
 #include "GLSH_Mesh.h"
+#include "GLSH_MeshArena.h"
+#include "GLSH_MeshRenderer.h"
+#include "GLSH_InstancedMesh.h"
+#include "GLSH_LODMesh.h"
+#include "GLSH_StreamBuffer.h"
 #include "GLSH_Shaders.h"
 #include "GLSH_System.h"
 #include "GLSH_Util.h"
@@ -12,6 +17,9 @@
 #include "GLSH_Camera.h"
 #include "GLSH_Image.h"
 #include "GLSH_Texture.h"
+#include "GLSH_TextureArray.h"
+#include "GLSH_SamplerCache.h"
+#include "GLSH_StaticBatch.h"
 #include "GLSH_Text.h"
 
 #endif
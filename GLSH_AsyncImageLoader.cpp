@@ -0,0 +1,154 @@
+#include "GLSH_AsyncImageLoader.h"
+#include "GLSH_ThreadPool.h"
+#include "GLSH_Util.h"
+
+namespace glsh {
+
+struct AsyncImageLoader::Job {
+    unsigned            id;
+    std::string         path;
+    bool                genMipmaps;
+
+    Image               image;
+    Image               scratch;
+    const Image*        ready;          // image or scratch, NULL if the load failed
+
+    int                 level, row;     // where the next slice starts
+    double              seconds;        // spent loading and preparing
+};
+
+AsyncImageLoader::AsyncImageLoader(ThreadPool& pool)
+    : mPool(pool)
+    , mNextId(1)
+    , mNumDecoding(0)
+    , mWorkerSeconds(0)
+{
+}
+
+AsyncImageLoader::~AsyncImageLoader()
+{
+    // the jobs still queued on the pool point back at us
+    WaitDecoded();
+}
+
+unsigned AsyncImageLoader::Load(const std::string& path, bool genMipmaps)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->path = path;
+    job->genMipmaps = genMipmaps;
+    job->ready = NULL;
+    job->level = 0;
+    job->row = 0;
+    job->seconds = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        job->id = mNextId++;
+        ++mNumDecoding;
+    }
+
+    mPool.schedule([this, job]() {
+        double start = GetPerfTime();
+
+        if (job->image.Load(job->path)) {
+            job->ready = PrepareTextureImage(job->image, job->genMipmaps, job->scratch);
+        }
+
+        job->seconds = GetPerfTime() - start;
+
+        // notify under the lock, the destructor may be waiting to return
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWorkerSeconds += job->seconds;
+        mReady.push_back(job);
+        --mNumDecoding;
+        mJobDone.notify_all();
+    });
+
+    return job->id;
+}
+
+size_t AsyncImageLoader::Update(size_t budget, const std::function<void(const Slice&)>& upload)
+{
+    size_t sent = 0;
+
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mReady.empty()) {
+                break;
+            }
+            job = mReady.front();
+        }
+
+        const Image* img = job->ready;
+        if (!img) {
+            Slice slice = { job->id, NULL, 0, 0, 0, NULL, 0, true, true, job->seconds };
+            upload(slice);
+        } else {
+            while (job->level < img->numMipmaps()) {
+                int width = img->getMipmapWidth(job->level);
+                int height = img->getMipmapHeight(job->level);
+                size_t rowSize = (size_t)width * img->getBytesPerPixel();
+
+                // as many rows as fit, but always some progress
+                size_t fit = sent < budget ? (budget - sent) / rowSize : 0;
+                int rows = fit < (size_t)(height - job->row) ? (int)fit : height - job->row;
+                if (rows == 0) {
+                    if (sent > 0) {
+                        return sent;
+                    }
+                    rows = 1;
+                }
+
+                Slice slice;
+                slice.id = job->id;
+                slice.image = img;
+                slice.level = job->level;
+                slice.y = job->row;
+                slice.height = rows;
+                slice.data = img->getMipmapData(job->level) + job->row * rowSize;
+                slice.size = rows * rowSize;
+                slice.first = job->level == 0 && job->row == 0;
+
+                job->row += rows;
+                if (job->row == height) {
+                    ++job->level;
+                    job->row = 0;
+                }
+                slice.last = job->level == img->numMipmaps();
+                slice.loadSeconds = job->seconds;
+
+                upload(slice);
+                sent += slice.size;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReady.pop_front();
+    }
+
+    return sent;
+}
+
+void AsyncImageLoader::WaitDecoded()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mNumDecoding > 0) {
+        mJobDone.wait(lock);
+    }
+}
+
+unsigned AsyncImageLoader::numPending() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mNumDecoding + (unsigned)mReady.size();
+}
+
+double AsyncImageLoader::getWorkerSeconds() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWorkerSeconds;
+}
+
+} // end of namespace
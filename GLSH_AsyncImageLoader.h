@@ -0,0 +1,88 @@
+#ifndef GLSH_ASYNCIMAGELOADER_H_
+#define GLSH_ASYNCIMAGELOADER_H_
+
+#include "GLSH_Image.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace glsh {
+
+class ThreadPool;
+
+//
+// Loads images on a thread pool and hands them back a few rows at a time, never more than a given
+// number of bytes per call, so the GL thread can spread texture uploads over several frames.
+// Images are prepared for upload on the workers (see PrepareTextureImage).
+//
+// There are no GL calls in here, so it works (and can be tested) without a GL context.
+//
+class AsyncImageLoader {
+public:
+    //
+    // A band of rows of one mip level, ready to go to glTexSubImage2D.
+    // A load that failed shows up as a single slice with a NULL image.
+    //
+    struct Slice {
+        unsigned                id;             // from Load()
+        const Image*            image;          // the prepared image, valid during the callback
+        int                     level;
+        int                     y, height;      // rows [y, y + height) of the level
+        const unsigned char*    data;
+        size_t                  size;
+        bool                    first;          // first slice of this image
+        bool                    last;           // last slice of this image, the image is freed after it
+        double                  loadSeconds;    // time a worker spent loading and preparing the image
+    };
+
+private:
+    struct Job;
+
+    ThreadPool&                         mPool;
+
+    mutable std::mutex                  mMutex;
+    std::condition_variable             mJobDone;
+
+    std::deque<std::shared_ptr<Job> >   mReady;         // decoded, in the order they finished
+    unsigned                            mNextId;
+    unsigned                            mNumDecoding;
+
+    double                              mWorkerSeconds;
+
+public:
+    explicit                            AsyncImageLoader(ThreadPool& pool);
+                                        ~AsyncImageLoader();    // waits for the jobs still decoding
+
+    // queue a .tga or .qoi file for loading; returns the id its slices will carry
+    unsigned                            Load(const std::string& path, bool genMipmaps);
+
+    //
+    // Call upload with ready slices, in order, until budget bytes have been handed out.
+    // At least one row goes out if anything is ready, so a row wider than the budget can't stall the queue.
+    // Returns the number of bytes handed out.
+    //
+    size_t                              Update(size_t budget, const std::function<void(const Slice&)>& upload);
+
+    // block until nothing is left decoding (the slices may still be waiting for Update)
+    void                                WaitDecoded();
+
+    // loads not fully handed out yet
+    unsigned                            numPending() const;
+
+    // thread time spent loading and preparing images, off the caller's thread
+    double                              getWorkerSeconds() const;
+
+private:
+                                        // noncopyable
+                                        AsyncImageLoader(const AsyncImageLoader&);
+                                        AsyncImageLoader& operator= (const AsyncImageLoader&);
+};
+
+} // end of namespace
+
+#endif
@@ -18,6 +18,9 @@ public:
 
     void                    setViewportSize(int width, int height);
 
+    int                     getViewportWidth() const    { return mViewportWidth; }
+    int                     getViewportHeight() const   { return mViewportHeight; }
+
     virtual glm::vec3       getPosition() const = 0;
     virtual glm::quat       getOrientation() const = 0;
 
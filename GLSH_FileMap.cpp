@@ -0,0 +1,138 @@
+#include "GLSH_FileMap.h"
+
+#if _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace glsh {
+
+#if _WIN32
+
+MappedFile::MappedFile()
+    : mData(NULL)
+    , mSize(0)
+    , mFile(INVALID_HANDLE_VALUE)
+    , mMapping(NULL)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    // we'll be reading front to back, so let the cache manager read ahead aggressively
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1) {
+        // can't map empty files (or files bigger than our address space)
+        Close();
+        return false;
+    }
+
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mMapping) {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mData) {
+        Close();
+        return false;
+    }
+
+    mSize = (size_t)size.QuadPart;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData) {
+        UnmapViewOfFile(mData);
+        mData = NULL;
+    }
+    if (mMapping) {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+    mSize = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : mData(NULL)
+    , mSize(0)
+    , mFile(-1)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    mFile = open(path.c_str(), O_RDONLY);
+    if (mFile < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(mFile, &st) != 0 || st.st_size == 0) {
+        // can't map empty files
+        Close();
+        return false;
+    }
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (p == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    // we'll be reading front to back, so ask for aggressive read-ahead
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    mData = static_cast<const unsigned char*>(p);
+    mSize = (size_t)st.st_size;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData) {
+        munmap(const_cast<unsigned char*>(mData), mSize);
+        mData = NULL;
+    }
+    if (mFile >= 0) {
+        close(mFile);
+        mFile = -1;
+    }
+    mSize = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+} // end of namespace
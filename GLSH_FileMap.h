@@ -0,0 +1,43 @@
+#ifndef GLSH_FILEMAP_H_
+#define GLSH_FILEMAP_H_
+
+#include <string>
+#include <cstddef>
+
+namespace glsh {
+
+//
+// A read-only view of a whole file mapped into the address space.
+// The OS pages the contents in on demand, so no heap buffer and no read copy are needed.
+//
+class MappedFile {
+    const unsigned char*    mData;
+    size_t                  mSize;
+
+#if _WIN32
+    void*                   mFile;      // file HANDLE
+    void*                   mMapping;   // file mapping HANDLE
+#else
+    int                     mFile;      // file descriptor
+#endif
+
+public:
+                            MappedFile();
+                            ~MappedFile();
+
+    bool                    Open(const std::string& path);
+    void                    Close();
+
+    bool                    isOpen() const      { return mData != NULL; }
+    const unsigned char*    getData() const     { return mData; }
+    size_t                  getSize() const     { return mSize; }
+
+private:
+                            // noncopyable
+                            MappedFile(const MappedFile&);
+                            MappedFile& operator= (const MappedFile&);
+};
+
+} // end of namespace
+
+#endif
@@ -1,8 +1,13 @@
 #include "GLSH_Image.h"
 #include "GLSH_Util.h"
+#include "GLSH_FileMap.h"
+#include "GLSH_PixelOps.h"
+#include "GLSH_ThreadPool.h"
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <functional>
 
 namespace glsh {
 
@@ -32,6 +37,8 @@ Image::Image()
     , mHeight(0)
     , mBytesPerPixel(0)
     , mData(NULL)
+    , mDataSize(0)
+    , mCapacity(0)
 {
 }
 
@@ -40,20 +47,55 @@ Image::~Image()
     Deallocate();
 }
 
-bool Image::Allocate(int width, int height, int bytesPerPixel)
+// mip levels start on 16-byte boundaries within the block, so SIMD loads of a row start don't split cache lines as often
+static const size_t MIPMAP_ALIGNMENT = 16;
+
+size_t Image::LayoutMipmaps(std::vector<Mipmap>& levels, int width, int height, int bytesPerPixel,
+                            int maxLevels, int minSize)
+{
+    levels.clear();
+
+    size_t offset = 0;
+    for (;;) {
+        size_t size = (size_t)width * height * bytesPerPixel;
+        levels.push_back(Mipmap(width, height, offset, size));
+        offset += size;
+
+        if ((maxLevels > 0 && (int)levels.size() >= maxLevels) || (width == 1 && height == 1)) {
+            break;
+        }
+
+        // NPOT sizes round down, as in GL
+        width = width > 1 ? width >> 1 : 1;
+        height = height > 1 ? height >> 1 : 1;
+        if (width < minSize || height < minSize) {
+            break;
+        }
+
+        offset = (offset + MIPMAP_ALIGNMENT - 1) & ~(MIPMAP_ALIGNMENT - 1);
+    }
+
+    return offset;
+}
+
+bool Image::Allocate(int width, int height, int bytesPerPixel, int numLevels)
 {
     // make sure to delete old memory if reallocating
     Deallocate();
 
-    // allocate new memory for the image
-    mData = new unsigned char[width * height * bytesPerPixel];
+    if (width <= 0 || height <= 0 || bytesPerPixel <= 0) {
+        return false;
+    }
+
+    // allocate one block for all the levels
+    size_t size = LayoutMipmaps(mMipmaps, width, height, bytesPerPixel, numLevels, 1);
+    mData = new unsigned char[size];
+    mDataSize = size;
+    mCapacity = size;
     mWidth = width;
     mHeight = height;
     mBytesPerPixel = bytesPerPixel;
 
-    // create level 0 mipmap
-    mMipmaps.push_back(Mipmap(mWidth, mHeight, mData));
-
     return true;
 }
 
@@ -61,46 +103,36 @@ void Image::Deallocate()
 {
     delete [] mData;
     mData = NULL;
+    mDataSize = 0;
+    mCapacity = 0;
     mWidth = 0;
     mHeight = 0;
     mBytesPerPixel = 0;
 
-    // delete mipmaps
-    for (unsigned i = 1; i < mMipmaps.size(); i++) {
-        delete mMipmaps[i].data;
-    }
     mMipmaps.clear();
 }
 
 bool Image::LoadTarga(const std::string& path)
 {
-    // open the file in binary mode
-    std::ifstream file(path.c_str(), std::ios::binary);
-
-    // make sure the file opened correctly
-    if (!file.good()) {
+    // map the file into memory; the pixels get decoded straight from the mapping into mData,
+    // so there is no intermediate file buffer to allocate and fill
+    MappedFile file;
+    if (!file.Open(path)) {
         std::cerr << "*** Failed to open file '" << path << "'" << std::endl;
         return false;
     }
 
-    // get the file size
-    file.seekg(0, std::ios::end);          // seek to the end of the file
-    size_t len = (size_t)file.tellg();     // get the file pointer offset in bytes
-    file.seekg(0, std::ios::beg);          // rewind back to the beginning
-
-    // allocate memory for the file contents
-    unsigned char* buf = new unsigned char[len];
+    const unsigned char* buf = file.getData();
+    size_t len = file.getSize();
 
-    // read entire file into memory
-    file.read((char*)buf, len);
-    if (!file.good()) {
-        std::cerr << "*** Failed to read file '" << path << "'" << std::endl;
-        delete [] buf;  // avoid a leak
+    // make sure there's at least a complete header
+    if (len < sizeof(TargaHeader)) {
+        std::cerr << "*** File '" << path << "' is too small to be a TGA image" << std::endl;
         return false;
     }
 
     // the header is at the beginning of the file contents; use a cast to reinterpret that chunk of memory
-    TargaHeader* hdr = reinterpret_cast<TargaHeader*>(buf);
+    const TargaHeader* hdr = reinterpret_cast<const TargaHeader*>(buf);
 
     //std::cout << "Loading '" << path << "': " << hdr->width << "x" << hdr->height << ", " << (unsigned)hdr->bpp << " bpp" << std::endl;
 
@@ -115,26 +147,38 @@ bool Image::LoadTarga(const std::string& path)
     default:
         // anything else (like indexed formats) is unsupported
         std::cerr << "*** Unsuported TGA format" << std::endl;
-        delete [] buf;  // avoid a leak
+        return false;
+    }
+
+    // only 8, 24, and 32 bpp images are supported
+    if (hdr->bpp != 8 && hdr->bpp != 24 && hdr->bpp != 32) {
+        std::cerr << "*** Unsupported TGA color depth: " << (unsigned)hdr->bpp << " bpp" << std::endl;
         return false;
     }
 
     // bit 4 of image descriptor indicates right-to-left pixel ordering, which we don't support
     if (hdr->imageDesc & 0x10) {
         std::cerr << "*** Oopsy doodle, right-to-left TGA files are not supported" << std::endl;
-        delete [] buf;  // avoid a leak
+        return false;
+    }
+
+    // skip past header and optional variable-length id field to get to the start of the image data
+    size_t dataOffset = sizeof(TargaHeader) + hdr->idLength;
+    size_t dataSize = (size_t)hdr->width * hdr->height * (hdr->bpp / 8);
+
+    // reading from a mapping past the end of the file is fatal, so make sure it's all there
+    if (dataOffset > len || ((hdr->imageTypeCode == TARGA_RGB || hdr->imageTypeCode == TARGA_GRAYSCALE) && len - dataOffset < dataSize)) {
+        std::cerr << "*** TGA file '" << path << "' is truncated" << std::endl;
         return false;
     }
 
     // allocate memory for the image data
     if (!Allocate(hdr->width, hdr->height, hdr->bpp / 8)) {
         std::cerr << "*** Failed to allocate memory for image" << std::endl;
-        delete [] buf;  // avoid a leak
         return false;
     }
 
-    // jump to the start of the image data (skip past header and optional variable-length id field)
-    unsigned char* imgData = buf + sizeof(TargaHeader) + hdr->idLength;
+    const unsigned char* imgData = buf + dataOffset;
 
     // decide how to load the image depending on type
     switch (hdr->imageTypeCode) {
@@ -146,26 +190,46 @@ bool Image::LoadTarga(const std::string& path)
     case TARGA_RLE_RGB:
     case TARGA_RLE_GRAYSCALE:
         // load RLE-compressed image
-        LoadTargaRLE(hdr, imgData);
+        if (!LoadTargaRLE(hdr, imgData, buf + len)) {
+            std::cerr << "*** TGA file '" << path << "' is truncated" << std::endl;
+            Deallocate();
+            return false;
+        }
         break;
     default:
         // we should never get here
         std::cerr << "*** Oops, don't know how to load this format: fire the programmer" << std::endl;
-        delete [] buf;
         Deallocate();
         return false;
     }
 
-    // done loading, so deallocate the file contents
-    delete [] buf;
-
-    // all good, yay
+    // all good, yay (the file gets unmapped when it goes out of scope)
     return true;
 }
 
+//
+// Convert TGA pixels (BGR/BGRA byte order) to our in-memory layout (RGB/RGBA)
+//
+static void ConvertTargaPixels(unsigned char* dst, const unsigned char* src, size_t numPixels, int bytesPerPixel)
+{
+    switch (bytesPerPixel) {
+    case 3:
+        SwizzleBGRToRGB(dst, src, numPixels);
+        break;
+    case 4:
+        SwizzleBGRAToRGBA(dst, src, numPixels);
+        break;
+    default:
+        // grayscale needs no conversion
+        std::memcpy(dst, src, numPixels * bytesPerPixel);
+        break;
+    }
+}
+
 void Image::LoadTargaUncompressed(const TargaHeader* hdr, const unsigned char* imgData)
 {
-    int rowlen = (hdr->bpp / 8) * hdr->width;  // bytes per row
+    int bpp = hdr->bpp / 8;
+    int rowlen = bpp * hdr->width;  // bytes per row
     int rowstep;
     unsigned char* dstRow;
     // check bit 5 of image descriptor to determine row ordering
@@ -179,57 +243,58 @@ void Image::LoadTargaUncompressed(const TargaHeader* hdr, const unsigned char* i
         dstRow = mData;
     }
 
-    switch (hdr->bpp) {
-    case 24:
-        //std::cout << "~~ Loading 24 bpp" << std::endl;
+    if (rowstep == rowlen) {
+        // rows are stored in the same order as in the file, so the whole image converts in one go
+        ConvertTargaPixels(mData, imgData, (size_t)hdr->width * hdr->height, bpp);
+    } else {
         for (unsigned short j = 0; j < hdr->height; j++) {
-            unsigned char* p = dstRow;
-            for (unsigned short i = 0; i < hdr->width; i++) {
-                char b = *imgData++;
-                char g = *imgData++;
-                char r = *imgData++;
-                *p++ = r;
-                *p++ = g;
-                *p++ = b;
-            }
+            ConvertTargaPixels(dstRow, imgData, hdr->width, bpp);
+            imgData += rowlen;
             dstRow += rowstep;
         }
-        break;
+    }
+}
 
-    case 32:
-        //std::cout << "~~ Loading 32 bpp" << std::endl;
-        for (unsigned short j = 0; j < hdr->height; j++) {
-            unsigned char* p = dstRow;
-            for (unsigned short i = 0; i < hdr->width; i++) {
-                char b = *imgData++;
-                char g = *imgData++;
-                char r = *imgData++;
-                char a = *imgData++;
-                *p++ = r;
-                *p++ = g;
-                *p++ = b;
-                *p++ = a;
+//
+// Fill a span with copies of one (already converted) pixel
+//
+static void FillPixels(unsigned char* dst, const unsigned char* pixel, size_t numPixels, int bytesPerPixel)
+{
+    switch (bytesPerPixel) {
+    case 1:
+        std::memset(dst, pixel[0], numPixels);
+        break;
+    case 4:
+        {
+            // simple enough for the compiler to vectorize
+            unsigned value;
+            std::memcpy(&value, pixel, 4);
+            for (size_t i = 0; i < numPixels; i++) {
+                std::memcpy(dst + 4 * i, &value, 4);
             }
-            dstRow += rowstep;
         }
         break;
-
-    case 8:
-        //std::cout << "~~ Loading 8 bpp" << std::endl;
-        for (unsigned short j = 0; j < hdr->height; j++) {
-            unsigned char* p = dstRow;
-            for (unsigned short i = 0; i < hdr->width; i++) {
-                *p++ = *imgData++;
+    default:
+        {
+            // 3 bytes don't fit a machine word, so keep doubling what's been written so far
+            size_t len = numPixels * bytesPerPixel;
+            size_t done = bytesPerPixel;
+            std::memcpy(dst, pixel, bytesPerPixel);
+            while (done < len) {
+                size_t n = done < len - done ? done : len - done;
+                std::memcpy(dst + done, dst, n);
+                done += n;
             }
-            dstRow += rowstep;
         }
         break;
     }
 }
 
-void Image::LoadTargaRLE(const TargaHeader* hdr, const unsigned char* imgData)
+bool Image::LoadTargaRLE(const TargaHeader* hdr, const unsigned char* imgData, const unsigned char* imgEnd)
 {
-    int rowlen = (hdr->bpp / 8) * hdr->width;  // bytes per row
+    const int bpp = hdr->bpp / 8;
+    const unsigned width = hdr->width;
+    int rowlen = bpp * hdr->width;  // bytes per row
     int rowstep;
     unsigned char* dstRow;
     // check bit 5 of image descriptor to determine row ordering
@@ -243,148 +308,611 @@ void Image::LoadTargaRLE(const TargaHeader* hdr, const unsigned char* imgData)
         dstRow = mData;
     }
 
-    const unsigned numPixels = hdr->width * hdr->height;
+    const unsigned numPixels = width * hdr->height;
     unsigned numPixelsRead = 0;
-    unsigned short numPixelsInRow = 0;
-    unsigned char* p = dstRow;
-
-    switch (hdr->bpp) {
-    case 24:
-        //std::cout << "~~ Loading 24 bpp, RLE" << std::endl;
-        while (numPixelsRead < numPixels) {
-            unsigned char count = (unsigned char)*imgData++;
-            if (count > 127) {
-                // RLE packet
-                count -= 127;
-                char b = *imgData++;
-                char g = *imgData++;
-                char r = *imgData++;
-                for (unsigned char i = 0; i < count; i++) {
-                    *p++ = r;
-                    *p++ = g;
-                    *p++ = b;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
-                    }
-                }
+    unsigned numPixelsInRow = 0;
+
+    //
+    // Each packet is handled as a whole: RLE packets become fills and raw packets become
+    // swizzled copies.  A packet only gets split where it crosses the end of a row.
+    //
+    while (numPixelsRead < numPixels) {
+
+        if (imgData >= imgEnd) {
+            return false;  // truncated: no packet header
+        }
+
+        unsigned header = *imgData++;
+        bool isRun = header > 127;
+        unsigned count = (header & 0x7f) + 1;
+
+        // a packet that runs past the end of the image is malformed; don't write past mData
+        if (count > numPixels - numPixelsRead) {
+            count = numPixels - numPixelsRead;
+        }
+
+        unsigned char pixel[4];
+        if (isRun) {
+            // RLE packet: one pixel value repeated count times
+            if ((size_t)(imgEnd - imgData) < (size_t)bpp) {
+                return false;  // truncated: no pixel value
+            }
+            ConvertTargaPixels(pixel, imgData, 1, bpp);
+            imgData += bpp;
+        } else {
+            // raw packet: count literal pixel values
+            if ((size_t)(imgEnd - imgData) < (size_t)count * bpp) {
+                return false;  // truncated: not enough pixel values
+            }
+        }
+
+        numPixelsRead += count;
+
+        while (count > 0) {
+            unsigned n = width - numPixelsInRow;
+            if (n > count) {
+                n = count;
+            }
+
+            unsigned char* p = dstRow + numPixelsInRow * bpp;
+            if (isRun) {
+                FillPixels(p, pixel, n, bpp);
             } else {
-                // raw packet
-                ++count;
-                for (unsigned char i = 0; i < count; i++) {
-                    char b = *imgData++;
-                    char g = *imgData++;
-                    char r = *imgData++;
-                    *p++ = r;
-                    *p++ = g;
-                    *p++ = b;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
-                    }
-                }
+                ConvertTargaPixels(p, imgData, n, bpp);
+                imgData += n * bpp;
+            }
+
+            count -= n;
+            numPixelsInRow += n;
+            if (numPixelsInRow == width) {
+                // advance to next row
+                dstRow += rowstep;
+                numPixelsInRow = 0;
             }
-            numPixelsRead += count;
         }
-        break;
+    }
 
-    case 32:
-        //std::cout << "~~ Loading 24 bpp, RLE" << std::endl;
-        while (numPixelsRead < numPixels) {
-            unsigned char count = (unsigned char)*imgData++;
-            if (count > 127) {
-                // RLE packet
-                count -= 127;
-                char b = *imgData++;
-                char g = *imgData++;
-                char r = *imgData++;
-                char a = *imgData++;
-                for (unsigned char i = 0; i < count; i++) {
-                    *p++ = r;
-                    *p++ = g;
-                    *p++ = b;
-                    *p++ = a;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
-                    }
-                }
+    return true;
+}
+
+
+//
+// QOI files
+//
+// See https://qoiformat.org/qoi-specification.pdf.  Rows are stored top to bottom,
+// so they get flipped on the way in and out.
+//
+
+static const unsigned char QOI_OP_INDEX     = 0x00;
+static const unsigned char QOI_OP_DIFF      = 0x40;
+static const unsigned char QOI_OP_LUMA      = 0x80;
+static const unsigned char QOI_OP_RUN       = 0xc0;
+static const unsigned char QOI_OP_RGB       = 0xfe;
+static const unsigned char QOI_OP_RGBA      = 0xff;
+static const unsigned char QOI_MASK_2       = 0xc0;
+
+static const size_t QOI_HEADER_SIZE = 14;
+static const unsigned char QOI_PADDING[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+static inline unsigned QoiHash(const unsigned char* px)
+{
+    return (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63;
+}
+
+// bytes in a chunk, including the tag
+static inline int QoiChunkSize(unsigned char tag)
+{
+    if (tag == QOI_OP_RGBA) {
+        return 5;
+    } else if (tag == QOI_OP_RGB) {
+        return 4;
+    } else if ((tag & QOI_MASK_2) == QOI_OP_LUMA) {
+        return 2;
+    }
+    return 1;
+}
+
+static inline unsigned ReadBigEndian32(const unsigned char* p)
+{
+    return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3];
+}
+
+static inline void WriteBigEndian32(unsigned char* p, unsigned v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+bool Image::Load(const std::string& path)
+{
+    std::string ext = GetFileExtension(path);
+    if (ext == ".qoi") {
+        return LoadQOI(path);
+    } else if (ext == ".tga") {
+        return LoadTarga(path);
+    }
+
+    std::cerr << "*** Don't know how to load '" << path << "': unknown file extension" << std::endl;
+    return false;
+}
+
+bool Image::LoadQOI(const std::string& path)
+{
+    MappedFile file;
+    if (!file.Open(path)) {
+        std::cerr << "*** Failed to open file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    const unsigned char* buf = file.getData();
+    size_t len = file.getSize();
+
+    if (len < QOI_HEADER_SIZE + sizeof(QOI_PADDING) || memcmp(buf, "qoif", 4) != 0) {
+        std::cerr << "*** File '" << path << "' is not a QOI image" << std::endl;
+        return false;
+    }
+
+    unsigned width = ReadBigEndian32(buf + 4);
+    unsigned height = ReadBigEndian32(buf + 8);
+    int channels = buf[12];
+
+    if (width == 0 || height == 0 || width > 0xffff || height > 0xffff || (channels != 3 && channels != 4)) {
+        std::cerr << "*** Unsupported QOI image '" << path << "': " << width << "x" << height << ", " << channels << " channels" << std::endl;
+        return false;
+    }
+
+    if (!Allocate(width, height, channels)) {
+        std::cerr << "*** Failed to allocate memory for image" << std::endl;
+        return false;
+    }
+
+    // every chunk must end before the padding
+    const unsigned char* p = buf + QOI_HEADER_SIZE;
+    const unsigned char* end = buf + len - sizeof(QOI_PADDING);
+
+    unsigned char index[64 * 4];
+    memset(index, 0, sizeof(index));
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    unsigned run = 0;
+    bool truncated = false;
+
+    size_t rowLen = (size_t)width * channels;
+    for (unsigned row = 0; row < height && !truncated; row++) {
+        unsigned char* q = mData + (height - 1 - row) * rowLen;
+
+        for (unsigned i = 0; i < width; i++) {
+            if (run > 0) {
+                --run;
             } else {
-                // raw packet
-                ++count;
-                for (unsigned char i = 0; i < count; i++) {
-                    char b = *imgData++;
-                    char g = *imgData++;
-                    char r = *imgData++;
-                    char a = *imgData++;
-                    *p++ = r;
-                    *p++ = g;
-                    *p++ = b;
-                    *p++ = a;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
-                    }
+                if (p >= end || end - p < QoiChunkSize(*p)) {
+                    truncated = true;
+                    break;
                 }
+
+                unsigned char b1 = *p++;
+                if (b1 == QOI_OP_RGB) {
+                    px[0] = p[0];
+                    px[1] = p[1];
+                    px[2] = p[2];
+                    p += 3;
+                } else if (b1 == QOI_OP_RGBA) {
+                    px[0] = p[0];
+                    px[1] = p[1];
+                    px[2] = p[2];
+                    px[3] = p[3];
+                    p += 4;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                    memcpy(px, index + 4 * b1, 4);
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px[0] += ((b1 >> 4) & 3) - 2;
+                    px[1] += ((b1 >> 2) & 3) - 2;
+                    px[2] += (b1 & 3) - 2;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                    unsigned char b2 = *p++;
+                    int dg = (b1 & 0x3f) - 32;
+                    px[0] += dg - 8 + ((b2 >> 4) & 0x0f);
+                    px[1] += dg;
+                    px[2] += dg - 8 + (b2 & 0x0f);
+                } else {
+                    // QOI_OP_RUN: this pixel plus up to 61 more
+                    run = b1 & 0x3f;
+                }
+
+                memcpy(index + 4 * QoiHash(px), px, 4);
             }
-            numPixelsRead += count;
+
+            memcpy(q, px, channels);
+            q += channels;
         }
-        break;
+    }
 
-    case 8:
-        //std::cout << "~~ Loading 8 bpp, RLE" << std::endl;
-        while (numPixelsRead < numPixels) {
-            unsigned char count = (unsigned char)*imgData++;
-            if (count > 127) {
-                // RLE packet
-                count -= 127;
-                char val = *imgData++;
-                for (unsigned char i = 0; i < count; i++) {
-                    *p++ = val;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
-                    }
+    if (truncated) {
+        std::cerr << "*** QOI file '" << path << "' is truncated" << std::endl;
+        Deallocate();
+        return false;
+    }
+
+    return true;
+}
+
+bool Image::SaveQOI(const std::string& path) const
+{
+    if (!isGood() || (mBytesPerPixel != 3 && mBytesPerPixel != 4)) {
+        std::cerr << "*** Can't save '" << path << "': QOI images need 3 or 4 bytes per pixel" << std::endl;
+        return false;
+    }
+
+    int channels = mBytesPerPixel;
+
+    // worst case is a tag byte plus every channel for each pixel
+    std::vector<unsigned char> out(QOI_HEADER_SIZE + (size_t)mWidth * mHeight * (channels + 1) + sizeof(QOI_PADDING));
+    unsigned char* q = &out[0];
+
+    memcpy(q, "qoif", 4);
+    WriteBigEndian32(q + 4, mWidth);
+    WriteBigEndian32(q + 8, mHeight);
+    q[12] = (unsigned char)channels;
+    q[13] = 0;      // sRGB with linear alpha
+    q += QOI_HEADER_SIZE;
+
+    unsigned char index[64 * 4];
+    memset(index, 0, sizeof(index));
+    unsigned char prev[4] = { 0, 0, 0, 255 };
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    int run = 0;
+
+    size_t rowLen = (size_t)mWidth * channels;
+    size_t numPixels = (size_t)mWidth * mHeight;
+    size_t n = 0;
+
+    for (int row = mHeight - 1; row >= 0; row--) {
+        const unsigned char* p = mData + row * rowLen;
+
+        for (int i = 0; i < mWidth; i++, n++) {
+            memcpy(px, p, channels);
+            p += channels;
+
+            if (memcmp(px, prev, 4) == 0) {
+                ++run;
+                if (run == 62 || n == numPixels - 1) {
+                    *q++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+                    run = 0;
                 }
+                continue;
+            }
+
+            if (run > 0) {
+                *q++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            unsigned h = QoiHash(px);
+            if (memcmp(index + 4 * h, px, 4) == 0) {
+                *q++ = (unsigned char)(QOI_OP_INDEX | h);
             } else {
-                // raw packet
-                ++count;
-                for (unsigned char i = 0; i < count; i++) {
-                    *p++ = *imgData++;
-                    if (++numPixelsInRow == hdr->width) {
-                        // advance to next row
-                        dstRow += rowstep;
-                        p = dstRow;
-                        numPixelsInRow = 0;
+                memcpy(index + 4 * h, px, 4);
+
+                if (px[3] == prev[3]) {
+                    signed char vr = (signed char)(px[0] - prev[0]);
+                    signed char vg = (signed char)(px[1] - prev[1]);
+                    signed char vb = (signed char)(px[2] - prev[2]);
+                    signed char vgr = (signed char)(vr - vg);
+                    signed char vgb = (signed char)(vb - vg);
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        *q++ = (unsigned char)(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                    } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                        *q++ = (unsigned char)(QOI_OP_LUMA | (vg + 32));
+                        *q++ = (unsigned char)(((vgr + 8) << 4) | (vgb + 8));
+                    } else {
+                        *q++ = QOI_OP_RGB;
+                        *q++ = px[0];
+                        *q++ = px[1];
+                        *q++ = px[2];
                     }
+                } else {
+                    *q++ = QOI_OP_RGBA;
+                    *q++ = px[0];
+                    *q++ = px[1];
+                    *q++ = px[2];
+                    *q++ = px[3];
                 }
             }
-            numPixelsRead += count;
+
+            memcpy(prev, px, 4);
         }
-        break;
     }
+
+    memcpy(q, QOI_PADDING, sizeof(QOI_PADDING));
+    q += sizeof(QOI_PADDING);
+
+    std::ofstream f(path.c_str(), std::ios::binary);
+    if (!f || !f.write(reinterpret_cast<const char*>(&out[0]), q - &out[0])) {
+        std::cerr << "*** Failed to write '" << path << "'" << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
+//
+// Region reads
+//
 
-bool Image::GenerateMipmaps(int minSize)
+// how much of a file wide region reads pull in per request
+static const size_t TARGA_REGION_BUFFER_SIZE = 1024 * 1024;
+
+TargaRegionReader::TargaRegionReader()
+    : mWidth(0)
+    , mHeight(0)
+    , mBytesPerPixel(0)
+    , mDataOffset(0)
+    , mTopDown(false)
 {
-    // there must be an image loaded
-    if (!isGood()) {
+}
+
+bool TargaRegionReader::Open(const std::string& path)
+{
+    Close();
+
+    mFile.open(path.c_str(), std::ios::binary);
+    if (!mFile) {
+        std::cerr << "*** Failed to open file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    TargaHeader hdr;
+    if (!mFile.read(reinterpret_cast<char*>(&hdr), sizeof(hdr))) {
+        std::cerr << "*** File '" << path << "' is too small to be a TGA image" << std::endl;
+        Close();
+        return false;
+    }
+
+    // RLE data can't be seeked into, and right-to-left files aren't supported anywhere
+    if (hdr.imageTypeCode != TARGA_RGB && hdr.imageTypeCode != TARGA_GRAYSCALE) {
+        std::cerr << "*** TGA file '" << path << "' is not uncompressed, can't read regions from it" << std::endl;
+        Close();
+        return false;
+    }
+    if (hdr.bpp != 8 && hdr.bpp != 24 && hdr.bpp != 32) {
+        std::cerr << "*** Unsupported TGA color depth: " << (unsigned)hdr.bpp << " bpp" << std::endl;
+        Close();
+        return false;
+    }
+    if (hdr.imageDesc & 0x10) {
+        std::cerr << "*** Oopsy doodle, right-to-left TGA files are not supported" << std::endl;
+        Close();
+        return false;
+    }
+
+    // make sure all the pixels are there, so region reads can't run off the end
+    std::streamoff dataOffset = (std::streamoff)sizeof(TargaHeader) + hdr.idLength;
+    std::streamoff dataSize = (std::streamoff)hdr.width * hdr.height * (hdr.bpp / 8);
+    mFile.seekg(0, std::ios::end);
+    std::streamoff len = mFile.tellg();
+    if (len < dataOffset + dataSize) {
+        std::cerr << "*** TGA file '" << path << "' is truncated" << std::endl;
+        Close();
+        return false;
+    }
+
+    mPath = path;
+    mWidth = hdr.width;
+    mHeight = hdr.height;
+    mBytesPerPixel = hdr.bpp / 8;
+    mDataOffset = dataOffset;
+    mTopDown = (hdr.imageDesc & 0x20) != 0;
+
+    return true;
+}
+
+void TargaRegionReader::Close()
+{
+    if (mFile.is_open()) {
+        mFile.close();
+    }
+    mFile.clear();
+    mPath.clear();
+    mWidth = 0;
+    mHeight = 0;
+    mBytesPerPixel = 0;
+    mDataOffset = 0;
+    mTopDown = false;
+    std::vector<unsigned char>().swap(mBuffer);
+}
+
+bool TargaRegionReader::ReadRegion(int x, int y, int w, int h, unsigned char* dst)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > mWidth || y + h > mHeight) {
+        std::cerr << "*** Region " << w << "x" << h << " at (" << x << ", " << y << ") is outside of '" << mPath << "'" << std::endl;
+        return false;
+    }
+
+    size_t fileRowLen = (size_t)mWidth * mBytesPerPixel;
+    size_t rowLen = (size_t)w * mBytesPerPixel;
+
+    if (rowLen * 2 < fileRowLen) {
+        // narrow region: seek to each row and read just the part we want, straight into dst
+        for (int j = 0; j < h; j++) {
+            int fileRow = mTopDown ? mHeight - 1 - (y + j) : y + j;
+            unsigned char* dstRow = dst + (size_t)j * rowLen;
+
+            mFile.seekg(mDataOffset + (std::streamoff)fileRow * fileRowLen + (std::streamoff)x * mBytesPerPixel);
+            if (!mFile.read(reinterpret_cast<char*>(dstRow), rowLen)) {
+                std::cerr << "*** Failed to read from '" << mPath << "'" << std::endl;
+                mFile.clear();
+                return false;
+            }
+
+            // the swizzles work in place, grayscale needs nothing
+            if (mBytesPerPixel > 1) {
+                ConvertTargaPixels(dstRow, dstRow, w, mBytesPerPixel);
+            }
+        }
+        return true;
+    }
+
+    //
+    // Wide region: skipping the bits of each row outside the region isn't worth a request,
+    // so read runs of whole rows into a buffer and convert the part inside the region.
+    //
+    int rowsPerChunk = (int)(TARGA_REGION_BUFFER_SIZE / fileRowLen);
+    if (rowsPerChunk < 1) {
+        rowsPerChunk = 1;
+    }
+    if (rowsPerChunk > h) {
+        rowsPerChunk = h;
+    }
+
+    for (int j = 0; j < h; j += rowsPerChunk) {
+        int n = h - j < rowsPerChunk ? h - j : rowsPerChunk;
+
+        // image rows y + j .. y + j + n - 1 are stored forwards or backwards
+        int firstFileRow = mTopDown ? mHeight - (y + j + n) : y + j;
+
+        size_t chunkLen = (n - 1) * fileRowLen + rowLen;
+        if (mBuffer.size() < chunkLen) {
+            mBuffer.resize(chunkLen);
+        }
+
+        mFile.seekg(mDataOffset + (std::streamoff)firstFileRow * fileRowLen + (std::streamoff)x * mBytesPerPixel);
+        if (!mFile.read(reinterpret_cast<char*>(&mBuffer[0]), chunkLen)) {
+            std::cerr << "*** Failed to read from '" << mPath << "'" << std::endl;
+            mFile.clear();
+            return false;
+        }
+
+        for (int k = 0; k < n; k++) {
+            int bufRow = mTopDown ? n - 1 - k : k;
+            ConvertTargaPixels(dst + (size_t)(j + k) * rowLen, &mBuffer[bufRow * fileRowLen], w, mBytesPerPixel);
+        }
+    }
+
+    return true;
+}
+
+bool TargaRegionReader::ReadRegion(int x, int y, int w, int h, Image& img)
+{
+    if (!isOpen() || !img.Allocate(w, h, mBytesPerPixel)) {
         return false;
     }
+    if (!ReadRegion(x, y, w, h, img.getData())) {
+        img.Deallocate();
+        return false;
+    }
+    return true;
+}
+
+//
+// Mipmap generation
+//
+
+// a level is only split across the thread pool if it has at least this many pixels...
+static const int MIPMAP_PARALLEL_PIXELS = 64 * 1024;
+
+// ...and each band of rows gets about this many
+static const int MIPMAP_BAND_PIXELS = 16 * 1024;
+
+//
+// Source pixels and weights for one destination pixel along one axis.
+//
+struct ReduceTaps {
+    int     first;
+    int     count;
+    float   weight[3];
+};
+
+//
+// Taps for halving an axis of srcSize pixels to dstSize = max(1, srcSize / 2).
+// Even sizes are a plain 2-tap box.  Odd sizes use a 3-tap polyphase filter whose footprint
+// shifts across the row, so every source pixel contributes exactly 1 / srcSize of the total.
+//
+static void ComputeReduceTaps(std::vector<ReduceTaps>& taps, int srcSize, int dstSize)
+{
+    taps.resize(dstSize);
+
+    for (int i = 0; i < dstSize; i++) {
+        ReduceTaps& t = taps[i];
+        if (srcSize == 1) {
+            t.first = 0;
+            t.count = 1;
+            t.weight[0] = 1.0f;
+        } else if (srcSize == 2 * dstSize) {
+            t.first = 2 * i;
+            t.count = 2;
+            t.weight[0] = 0.5f;
+            t.weight[1] = 0.5f;
+        } else {
+            float s = 1.0f / srcSize;
+            t.first = 2 * i;
+            t.count = 3;
+            t.weight[0] = (dstSize - i) * s;
+            t.weight[1] = dstSize * s;
+            t.weight[2] = (i + 1) * s;
+        }
+    }
+}
+
+//
+// Reduce rows [rowBegin, rowEnd) of the destination level with the 2x2 box kernel.
+// Only for even widths and even heights (or a height of 1).
+//
+static void ReduceRowsBox(unsigned char* dst, int dstWidth, const unsigned char* src, int srcWidth, int srcHeight,
+                          int bpp, int rowBegin, int rowEnd)
+{
+    size_t srcStride = (size_t)srcWidth * bpp;
+    size_t dstStride = (size_t)dstWidth * bpp;
+
+    for (int j = rowBegin; j < rowEnd; j++) {
+        const unsigned char* row0 = src + 2 * j * srcStride;
+        const unsigned char* row1 = srcHeight > 1 ? row0 + srcStride : row0;
+        DownsampleRow2x2(dst + j * dstStride, row0, row1, dstWidth, bpp);
+    }
+}
+
+//
+// Reduce rows [rowBegin, rowEnd) of the destination level with the separable polyphase filter.
+//
+static void ReduceRowsPolyphase(unsigned char* dst, int dstWidth, const unsigned char* src, int srcWidth,
+                                const std::vector<ReduceTaps>& xTaps, const std::vector<ReduceTaps>& yTaps,
+                                int bpp, int rowBegin, int rowEnd)
+{
+    size_t srcStride = (size_t)srcWidth * bpp;
+    unsigned char* q = dst + (size_t)rowBegin * dstWidth * bpp;
+
+    for (int j = rowBegin; j < rowEnd; j++) {
+        const ReduceTaps& ty = yTaps[j];
+
+        for (int i = 0; i < dstWidth; i++) {
+            const ReduceTaps& tx = xTaps[i];
+
+            for (int c = 0; c < bpp; c++) {
+                float acc = 0.0f;
+                for (int y = 0; y < ty.count; y++) {
+                    const unsigned char* p = src + (ty.first + y) * srcStride + tx.first * bpp + c;
+                    float rowAcc = 0.0f;
+                    for (int x = 0; x < tx.count; x++) {
+                        rowAcc += tx.weight[x] * p[x * bpp];
+                    }
+                    acc += ty.weight[y] * rowAcc;
+                }
 
-    // dimensions must be powers of two, otherwise we need a more sophisticated method
-    if (!IsPowerOf2(mWidth) || !IsPowerOf2(mHeight)) {
+                int v = (int)(acc + 0.5f);
+                *q++ = (unsigned char)(v < 255 ? v : 255);
+            }
+        }
+    }
+}
+
+bool Image::GenerateMipmaps(int minSize)
+{
+    // there must be an image loaded
+    if (!isGood()) {
         return false;
     }
 
@@ -393,48 +921,173 @@ bool Image::GenerateMipmaps(int minSize)
         minSize = 1;
     }
 
-    const Mipmap& prev = mMipmaps.back();
-    int prevWidth = prev.width;
-    int prevHeight = prev.height;
-    int dstWidth = prevWidth >> 1;
-    int dstHeight = prevHeight >> 1;
+    // lay out the whole chain, and grow the block once if it doesn't fit
+    std::vector<Mipmap> levels;
+    size_t size = LayoutMipmaps(levels, mWidth, mHeight, mBytesPerPixel, 0, minSize);
+    if (size > mCapacity) {
+        unsigned char* data = new unsigned char[size];
+        memcpy(data, mData, levels[0].size);
+        delete [] mData;
+        mData = data;
+        mCapacity = size;
+    }
+    mMipmaps.swap(levels);
+    mDataSize = size;
+
+    std::vector<ReduceTaps> xTaps, yTaps;
 
-    const unsigned char* srcData = prev.data;
-    int srcStride = prev.width * mBytesPerPixel;
+    // each level is reduced from the one before it
+    for (unsigned level = 1; level < mMipmaps.size(); level++) {
+        const Mipmap& src = mMipmaps[level - 1];
+        const Mipmap& dst = mMipmaps[level];
+        int srcWidth = src.width;
+        int srcHeight = src.height;
+        int dstWidth = dst.width;
+        int dstHeight = dst.height;
+        const unsigned char* srcData = mData + src.offset;
+        unsigned char* dstData = mData + dst.offset;
+        int bpp = mBytesPerPixel;
 
-    while (dstWidth >= minSize && dstHeight >= minSize) {
+        std::function<void(unsigned, unsigned)> reduceRows;
+        if (srcWidth == 2 * dstWidth && (srcHeight == 2 * dstHeight || srcHeight == 1)) {
+            reduceRows = [=](unsigned rowBegin, unsigned rowEnd) {
+                ReduceRowsBox(dstData, dstWidth, srcData, srcWidth, srcHeight, bpp, rowBegin, rowEnd);
+            };
+        } else {
+            ComputeReduceTaps(xTaps, srcWidth, dstWidth);
+            ComputeReduceTaps(yTaps, srcHeight, dstHeight);
+            const std::vector<ReduceTaps>* px = &xTaps;
+            const std::vector<ReduceTaps>* py = &yTaps;
+            reduceRows = [=](unsigned rowBegin, unsigned rowEnd) {
+                ReduceRowsPolyphase(dstData, dstWidth, srcData, srcWidth, *px, *py, bpp, rowBegin, rowEnd);
+            };
+        }
+
+        // split big levels into bands of rows; small ones aren't worth the hand-off
+        if (dstWidth * dstHeight >= MIPMAP_PARALLEL_PIXELS) {
+            unsigned bandRows = MIPMAP_BAND_PIXELS / dstWidth;
+            GetSharedThreadPool().parallelFor(dstHeight, bandRows > 0 ? bandRows : 1, reduceRows);
+        } else {
+            reduceRows(0, dstHeight);
+        }
+    }
 
-        unsigned char* dstData = new unsigned char [dstWidth * dstHeight * mBytesPerPixel];
-        unsigned char* q = dstData;
-        int dstStride = dstWidth * mBytesPerPixel;
+    return true;
+}
 
-        //int n = dstWidth * dstHeight * mBytesPerPixel;
 
-        for (int j = 0; j < dstHeight; j++) {
-            //unsigned char* dstRow = dstData + j * dstStride;
+//
+// Texture upload
+//
 
-            const unsigned char* p1 = srcData + 2 * j * srcStride;
-            const unsigned char* p2 = p1 + srcStride;
+const Image* PrepareTextureImage(const Image& img, bool genMipmaps, Image& scratch)
+{
+    int bpp = img.getBytesPerPixel();
+    int width = img.getWidth();
+    int height = img.getHeight();
 
-            for (int i = 0; i < dstStride; i++) {
-                unsigned a = (unsigned)*p1 + (unsigned)*(p1 + mBytesPerPixel);
-                unsigned b = (unsigned)*p2 + (unsigned)*(p2 + mBytesPerPixel);
-                p1 += 2 * mBytesPerPixel;
-                p2 += 2 * mBytesPerPixel;
+    int numLevels = genMipmaps ? img.numMipmaps() : 1;
+    bool buildMipmaps = genMipmaps && numLevels == 1 && (width > 1 || height > 1);
 
-                *q++ = (a + b) / 4;
-            }
+    if (bpp != 3 && !buildMipmaps && numLevels == img.numMipmaps()) {
+        return &img;
+    }
+
+    if (!scratch.Allocate(width, height, bpp == 3 ? 4 : bpp, buildMipmaps ? 0 : numLevels)) {
+        std::cerr << "*** Failed to allocate memory for texture levels" << std::endl;
+        return NULL;
+    }
+
+    int numCopied = buildMipmaps ? 1 : numLevels;
+    for (int level = 0; level < numCopied; level++) {
+        if (bpp == 3) {
+            size_t numPixels = (size_t)img.getMipmapWidth(level) * img.getMipmapHeight(level);
+            ExpandRGBToRGBA(scratch.getMipmapData(level), img.getMipmapData(level), numPixels);
+        } else {
+            memcpy(scratch.getMipmapData(level), img.getMipmapData(level), img.getMipmapSize(level));
         }
+    }
 
-        mMipmaps.push_back(Mipmap(dstWidth, dstHeight, dstData));
+    if (buildMipmaps) {
+        scratch.GenerateMipmaps(1);
+    }
+
+    return &scratch;
+}
 
-        prevWidth = dstWidth;
-        prevHeight = dstHeight;
-        dstWidth >>= 1;
-        dstHeight >>= 1;
+// source pixels and 8-bit fraction for sampling at texel centers along one axis
+static void GetBilinearTaps(std::vector<int>& i0, std::vector<int>& i1, std::vector<unsigned>& frac, int srcSize, int dstSize)
+{
+    i0.resize(dstSize);
+    i1.resize(dstSize);
+    frac.resize(dstSize);
+
+    float scale = (float)srcSize / dstSize;
+    for (int i = 0; i < dstSize; i++) {
+        float s = (i + 0.5f) * scale - 0.5f;
+        if (s < 0) {
+            s = 0;
+        }
+        int k = (int)s;
+        if (k >= srcSize - 1) {
+            k = srcSize - 1;
+            s = (float)k;
+        }
+        i0[i] = k;
+        i1[i] = k + 1 < srcSize ? k + 1 : k;
+        frac[i] = (unsigned)((s - k) * 256 + 0.5f);
+    }
+}
+
+bool ResizeImage(const Image& src, int width, int height, Image& dst)
+{
+    if (!src.isGood() || !dst.Allocate(width, height, src.getBytesPerPixel())) {
+        return false;
+    }
+
+    int bpp = src.getBytesPerPixel();
+    int srcWidth = src.getWidth();
+    size_t srcPitch = (size_t)srcWidth * bpp;
+    size_t dstPitch = (size_t)width * bpp;
+    const unsigned char* srcData = src.getData();
+    unsigned char* dstData = dst.getData();
+
+    std::vector<int> x0, x1, y0, y1;
+    std::vector<unsigned> fx, fy;
+    GetBilinearTaps(x0, x1, fx, srcWidth, width);
+    GetBilinearTaps(y0, y1, fy, src.getHeight(), height);
+
+    // rows are independent, so they go in parallel bands like the mipmap reductions
+    std::function<void(unsigned, unsigned)> resizeRows = [&](unsigned begin, unsigned end) {
+        for (unsigned y = begin; y < end; y++) {
+            const unsigned char* row0 = srcData + y0[y] * srcPitch;
+            const unsigned char* row1 = srcData + y1[y] * srcPitch;
+            unsigned wy = fy[y];
+            unsigned char* out = dstData + y * dstPitch;
+            for (int x = 0; x < width; x++) {
+                const unsigned char* p00 = row0 + x0[x] * bpp;
+                const unsigned char* p01 = row0 + x1[x] * bpp;
+                const unsigned char* p10 = row1 + x0[x] * bpp;
+                const unsigned char* p11 = row1 + x1[x] * bpp;
+                unsigned wx = fx[x];
+                for (int c = 0; c < bpp; c++) {
+                    unsigned top = p00[c] * (256 - wx) + p01[c] * wx;
+                    unsigned bottom = p10[c] * (256 - wx) + p11[c] * wx;
+                    *out++ = (unsigned char)((top * (256 - wy) + bottom * wy + 32768) >> 16);
+                }
+            }
+        }
+    };
+
+    if (width * height >= MIPMAP_PARALLEL_PIXELS) {
+        unsigned bandRows = MIPMAP_BAND_PIXELS / width;
+        GetSharedThreadPool().parallelFor(height, bandRows > 0 ? bandRows : 1, resizeRows);
+    } else {
+        resizeRows(0, height);
     }
 
     return true;
 }
 
+
 } // end of namespace
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <fstream>
+#include <cstddef>
 
 namespace glsh {
 
@@ -10,17 +12,25 @@ namespace glsh {
 struct TargaHeader;
 
 
+//
+// An image and its mip chain, stored in a single block of memory.
+// Level 0 starts at the beginning of the block; the other levels follow in order,
+// each at a 16-byte aligned offset.
+//
 class Image {
 private:
     int                     mWidth, mHeight;
     int                     mBytesPerPixel;
-    unsigned char*          mData;
+    unsigned char*          mData;          // the whole block, starting with level 0
+    size_t                  mDataSize;      // bytes used by the levels we have
+    size_t                  mCapacity;      // bytes allocated
 
 public:
                             Image();
                             ~Image();
 
-    bool                    Allocate(int width, int height, int bytesPerPixel);
+    // numLevels < 1 reserves room for the full chain down to 1x1; level contents are left undefined
+    bool                    Allocate(int width, int height, int bytesPerPixel, int numLevels = 1);
     void                    Deallocate();
 
     bool                    isGood() const              { return mData != 0; }
@@ -31,15 +41,25 @@ public:
     const unsigned char*    getData() const             { return mData; }
     unsigned char*          getData()                   { return mData; }
 
+    // size of the block holding all the levels, padding included
+    size_t                  getDataSize() const         { return mDataSize; }
+
+    // load a .tga or .qoi file, picking the codec by extension
+    bool                    Load(const std::string& path);
+
     bool                    LoadTarga(const std::string& path);
 
+    // QOI ("Quite OK Image") files, 3 or 4 bytes per pixel; only level 0 is saved
+    bool                    LoadQOI(const std::string& path);
+    bool                    SaveQOI(const std::string& path) const;
+
 private:
 
     //
     // helper methods for loading TGA images
     //
     void                    LoadTargaUncompressed(const TargaHeader* hdr, const unsigned char* imgData);
-    void                    LoadTargaRLE(const TargaHeader* hdr, const unsigned char* imgData);
+    bool                    LoadTargaRLE(const TargaHeader* hdr, const unsigned char* imgData, const unsigned char* imgEnd);
 
     //
     // stuff needed for mipmapping
@@ -47,21 +67,28 @@ private:
 
     struct Mipmap {
         int             width, height;
-        unsigned char*  data;
+        size_t          offset;         // from the start of the block
+        size_t          size;           // in bytes, without padding
 
         Mipmap()
             : width(0)
             , height(0)
-            , data(NULL)
+            , offset(0)
+            , size(0)
         { }
 
-        Mipmap(int width, int height, unsigned char* data)
+        Mipmap(int width, int height, size_t offset, size_t size)
             : width(width)
             , height(height)
-            , data(data)
+            , offset(offset)
+            , size(size)
         { }
     };
 
+    // fill in the level table for a chain of up to maxLevels levels (< 1 means all of them), returns the total size
+    static size_t           LayoutMipmaps(std::vector<Mipmap>& levels, int width, int height, int bytesPerPixel,
+                                          int maxLevels, int minSize);
+
     std::vector<Mipmap>     mMipmaps;
 
 public:
@@ -72,8 +99,58 @@ public:
 
     int                     getMipmapWidth(int level) const     { return mMipmaps[level].width; }
     int                     getMipmapHeight(int level) const    { return mMipmaps[level].height; }
-    const unsigned char*    getMipmapData(int level) const      { return mMipmaps[level].data; }
-    unsigned char*          getMipmapData(int level)            { return mMipmaps[level].data; }
+    size_t                  getMipmapOffset(int level) const    { return mMipmaps[level].offset; }
+    size_t                  getMipmapSize(int level) const      { return mMipmaps[level].size; }
+    const unsigned char*    getMipmapData(int level) const      { return mData + mMipmaps[level].offset; }
+    unsigned char*          getMipmapData(int level)            { return mData + mMipmaps[level].offset; }
+};
+
+
+//
+// Make an image ready for texture upload without touching GL, so it can run on any thread:
+// RGB is padded to RGBA, and the mip chain is built if genMipmaps is set and the image has none.
+// Returns img itself when it needs no changes, otherwise scratch; NULL on failure.
+//
+const Image* PrepareTextureImage(const Image& img, bool genMipmaps, Image& scratch);
+
+//
+// Resample level 0 of an image to a new size with a bilinear filter, into a fresh single-level image.
+// Meant for enlarging, or shrinking by less than half; GenerateMipmaps does a better job of halving.
+//
+bool ResizeImage(const Image& src, int width, int height, Image& dst);
+
+
+//
+// Reads rectangles out of an uncompressed TGA file by seeking, without loading the rest of it,
+// so huge images can be used a piece at a time.  Coordinates follow Image's row order,
+// with row 0 at the bottom.
+//
+class TargaRegionReader {
+    std::ifstream               mFile;
+    std::string                 mPath;
+    int                         mWidth, mHeight;
+    int                         mBytesPerPixel;
+    std::streamoff              mDataOffset;
+    bool                        mTopDown;       // file rows run top to bottom
+    std::vector<unsigned char>  mBuffer;
+
+public:
+                                TargaRegionReader();
+
+    // only uncompressed 8, 24, and 32 bpp files can be read by region
+    bool                        Open(const std::string& path);
+    void                        Close();
+
+    bool                        isOpen() const              { return mWidth > 0; }
+    int                         getWidth() const            { return mWidth; }
+    int                         getHeight() const           { return mHeight; }
+    int                         getBytesPerPixel() const    { return mBytesPerPixel; }
+
+    // read the w x h rectangle at (x, y) into dst as tightly packed RGB(A) rows
+    bool                        ReadRegion(int x, int y, int w, int h, unsigned char* dst);
+
+    // same, into a freshly allocated image
+    bool                        ReadRegion(int x, int y, int w, int h, Image& img);
 };
 
 } // end of namespace
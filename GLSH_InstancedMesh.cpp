@@ -0,0 +1,184 @@
+#include "GLSH_InstancedMesh.h"
+
+#include <iostream>
+
+namespace glsh {
+
+// how long Map waits for the GPU to finish with a region before giving up and overwriting it anyway
+static const GLuint64 s_fenceTimeout = 1000000000;   // 1 second, in nanoseconds
+
+InstancedMesh::InstancedMesh(const Mesh* base, const VertexFormat& instanceFormat, unsigned maxInstances,
+                             GLuint buffer, unsigned char* mapped, size_t regionSize)
+    : Mesh(base->getVAO(), base->mDrawingMode)
+    , mBase(base)
+    , mInstanceFormat(&instanceFormat)
+    , mMaxInstances(maxInstances)
+    , mNumInstances(0)
+    , mBuffer(buffer)
+    , mRegionSize(regionSize)
+    , mMapped(mapped)
+    , mWriteRegion(0)
+    , mDrawRegion(0)
+{
+    for (unsigned i = 0; i < NumRegions; i++) {
+        mFences[i] = 0;
+    }
+
+    if (!mMapped) {
+        mStaging.resize(mRegionSize);
+    }
+}
+
+InstancedMesh::~InstancedMesh()
+{
+    for (unsigned i = 0; i < NumRegions; i++) {
+        if (mFences[i]) {
+            glDeleteSync(mFences[i]);
+        }
+    }
+
+    // deleting the buffer unmaps it
+    if (mBuffer) {
+        glDeleteBuffers(1, &mBuffer);
+    }
+
+    // the VAO is the base mesh's, don't let ~Mesh delete it
+    mVAO = 0;
+}
+
+void* InstancedMesh::Map()
+{
+    if (!mMapped) {
+        return &mStaging[0];
+    }
+
+    // wait until the GPU is done with the last draw that read this region
+    GLsync& fence = mFences[mWriteRegion];
+    if (fence) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, s_fenceTimeout);
+        if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+            std::cerr << "*** Instance buffer region still in use after waiting, overwriting it" << std::endl;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    return mMapped + mWriteRegion * mRegionSize;
+}
+
+void InstancedMesh::Unmap(unsigned numInstances)
+{
+    if (numInstances > mMaxInstances) {
+        numInstances = mMaxInstances;
+    }
+
+    if (mMapped) {
+        // the mapping is coherent, so the writes are already visible; just move on to the next region
+        mDrawRegion = mWriteRegion;
+        mWriteRegion = (mWriteRegion + 1) % NumRegions;
+    } else {
+        // orphan the old storage, so the upload doesn't wait for draws still reading it
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, mRegionSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, numInstances * mInstanceFormat->getVertexSizeInBytes(), &mStaging[0]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mDrawRegion = 0;
+    }
+
+    mNumInstances = numInstances;
+}
+
+void InstancedMesh::drawImpl() const
+{
+    drawInstancedImpl(mNumInstances);
+}
+
+void InstancedMesh::drawInstancedImpl(GLsizei numInstances) const
+{
+    if (numInstances > mNumInstances) {
+        numInstances = mNumInstances;
+    }
+    if (numInstances <= 0) {
+        return;
+    }
+
+    // the base mesh's VAO is bound; point its instance attributes at the region to draw
+    const char* regionStart = (const char*)GLSH_BUFFER_OFFSET(mDrawRegion * mRegionSize);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    for (unsigned i = 0; i < mInstanceFormat->numAttribs(); i++) {
+        const VertexAttrib& a = mInstanceFormat->getAttrib(i);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, regionStart + (size_t)a.offset);
+        glVertexAttribDivisor(a.index, a.divisor);
+        glEnableVertexAttribArray(a.index);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mBase->drawInstancedImpl(numInstances);
+
+    // and leave the VAO the way it was
+    for (unsigned i = 0; i < mInstanceFormat->numAttribs(); i++) {
+        const VertexAttrib& a = mInstanceFormat->getAttrib(i);
+        glDisableVertexAttribArray(a.index);
+        glVertexAttribDivisor(a.index, 0);
+    }
+
+    if (mMapped) {
+        // Map waits on this before writing the region again; a later draw's fence covers the earlier ones
+        if (mFences[mDrawRegion]) {
+            glDeleteSync(mFences[mDrawRegion]);
+        }
+        mFences[mDrawRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+InstancedMesh* CreateInstancedMesh(const Mesh* base, const VertexFormat& instanceFormat, unsigned maxInstances)
+{
+    if (!base || maxInstances == 0) {
+        std::cerr << "*** Can't create instanced mesh without a base mesh and room for instances" << std::endl;
+        return NULL;
+    }
+
+    // the divisors and instanced draws are the core entry points, and the shaders are #version 330
+    if (!GLEW_VERSION_3_3) {
+        std::cerr << "*** Can't create instanced mesh: needs OpenGL 3.3" << std::endl;
+        return NULL;
+    }
+
+    size_t regionSize = (size_t)maxInstances * instanceFormat.getVertexSizeInBytes();
+    unsigned char* mapped = NULL;
+
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    if (!buffer) {
+        std::cerr << "*** Failed to create instance buffer" << std::endl;
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size_t size = regionSize * InstancedMesh::NumRegions;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+
+        if (!mapped) {
+            // storage is immutable, so start over with a buffer that glBufferData can resize
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        }
+    }
+
+    if (!mapped) {
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return new InstancedMesh(base, instanceFormat, maxInstances, buffer, mapped, regionSize);
+}
+
+} // end of namespace
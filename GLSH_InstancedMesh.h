@@ -0,0 +1,101 @@
+#ifndef GLSH_INSTANCEDMESH_H_
+#define GLSH_INSTANCEDMESH_H_
+
+#include "GLSH_Mesh.h"
+
+#include <cstring>
+#include <vector>
+
+namespace glsh {
+
+//
+// Many copies of a base mesh in one draw call, each with its own per-instance attributes (such as
+// InstanceTransformTint) read from an instance buffer, with the divisors from the instance VertexFormat.
+//
+// The instances can change every frame: write them to the memory Map returns and hand it back with Unmap
+// (or use SetInstances).  With GL 4.4 or ARB_buffer_storage the instance buffer is mapped once, persistently,
+// as NumRegions regions used in turn, and a fence after each draw keeps Map from handing out a region
+// the GPU hasn't finished reading.  So writing instances is a plain memory write, with no driver copy and
+// no stall unless the CPU gets NumRegions frames ahead.  Without it, Unmap orphans the buffer and uploads.
+//
+// The instance attributes go on the base mesh's VAO only while drawing, so the base mesh can still be drawn
+// by itself, and several InstancedMeshes can share one.  The base mesh must outlive them.
+//
+class InstancedMesh : public Mesh {
+public:
+    static const unsigned   NumRegions = 3;
+
+private:
+    const Mesh*                 mBase;
+    const VertexFormat*         mInstanceFormat;
+    unsigned                    mMaxInstances;
+    GLsizei                     mNumInstances;
+
+    GLuint                      mBuffer;
+    size_t                      mRegionSize;        // bytes, room for mMaxInstances
+    unsigned char*              mMapped;            // the whole persistent mapping, or NULL if there isn't one
+    unsigned                    mWriteRegion;       // the region Map hands out
+    unsigned                    mDrawRegion;        // the region with the instances to draw
+    mutable GLsync              mFences[NumRegions];
+    std::vector<unsigned char>  mStaging;           // what Map hands out when there's no persistent mapping
+
+public:
+    // NOTE: takes ownership of the instance buffer, and the mapping, if there is one
+    InstancedMesh(const Mesh* base, const VertexFormat& instanceFormat, unsigned maxInstances,
+                  GLuint buffer, unsigned char* mapped, size_t regionSize);
+
+    virtual ~InstancedMesh() override;
+
+    // memory for up to getMaxInstances() instances, laid out as the instance format says
+    void*                       Map();
+
+    // the first numInstances instances written since Map are the ones drawn from now on
+    void                        Unmap(unsigned numInstances);
+
+    template <typename InstanceType>
+    void                        SetInstances(const InstanceType* instances, unsigned numInstances)
+    {
+        if (numInstances > mMaxInstances) {
+            numInstances = mMaxInstances;
+        }
+        memcpy(Map(), instances, numInstances * sizeof(InstanceType));
+        Unmap(numInstances);
+    }
+
+    template <typename InstanceType>
+    void                        SetInstances(const std::vector<InstanceType>& instances)
+    {
+        SetInstances(instances.empty() ? NULL : &instances[0], (unsigned)instances.size());
+    }
+
+    const Mesh*                 getBase() const             { return mBase; }
+    unsigned                    getMaxInstances() const     { return mMaxInstances; }
+    GLsizei                     getNumInstances() const     { return mNumInstances; }
+    bool                        isPersistentlyMapped() const { return mMapped != NULL; }
+
+protected:
+    virtual void                drawImpl() const override;
+    virtual void                drawInstancedImpl(GLsizei numInstances) const override;
+
+private:
+                                // noncopyable
+                                InstancedMesh(const InstancedMesh&);
+                                InstancedMesh& operator= (const InstancedMesh&);
+};
+
+//
+// Create an instanced mesh that draws up to maxInstances copies of base, with per-instance attributes
+// laid out as instanceFormat says.  Needs GL 3.3; returns NULL without it.
+//
+InstancedMesh* CreateInstancedMesh(const Mesh* base, const VertexFormat& instanceFormat, unsigned maxInstances);
+
+// InstanceType needs a static GetFormat method, like InstanceTransformTint
+template <typename InstanceType>
+InstancedMesh* CreateInstancedMesh(const Mesh* base, unsigned maxInstances)
+{
+    return CreateInstancedMesh(base, InstanceType::GetFormat(), maxInstances);
+}
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,193 @@
+#include "GLSH_LODMesh.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace glsh {
+
+LODMesh::LODMesh(GLuint vbo, GLuint ibo, GLuint vao, GLenum indexType, const std::vector<MeshLODLevel>& levels,
+                 const glm::vec3& center, float radius)
+    : Mesh(vao, GL_TRIANGLES)
+    , mVBO(vbo)
+    , mIBO(ibo)
+    , mIndexType(indexType)
+    , mLevels(levels)
+    , mCenter(center)
+    , mRadius(radius)
+    , mLevel(0)
+{
+}
+
+LODMesh::~LODMesh()
+{
+    if (mIBO) {
+        glDeleteBuffers(1, &mIBO);
+    }
+    if (mVBO) {
+        glDeleteBuffers(1, &mVBO);
+    }
+}
+
+unsigned LODMesh::SelectLOD(const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError)
+{
+    mLevel = SelectLODLevel(mLevels, mCenter, mRadius, camera, modelMatrix, maxPixelError);
+    return mLevel;
+}
+
+void LODMesh::drawImpl() const
+{
+    const MeshLODLevel& level = mLevels[mLevel];
+    glDrawElements(mDrawingMode, (GLsizei)level.numIndices, mIndexType,
+                   GLSH_BUFFER_OFFSET(level.firstIndex * GetGLTypeSize(mIndexType)));
+}
+
+void LODMesh::drawInstancedImpl(GLsizei numInstances) const
+{
+    const MeshLODLevel& level = mLevels[mLevel];
+    glDrawElementsInstanced(mDrawingMode, (GLsizei)level.numIndices, mIndexType,
+                            GLSH_BUFFER_OFFSET(level.firstIndex * GetGLTypeSize(mIndexType)), numInstances);
+}
+
+unsigned SelectLODLevel(const std::vector<MeshLODLevel>& levels, const glm::vec3& center, float radius,
+                        const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError)
+{
+    // the model matrix scales the errors along with the mesh
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                           std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    glm::vec3 worldCenter = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+
+    // how many pixels a unit comes out as, at distance 1 for a perspective projection, anywhere for orthographic
+    glm::mat4 projection = camera.getProjectionMatrix();
+    float pixelsPerUnit = 0.5f * camera.getViewportHeight() * projection[1][1];
+
+    if (projection[2][3] != 0.0f) {
+        // perspective: the nearest point of the bounding sphere is where the errors look biggest
+        float distance = glm::length(worldCenter - camera.getPosition()) - radius * scale;
+        if (distance <= 0.0f) {
+            return 0;
+        }
+        pixelsPerUnit /= distance;
+    }
+
+    unsigned level = 0;
+    while (level + 1 < levels.size() && levels[level + 1].error * scale * pixelsPerUnit <= maxPixelError) {
+        ++level;
+    }
+    return level;
+}
+
+// the vertex's position, from floats or half floats
+static glm::vec3 GetPosition(const void* vertices, unsigned i, const VertexAttrib& a)
+{
+    const char* p = (const char*)vertices + (size_t)i * a.stride + (size_t)a.offset;
+    if (a.type == GL_HALF_FLOAT) {
+        const GLhalf* h = (const GLhalf*)p;
+        return glm::vec3(HalfToFloat(h[0]), HalfToFloat(h[1]), HalfToFloat(h[2]));
+    }
+    const GLfloat* f = (const GLfloat*)p;
+    return glm::vec3(f[0], f[1], f[2]);
+}
+
+bool ComputeBoundingSphere(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                           glm::vec3& center, float& radius)
+{
+    const VertexAttrib* position = NULL;
+    for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
+        const VertexAttrib& a = vertexFormat.getAttrib(i);
+        if (a.index == VA_POSITION && a.size >= 3 && (a.type == GL_FLOAT || a.type == GL_HALF_FLOAT)) {
+            position = &a;
+        }
+    }
+    if (!position || !vertices || numVertices == 0) {
+        return false;
+    }
+
+    // a sphere around the bounding box is close enough for picking levels
+    glm::vec3 lo = GetPosition(vertices, 0, *position);
+    glm::vec3 hi = lo;
+    for (unsigned i = 1; i < numVertices; i++) {
+        glm::vec3 p = GetPosition(vertices, i, *position);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    center = 0.5f * (lo + hi);
+    radius = 0.0f;
+    for (unsigned i = 0; i < numVertices; i++) {
+        radius = std::max(radius, glm::length(GetPosition(vertices, i, *position) - center));
+    }
+    return true;
+}
+
+LODMesh* CreateLODMesh(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                       const std::vector<unsigned>& lodIndices, const std::vector<MeshLODLevel>& levels)
+{
+    if (!vertices || numVertices == 0 || lodIndices.empty() || levels.empty()) {
+        std::cerr << "*** Can't create LOD mesh without vertices and levels" << std::endl;
+        return NULL;
+    }
+
+    glm::vec3 center;
+    float radius;
+    if (!ComputeBoundingSphere(vertices, numVertices, vertexFormat, center, radius)) {
+        std::cerr << "*** Can't create LOD mesh: vertex format has no float or half float positions" << std::endl;
+        return NULL;
+    }
+
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    if (!vao) {
+        std::cerr << "*** Failed to create VAO for LOD mesh" << std::endl;
+        return NULL;
+    }
+    glBindVertexArray(vao);
+
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+    if (!vbo || !ibo) {
+        std::cerr << "*** Failed to create buffers for LOD mesh" << std::endl;
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        return NULL;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexFormat.getVertexSizeInBytes() * numVertices, vertices, GL_STATIC_DRAW);
+
+    for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
+        const VertexAttrib& a = vertexFormat.getAttrib(i);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
+        glEnableVertexAttribArray(a.index);
+    }
+
+    // all the levels in one buffer; half the size when the vertices can be numbered in 16 bits
+    GLenum indexType = GL_UNSIGNED_INT;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    if (numVertices <= 65536) {
+        std::vector<GLushort> shortIndices(lodIndices.begin(), lodIndices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+        indexType = GL_UNSIGNED_SHORT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndices.size() * sizeof(GLuint), &lodIndices[0], GL_STATIC_DRAW);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::cerr << "*** GL error creating LOD mesh: " << gluErrorString(err) << std::endl;
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        return NULL;
+    }
+
+    return new LODMesh(vbo, ibo, vao, indexType, levels, center, radius);
+}
+
+} // end of namespace
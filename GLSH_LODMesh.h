@@ -0,0 +1,99 @@
+#ifndef GLSH_LODMESH_H_
+#define GLSH_LODMESH_H_
+
+#include "GLSH_Mesh.h"
+#include "GLSH_MeshSimplifier.h"
+#include "GLSH_Camera.h"
+
+#include <vector>
+
+namespace glsh {
+
+//
+// An indexed triangle mesh with a chain of levels of detail from GenerateLODs (GLSH_MeshSimplifier.h):
+// one VBO for all the levels, and one IBO with each level's indices one after the other.
+//
+// SelectLOD picks the level to draw from how big it comes out on screen: the coarsest level whose error,
+// projected at the distance of the mesh's bounding sphere, is within maxPixelError pixels.  Call it once a
+// frame before drawing, with the camera and model matrix the mesh is drawn with; draw uses the last level picked.
+//
+class LODMesh : public Mesh {
+    GLuint                      mVBO;
+    GLuint                      mIBO;
+    GLenum                      mIndexType;
+    std::vector<MeshLODLevel>   mLevels;
+    glm::vec3                   mCenter;        // bounding sphere, in model space
+    float                       mRadius;
+    unsigned                    mLevel;         // the one draw uses
+
+public:
+    // NOTE: mesh takes ownership of VBO, IBO, and VAO
+    LODMesh(GLuint vbo, GLuint ibo, GLuint vao, GLenum indexType, const std::vector<MeshLODLevel>& levels,
+            const glm::vec3& center, float radius);
+
+    virtual ~LODMesh() override;
+
+    // pick the level to draw; returns it
+    unsigned                    SelectLOD(const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError = 1.0f);
+
+    void                        setLOD(unsigned level)      { mLevel = level < mLevels.size() ? level : (unsigned)mLevels.size() - 1; }
+    unsigned                    getLOD() const              { return mLevel; }
+
+    unsigned                    numLODs() const             { return (unsigned)mLevels.size(); }
+    const MeshLODLevel&         getLODLevel(unsigned i) const { return mLevels[i]; }
+
+    const glm::vec3&            getBoundingCenter() const   { return mCenter; }
+    float                       getBoundingRadius() const   { return mRadius; }
+
+protected:
+    virtual void                drawImpl() const override;
+    virtual void                drawInstancedImpl(GLsizei numInstances) const override;
+
+private:
+                                // noncopyable
+                                LODMesh(const LODMesh&);
+                                LODMesh& operator= (const LODMesh&);
+};
+
+//
+// The coarsest of levels whose error, projected at the distance of the bounding sphere (center and radius in
+// model space), is within maxPixelError pixels; what LODMesh::SelectLOD and ArenaMesh::SelectLOD pick.
+//
+unsigned SelectLODLevel(const std::vector<MeshLODLevel>& levels, const glm::vec3& center, float radius,
+                        const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError = 1.0f);
+
+// a sphere around the bounding box of the VA_POSITION attribute (floats or half floats); false if there isn't one
+bool ComputeBoundingSphere(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                           glm::vec3& center, float& radius);
+
+//
+// Create an LOD mesh from vertices and a chain of levels made by GenerateLODs.  The vertex format's
+// VA_POSITION attribute (floats or half floats) gives the bounding sphere.  Indices are 16-bit when there
+// are at most 65536 vertices.
+//
+LODMesh* CreateLODMesh(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                       const std::vector<unsigned>& lodIndices, const std::vector<MeshLODLevel>& levels);
+
+template <typename VertexType>
+LODMesh* CreateLODMesh(const std::vector<VertexType>& vertices, const std::vector<unsigned>& lodIndices,
+                       const std::vector<MeshLODLevel>& levels)
+{
+    if (vertices.empty()) {
+        return NULL;
+    }
+    return CreateLODMesh(&vertices[0], (unsigned)vertices.size(), VertexType::GetFormat(), lodIndices, levels);
+}
+
+// generate the levels too, for vertex types with a glm::vec3 pos member
+template <typename VertexType>
+LODMesh* CreateLODMesh(const std::vector<VertexType>& vertices, const std::vector<unsigned>& indices, unsigned maxLevels)
+{
+    std::vector<unsigned> lodIndices;
+    std::vector<MeshLODLevel> levels;
+    GenerateLODs(lodIndices, levels, vertices, indices, maxLevels);
+    return CreateLODMesh(vertices, lodIndices, levels);
+}
+
+} // end of namespace
+
+#endif
@@ -1,5 +1,6 @@
 #include "GLSH_Mesh.h"
 
+#include <cstring>
 #include <iostream>
 
 namespace glsh {
@@ -39,7 +40,7 @@ VertexMesh* CreateMesh(GLenum drawingMode, const void* verts, unsigned numVerts,
     // describe how the vertex positions are layed out in the active buffer
     for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
         const VertexAttrib& a = vertexFormat.getAttrib(i);
-        glVertexAttribPointer(a.index, a.size, a.type, GL_FALSE, a.stride, a.offset);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
         glEnableVertexAttribArray(a.index);
     }
 
@@ -103,7 +104,7 @@ IndexedMesh* CreateMesh(GLenum drawingMode, const void* verts, unsigned numVerts
     // describe how the vertex positions are layed out in the active buffer
     for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
         const VertexAttrib& a = vertexFormat.getAttrib(i);
-        glVertexAttribPointer(a.index, a.size, a.type, GL_FALSE, a.stride, a.offset);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
         glEnableVertexAttribArray(a.index);
     }
 
@@ -158,4 +159,33 @@ IndexedMesh* CreateMesh(GLenum drawingMode, const void* verts, unsigned numVerts
     return mesh;
 }
 
+void DrawGeometry(StreamBuffer& stream, GLenum drawingMode, const void* verts, unsigned numVerts, const VertexFormat& vertexFormat)
+{
+    if (numVerts == 0) {
+        return;
+    }
+
+    size_t vertexSize = vertexFormat.getVertexSizeInBytes();
+
+    GLuint vao = stream.GetVAO(vertexFormat);
+    if (!vao) {
+        return;
+    }
+
+    // aligned to whole vertices, so the stream VAO can start at offset 0 and the draw picks the first vertex
+    size_t offset = 0;
+    void* dst = stream.Map(numVerts * vertexSize, vertexSize, offset);
+    if (!dst) {
+        return;
+    }
+    memcpy(dst, verts, numVerts * vertexSize);
+    stream.Unmap();
+
+    glBindVertexArray(vao);
+    glDrawArrays(drawingMode, (GLint)(offset / vertexSize), numVerts);
+    glBindVertexArray(0);
+
+    stream.Fence();
+}
+
 }
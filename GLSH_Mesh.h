@@ -6,16 +6,21 @@
 #include <vector>
 
 #include "GLSH_Vertex.h"
+#include "GLSH_StreamBuffer.h"
 
 // a macro that casts an integer offset to a pointer
 #define GLSH_BUFFER_OFFSET(i) ((void*)(i))
 
 namespace glsh {
 
+class InstancedMesh;
+
 //
 // An abstract base class for meshes that use a VAO
 //
 class Mesh {
+    friend class InstancedMesh;     // draws its base mesh's instances with the instance attributes added
+
 protected:
     GLuint  mVAO;            // the VAO describes the data sources and format
     GLenum  mDrawingMode;    // geometric primitive type (GL_TRIANGLES, etc.)
@@ -42,9 +47,28 @@ public:
         glBindVertexArray(0);
     }
 
+    // draw numInstances copies in one call, needs GL 3.3; see InstancedMesh for giving each its own attributes
+    void drawInstanced(GLsizei numInstances) const
+    {
+        // the instanced draw calls are core entry points, which GLEW leaves NULL before 3.3
+        if (!GLEW_VERSION_3_3) {
+            return;
+        }
+
+        glBindVertexArray(mVAO);
+
+        this->drawInstancedImpl(numInstances);
+
+        glBindVertexArray(0);
+    }
+
+    GLuint getVAO() const
+    { return mVAO; }
+
 protected:
 
     virtual void drawImpl() const = 0;    // subclasses must implement their own draw call(s)
+    virtual void drawInstancedImpl(GLsizei numInstances) const = 0;
 };
 
 
@@ -77,6 +101,11 @@ protected:
     {
         glDrawArrays(mDrawingMode, 0, mVertexCount);
     }
+
+    virtual void drawInstancedImpl(GLsizei numInstances) const override
+    {
+        glDrawArraysInstanced(mDrawingMode, 0, mVertexCount, numInstances);
+    }
 };
 
 
@@ -117,6 +146,11 @@ protected:
     {
         glDrawElements(mDrawingMode, mIndexCount, mIndexType, GLSH_BUFFER_OFFSET(0));
     }
+
+    virtual void drawInstancedImpl(GLsizei numInstances) const override
+    {
+        glDrawElementsInstanced(mDrawingMode, mIndexCount, mIndexType, GLSH_BUFFER_OFFSET(0), numInstances);
+    }
 };
 
 
@@ -208,31 +242,36 @@ IndexedMesh* CreateMesh(GLenum drawingMode, const std::vector<VertexType>& verti
 }
 
 //
-// Draw immediate geometry (from RAM)
+// Create an indexed mesh from 32-bit indices, storing them as 16-bit ones if there are few enough vertices.
+// Halving the index buffer saves memory and index fetch bandwidth, and most meshes qualify.
 //
-
 template <typename VertexType>
-void DrawGeometry(GLenum drawingMode, const VertexType* verts, unsigned numVerts)
+IndexedMesh* CreateIndexedMesh(GLenum drawingMode, const std::vector<VertexType>& vertices, const std::vector<unsigned>& indices)
 {
-    // unbind any active VAO
-    glBindVertexArray(0);
-
-    const VertexFormat& fmt = VertexType::GetFormat();
-
-    const char* ptr = (const char*)verts;  // need a byte-sized pointer for offset arithmetic to work properly
-
-    for (unsigned i = 0; i < fmt.numAttribs(); i++) {
-        const VertexAttrib& a = fmt.getAttrib(i);
-        glVertexAttribPointer(a.index, a.size, a.type, GL_FALSE, a.stride, ptr + (size_t)a.offset);  // I... fucking... love... this... language
-        glEnableVertexAttribArray(a.index);
+    if (vertices.size() <= 65536) {
+        std::vector<unsigned short> shortIndices(indices.size());
+        for (unsigned i = 0; i < indices.size(); i++) {
+            shortIndices[i] = (unsigned short)indices[i];
+        }
+        return CreateMesh(drawingMode, vertices, shortIndices);
+    } else {
+        return CreateMesh(drawingMode, vertices, indices);
     }
+}
 
-    glDrawArrays(drawingMode, 0, numVerts);
+//
+// Draw immediate geometry (from RAM)
+//
+// The vertices are copied into a StreamBuffer and drawn from there, so there's no client-side vertex
+// array and nothing allocated per call.  The shared stream buffer is used unless one is given.
+//
 
-    for (unsigned i = 0; i < fmt.numAttribs(); i++) {
-        const VertexAttrib& a = fmt.getAttrib(i);
-        glDisableVertexAttribArray(a.index);
-    }
+void DrawGeometry(StreamBuffer& stream, GLenum drawingMode, const void* verts, unsigned numVerts, const VertexFormat& vertexFormat);
+
+template <typename VertexType>
+void DrawGeometry(GLenum drawingMode, const VertexType* verts, unsigned numVerts)
+{
+    DrawGeometry(GetSharedStreamBuffer(), drawingMode, verts, numVerts, VertexType::GetFormat());
 }
 
 template <typename VertexType>
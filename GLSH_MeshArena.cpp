@@ -0,0 +1,546 @@
+#include "GLSH_MeshArena.h"
+#include "GLSH_LODMesh.h"
+
+#include <iostream>
+#include <map>
+#include <set>
+
+namespace glsh {
+
+//
+// First-fit allocator over [0, capacity), in whatever units the buffer is counted in.
+// Free ranges are kept by offset, so a freed range can find its neighbours and merge with them.
+//
+class RangeAllocator {
+    typedef std::map<unsigned, unsigned> FreeMap;   // offset -> size
+
+    FreeMap         mFree;
+    unsigned        mCapacity;
+    unsigned        mUsed;
+
+public:
+    RangeAllocator()
+        : mCapacity(0)
+        , mUsed(0)
+    { }
+
+    bool Allocate(unsigned size, unsigned& offset)
+    {
+        for (FreeMap::iterator it = mFree.begin(); it != mFree.end(); ++it) {
+            if (it->second >= size) {
+                offset = it->first;
+                unsigned rest = it->second - size;
+                mFree.erase(it);
+                if (rest > 0) {
+                    mFree[offset + size] = rest;
+                }
+                mUsed += size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Free(unsigned offset, unsigned size)
+    {
+        mUsed -= size;
+
+        // merge with the free range after it
+        FreeMap::iterator next = mFree.lower_bound(offset);
+        if (next != mFree.end() && offset + size == next->first) {
+            size += next->second;
+            next = mFree.erase(next);
+        }
+
+        // and the one before it
+        if (next != mFree.begin()) {
+            FreeMap::iterator prev = next;
+            --prev;
+            if (prev->first + prev->second == offset) {
+                prev->second += size;
+                return;
+            }
+        }
+
+        mFree[offset] = size;
+    }
+
+    // add free space at the end
+    void Grow(unsigned capacity)
+    {
+        unsigned extra = capacity - mCapacity;
+        unsigned offset = mCapacity;
+        mCapacity = capacity;
+        mUsed += extra;
+        Free(offset, extra);
+    }
+
+    // everything below used is taken, everything above it is free
+    void Reset(unsigned used)
+    {
+        mFree.clear();
+        mUsed = used;
+        if (used < mCapacity) {
+            mFree[used] = mCapacity - used;
+        }
+    }
+
+    // true if there are no holes below the last allocation
+    bool isCompact() const
+    {
+        return mFree.empty() || (mFree.size() == 1 && mFree.begin()->first + mFree.begin()->second == mCapacity);
+    }
+
+    unsigned getCapacity() const    { return mCapacity; }
+    unsigned getUsed() const        { return mUsed; }
+};
+
+// one of a pool's buffers and what's allocated in it
+struct ArenaBuffer {
+    GLuint          id;
+    unsigned        unitSize;       // bytes per allocation unit
+    RangeAllocator  ranges;
+
+    ArenaBuffer() : id(0), unitSize(1) { }
+};
+
+struct ArenaPool {
+    const VertexFormat*     format;
+    GLuint                  vao;
+    ArenaBuffer             vertices;   // counted in vertices
+    ArenaBuffer             indices;    // counted in bytes
+    std::set<ArenaMesh*>    meshes;
+
+    ArenaPool() : format(NULL), vao(0) { }
+};
+
+// index allocations are rounded up to this, so every mesh's indices start suitably aligned
+static const unsigned s_indexAlignment = 4;
+
+static unsigned GetIndexSize(GLenum indexType)
+{
+    switch (indexType) {
+    case GL_UNSIGNED_BYTE:  return 1;
+    case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT:   return 4;
+    default:                return 0;
+    }
+}
+
+static GLuint CreateBuffer(size_t size)
+{
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return id;
+}
+
+static void CopyBufferRange(GLuint src, GLuint dst, size_t srcOffset, size_t dstOffset, size_t size)
+{
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcOffset, dstOffset, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static void UploadBufferRange(GLuint dst, size_t offset, size_t size, const void* data)
+{
+    // not through GL_ELEMENT_ARRAY_BUFFER, that would change whatever VAO is bound
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// point the pool's VAO at its current buffers
+static void SetupVAO(const ArenaPool* pool)
+{
+    glBindVertexArray(pool->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, pool->vertices.id);
+    const VertexFormat& vertexFormat = *pool->format;
+    for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
+        const VertexAttrib& a = vertexFormat.getAttrib(i);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
+        glEnableVertexAttribArray(a.index);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->indices.id);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// move a buffer's contents into a bigger one with room for at least size more units
+static void GrowBuffer(ArenaBuffer& buffer, unsigned size, unsigned initialCapacity)
+{
+    unsigned capacity = buffer.ranges.getCapacity();
+    unsigned newCapacity = capacity * 2;
+    if (newCapacity < capacity + size) {
+        newCapacity = capacity + size;
+    }
+    if (newCapacity < initialCapacity) {
+        newCapacity = initialCapacity;
+    }
+
+    GLuint id = CreateBuffer((size_t)newCapacity * buffer.unitSize);
+    if (buffer.id) {
+        CopyBufferRange(buffer.id, id, 0, 0, (size_t)capacity * buffer.unitSize);
+        glDeleteBuffers(1, &buffer.id);
+    }
+
+    buffer.id = id;
+    buffer.ranges.Grow(newCapacity);
+}
+
+
+ArenaMesh::ArenaMesh(MeshArena* arena, ArenaPool* pool, GLuint vao, GLenum drawingMode)
+    : Mesh(vao, drawingMode)
+    , mArena(arena)
+    , mPool(pool)
+    , mBaseVertex(0)
+    , mVertexCount(0)
+    , mIndexOffset(0)
+    , mIndexBytes(0)
+    , mIndexCount(0)
+    , mIndexType(GL_NONE)
+    , mRadius(0.0f)
+    , mLevel(0)
+{
+}
+
+ArenaMesh::~ArenaMesh()
+{
+    if (mArena) {
+        mArena->Free(this);
+    }
+
+    // the VAO is the arena's, don't let ~Mesh delete it
+    mVAO = 0;
+}
+
+unsigned ArenaMesh::getDrawIndexOffset() const
+{
+    if (mLevels.empty()) {
+        return mIndexOffset;
+    }
+    return mIndexOffset + (unsigned)mLevels[mLevel].firstIndex * GetIndexSize(mIndexType);
+}
+
+GLsizei ArenaMesh::getDrawIndexCount() const
+{
+    return mLevels.empty() ? mIndexCount : (GLsizei)mLevels[mLevel].numIndices;
+}
+
+unsigned ArenaMesh::SelectLOD(const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError)
+{
+    if (mLevels.empty()) {
+        return 0;
+    }
+    mLevel = SelectLODLevel(mLevels, mCenter, mRadius, camera, modelMatrix, maxPixelError);
+    return mLevel;
+}
+
+void ArenaMesh::drawImpl() const
+{
+    if (mIndexCount > 0) {
+        glDrawElementsBaseVertex(mDrawingMode, getDrawIndexCount(), mIndexType, GLSH_BUFFER_OFFSET((size_t)getDrawIndexOffset()),
+                                 mBaseVertex);
+    } else {
+        glDrawArrays(mDrawingMode, mBaseVertex, mVertexCount);
+    }
+}
+
+void ArenaMesh::drawInstancedImpl(GLsizei numInstances) const
+{
+    if (mIndexCount > 0) {
+        glDrawElementsInstancedBaseVertex(mDrawingMode, getDrawIndexCount(), mIndexType,
+                                          GLSH_BUFFER_OFFSET((size_t)getDrawIndexOffset()), numInstances, mBaseVertex);
+    } else {
+        glDrawArraysInstanced(mDrawingMode, mBaseVertex, mVertexCount, numInstances);
+    }
+}
+
+
+MeshArena::MeshArena(unsigned initialVertices, unsigned initialIndexBytes)
+    : mInitialVertices(initialVertices)
+    , mInitialIndexBytes(initialIndexBytes)
+{
+}
+
+MeshArena::~MeshArena()
+{
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        ArenaPool* pool = mPools[i];
+
+        // meshes still around can't draw any more, and mustn't hand their ranges back
+        std::set<ArenaMesh*>::iterator it = pool->meshes.begin();
+        for (; it != pool->meshes.end(); ++it) {
+            (*it)->mArena = NULL;
+            (*it)->mPool = NULL;
+            (*it)->mVAO = 0;
+        }
+
+        glDeleteVertexArrays(1, &pool->vao);
+        glDeleteBuffers(1, &pool->vertices.id);
+        glDeleteBuffers(1, &pool->indices.id);
+        delete pool;
+    }
+    mPools.clear();
+}
+
+bool MeshArena::IsSupported()
+{
+    return (GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex) && (GLEW_VERSION_3_1 || GLEW_ARB_copy_buffer);
+}
+
+ArenaPool* MeshArena::GetPool(const VertexFormat& vertexFormat)
+{
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        if (mPools[i]->format == &vertexFormat) {
+            return mPools[i];
+        }
+    }
+
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    if (!vao) {
+        std::cerr << "*** Failed to create VAO for mesh arena" << std::endl;
+        return NULL;
+    }
+
+    ArenaPool* pool = new ArenaPool;
+    pool->format = &vertexFormat;
+    pool->vao = vao;
+    pool->vertices.unitSize = vertexFormat.getVertexSizeInBytes();
+    pool->indices.unitSize = 1;
+
+    mPools.push_back(pool);
+    return pool;
+}
+
+bool MeshArena::AllocateVertices(ArenaPool* pool, unsigned count, unsigned& offset)
+{
+    if (!pool->vertices.ranges.Allocate(count, offset)) {
+        GrowBuffer(pool->vertices, count, mInitialVertices);
+        SetupVAO(pool);
+        if (!pool->vertices.ranges.Allocate(count, offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MeshArena::AllocateIndexBytes(ArenaPool* pool, unsigned size, unsigned& offset)
+{
+    if (!pool->indices.ranges.Allocate(size, offset)) {
+        GrowBuffer(pool->indices, size, mInitialIndexBytes);
+        SetupVAO(pool);
+        if (!pool->indices.ranges.Allocate(size, offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeshArena::Free(ArenaMesh* mesh)
+{
+    ArenaPool* pool = mesh->mPool;
+
+    pool->vertices.ranges.Free(mesh->mBaseVertex, mesh->mVertexCount);
+    if (mesh->mIndexBytes > 0) {
+        pool->indices.ranges.Free(mesh->mIndexOffset, mesh->mIndexBytes);
+    }
+
+    pool->meshes.erase(mesh);
+}
+
+ArenaMesh* MeshArena::CreateMesh(GLenum drawingMode, const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat)
+{
+    return CreateMesh(drawingMode, vertices, numVertices, vertexFormat, NULL, 0, GL_NONE);
+}
+
+ArenaMesh* MeshArena::CreateMesh(GLenum drawingMode, const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                                 const void* indices, unsigned numIndices, GLenum indexType)
+{
+    if (!IsSupported()) {
+        std::cerr << "*** Can't create arena mesh: no driver support for base vertex drawing" << std::endl;
+        return NULL;
+    }
+
+    if (numVertices == 0) {
+        std::cerr << "*** Can't create arena mesh without vertices" << std::endl;
+        return NULL;
+    }
+
+    unsigned indexSize = GetIndexSize(indexType);
+    if (numIndices > 0 && indexSize == 0) {
+        std::cerr << "*** Can't create arena mesh: invalid index type" << std::endl;
+        return NULL;
+    }
+
+    ArenaPool* pool = GetPool(vertexFormat);
+    if (!pool) {
+        return NULL;
+    }
+
+    unsigned baseVertex = 0;
+    if (!AllocateVertices(pool, numVertices, baseVertex)) {
+        std::cerr << "*** Failed to allocate " << numVertices << " vertices in mesh arena" << std::endl;
+        return NULL;
+    }
+
+    ArenaMesh* mesh = new ArenaMesh(this, pool, pool->vao, drawingMode);
+    mesh->mBaseVertex = baseVertex;
+    mesh->mVertexCount = numVertices;
+    pool->meshes.insert(mesh);
+
+    size_t vertexSize = pool->vertices.unitSize;
+    UploadBufferRange(pool->vertices.id, baseVertex * vertexSize, numVertices * vertexSize, vertices);
+
+    if (numIndices > 0) {
+        unsigned size = numIndices * indexSize;
+        unsigned allocSize = (size + s_indexAlignment - 1) & ~(s_indexAlignment - 1);
+
+        unsigned offset = 0;
+        if (!AllocateIndexBytes(pool, allocSize, offset)) {
+            std::cerr << "*** Failed to allocate " << numIndices << " indices in mesh arena" << std::endl;
+            delete mesh;
+            return NULL;
+        }
+
+        mesh->mIndexOffset = offset;
+        mesh->mIndexBytes = allocSize;
+        mesh->mIndexCount = numIndices;
+        mesh->mIndexType = indexType;
+
+        UploadBufferRange(pool->indices.id, offset, size, indices);
+    }
+
+    return mesh;
+}
+
+ArenaMesh* MeshArena::CreateLODMesh(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                                    const std::vector<unsigned>& lodIndices, const std::vector<MeshLODLevel>& levels)
+{
+    if (!vertices || numVertices == 0 || lodIndices.empty() || levels.empty()) {
+        std::cerr << "*** Can't create arena LOD mesh without vertices and levels" << std::endl;
+        return NULL;
+    }
+
+    glm::vec3 center;
+    float radius;
+    if (!ComputeBoundingSphere(vertices, numVertices, vertexFormat, center, radius)) {
+        std::cerr << "*** Can't create arena LOD mesh: vertex format has no float or half float positions" << std::endl;
+        return NULL;
+    }
+
+    // all the levels in the one range; half the size when the vertices can be numbered in 16 bits
+    ArenaMesh* mesh;
+    if (numVertices <= 65536) {
+        std::vector<unsigned short> shortIndices(lodIndices.begin(), lodIndices.end());
+        mesh = CreateMesh(GL_TRIANGLES, vertices, numVertices, vertexFormat,
+                          &shortIndices[0], (unsigned)shortIndices.size(), GL_UNSIGNED_SHORT);
+    } else {
+        mesh = CreateMesh(GL_TRIANGLES, vertices, numVertices, vertexFormat,
+                          &lodIndices[0], (unsigned)lodIndices.size(), GL_UNSIGNED_INT);
+    }
+    if (!mesh) {
+        return NULL;
+    }
+
+    mesh->mLevels = levels;
+    mesh->mCenter = center;
+    mesh->mRadius = radius;
+    mesh->mLevel = 0;
+    return mesh;
+}
+
+void MeshArena::Compact()
+{
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        ArenaPool* pool = mPools[i];
+        bool moved = false;
+
+        // copy every mesh's range into a fresh buffer of the same size, back to back
+        if (pool->vertices.id && !pool->vertices.ranges.isCompact()) {
+            ArenaBuffer& buffer = pool->vertices;
+            GLuint id = CreateBuffer((size_t)buffer.ranges.getCapacity() * buffer.unitSize);
+
+            unsigned used = 0;
+            std::set<ArenaMesh*>::iterator it = pool->meshes.begin();
+            for (; it != pool->meshes.end(); ++it) {
+                ArenaMesh* mesh = *it;
+                CopyBufferRange(buffer.id, id, (size_t)mesh->mBaseVertex * buffer.unitSize, (size_t)used * buffer.unitSize,
+                                (size_t)mesh->mVertexCount * buffer.unitSize);
+                mesh->mBaseVertex = used;
+                used += mesh->mVertexCount;
+            }
+
+            glDeleteBuffers(1, &buffer.id);
+            buffer.id = id;
+            buffer.ranges.Reset(used);
+            moved = true;
+        }
+
+        if (pool->indices.id && !pool->indices.ranges.isCompact()) {
+            ArenaBuffer& buffer = pool->indices;
+            GLuint id = CreateBuffer(buffer.ranges.getCapacity());
+
+            unsigned used = 0;
+            std::set<ArenaMesh*>::iterator it = pool->meshes.begin();
+            for (; it != pool->meshes.end(); ++it) {
+                ArenaMesh* mesh = *it;
+                if (mesh->mIndexBytes > 0) {
+                    CopyBufferRange(buffer.id, id, mesh->mIndexOffset, used, mesh->mIndexBytes);
+                    mesh->mIndexOffset = used;
+                    used += mesh->mIndexBytes;
+                }
+            }
+
+            glDeleteBuffers(1, &buffer.id);
+            buffer.id = id;
+            buffer.ranges.Reset(used);
+            moved = true;
+        }
+
+        if (moved) {
+            SetupVAO(pool);
+        }
+    }
+}
+
+unsigned MeshArena::numMeshes() const
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        count += (unsigned)mPools[i]->meshes.size();
+    }
+    return count;
+}
+
+size_t MeshArena::getBytesUsed() const
+{
+    size_t bytes = 0;
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        const ArenaPool* pool = mPools[i];
+        bytes += (size_t)pool->vertices.ranges.getUsed() * pool->vertices.unitSize;
+        bytes += pool->indices.ranges.getUsed();
+    }
+    return bytes;
+}
+
+size_t MeshArena::getBytesAllocated() const
+{
+    size_t bytes = 0;
+    for (unsigned i = 0; i < mPools.size(); i++) {
+        const ArenaPool* pool = mPools[i];
+        bytes += (size_t)pool->vertices.ranges.getCapacity() * pool->vertices.unitSize;
+        bytes += pool->indices.ranges.getCapacity();
+    }
+    return bytes;
+}
+
+} // end of namespace
@@ -0,0 +1,191 @@
+#ifndef GLSH_MESHARENA_H_
+#define GLSH_MESHARENA_H_
+
+#include "GLSH_Mesh.h"
+#include "GLSH_MeshSimplifier.h"
+#include "GLSH_Camera.h"
+
+#include <vector>
+
+namespace glsh {
+
+class MeshArena;
+struct ArenaPool;
+
+//
+// A mesh whose vertices and indices live in a MeshArena's shared buffers.  Indices are relative to the
+// mesh's first vertex and drawn with glDrawElementsBaseVertex, so they stay valid wherever the arena
+// moves the mesh.  The VAO is the arena's, shared with every other mesh of the same vertex format.
+//
+// A mesh made by MeshArena::CreateLODMesh has a chain of levels of detail from GenerateLODs in its index range,
+// all over the same vertices.  SelectLOD picks one the way LODMesh::SelectLOD does (GLSH_LODMesh.h), and both
+// draw and MeshRenderer use the last one picked.
+//
+// Deleting the mesh gives its ranges back to the arena.  Delete the meshes before the arena.
+//
+class ArenaMesh : public Mesh {
+    friend class MeshArena;
+
+    MeshArena*      mArena;
+    ArenaPool*      mPool;
+
+    GLint           mBaseVertex;    // first vertex in the pool's VBO
+    GLsizei         mVertexCount;
+
+    unsigned        mIndexOffset;   // in bytes, in the pool's IBO
+    unsigned        mIndexBytes;    // allocated, rounded up
+    GLsizei         mIndexCount;    // 0 if not indexed
+    GLenum          mIndexType;
+
+    std::vector<MeshLODLevel>   mLevels;        // empty if the mesh has no levels of detail
+    glm::vec3       mCenter;        // bounding sphere, in model space
+    float           mRadius;
+    unsigned        mLevel;         // the one draw uses
+
+                    ArenaMesh(MeshArena* arena, ArenaPool* pool, GLuint vao, GLenum drawingMode);
+
+public:
+    virtual         ~ArenaMesh() override;
+
+    GLenum          getDrawingMode() const  { return mDrawingMode; }
+    GLint           getBaseVertex() const   { return mBaseVertex; }
+    GLsizei         getVertexCount() const  { return mVertexCount; }
+    unsigned        getIndexOffset() const  { return mIndexOffset; }
+    GLsizei         getIndexCount() const   { return mIndexCount; }
+    GLenum          getIndexType() const    { return mIndexType; }
+    bool            isIndexed() const       { return mIndexCount > 0; }
+
+    // the indices draw uses: the current level's if there are levels of detail, all of them otherwise
+    unsigned        getDrawIndexOffset() const;
+    GLsizei         getDrawIndexCount() const;
+
+    // pick the level to draw; returns it, 0 for a mesh without levels of detail
+    unsigned        SelectLOD(const Camera& camera, const glm::mat4& modelMatrix, float maxPixelError = 1.0f);
+
+    void            setLOD(unsigned level)  { mLevel = level < mLevels.size() ? level : (unsigned)mLevels.size() - 1; }
+    unsigned        getLOD() const          { return mLevel; }
+
+    unsigned        numLODs() const         { return (unsigned)mLevels.size(); }
+    const MeshLODLevel& getLODLevel(unsigned i) const { return mLevels[i]; }
+
+protected:
+    virtual void    drawImpl() const override;
+    virtual void    drawInstancedImpl(GLsizei numInstances) const override;
+
+private:
+                    // noncopyable
+                    ArenaMesh(const ArenaMesh&);
+                    ArenaMesh& operator= (const ArenaMesh&);
+};
+
+
+//
+// Sub-allocates meshes from a few large buffers instead of giving each its own VBO, IBO and VAO.
+// There's one pool per vertex format, with one VBO, one IBO and one VAO.  The ranges come from a
+// first-fit free list that merges neighbouring free ranges back together.
+//
+// A pool that runs out of room moves into buffers twice the size (glCopyBufferSubData, so no CPU copy),
+// and Compact moves every mesh down to close the gaps freed meshes left behind.  Meshes don't notice
+// either: they keep offsets, which the arena updates, not pointers.
+//
+// Formats are told apart by address, so use the ones from the vertex types' GetFormat.
+// Needs GL 3.2 or ARB_draw_elements_base_vertex and ARB_copy_buffer; see IsSupported.
+//
+class MeshArena {
+    friend class ArenaMesh;
+
+    std::vector<ArenaPool*>     mPools;
+    unsigned                    mInitialVertices;       // per pool
+    unsigned                    mInitialIndexBytes;     // per pool
+
+public:
+                                MeshArena(unsigned initialVertices = 65536, unsigned initialIndexBytes = 256 * 1024);
+                                ~MeshArena();
+
+    static bool                 IsSupported();
+
+    ArenaMesh*                  CreateMesh(GLenum drawingMode, const void* vertices, unsigned numVertices,
+                                           const VertexFormat& vertexFormat);
+
+    ArenaMesh*                  CreateMesh(GLenum drawingMode, const void* vertices, unsigned numVertices,
+                                           const VertexFormat& vertexFormat,
+                                           const void* indices, unsigned numIndices, GLenum indexType);
+
+    template <typename VertexType>
+    ArenaMesh*                  CreateMesh(GLenum drawingMode, const std::vector<VertexType>& vertices)
+    {
+        return CreateMesh(drawingMode, &vertices[0], (unsigned)vertices.size(), VertexType::GetFormat());
+    }
+
+    template <typename VertexType, typename IndexType>
+    ArenaMesh*                  CreateMesh(GLenum drawingMode, const std::vector<VertexType>& vertices, const std::vector<IndexType>& indices)
+    {
+        GLenum indexType = GL_NONE;
+        switch (sizeof(IndexType)) {
+        case 1: indexType = GL_UNSIGNED_BYTE; break;
+        case 2: indexType = GL_UNSIGNED_SHORT; break;
+        case 4: indexType = GL_UNSIGNED_INT; break;
+        default: return NULL; // error, invalid index size
+        }
+        return CreateMesh(drawingMode, &vertices[0], (unsigned)vertices.size(), VertexType::GetFormat(),
+                          &indices[0], (unsigned)indices.size(), indexType);
+    }
+
+    // like glsh::CreateIndexedMesh, with 16-bit indices when there are few enough vertices
+    template <typename VertexType>
+    ArenaMesh*                  CreateIndexedMesh(GLenum drawingMode, const std::vector<VertexType>& vertices, const std::vector<unsigned>& indices)
+    {
+        if (vertices.size() <= 65536) {
+            std::vector<unsigned short> shortIndices(indices.size());
+            for (unsigned i = 0; i < indices.size(); i++) {
+                shortIndices[i] = (unsigned short)indices[i];
+            }
+            return CreateMesh(drawingMode, vertices, shortIndices);
+        } else {
+            return CreateMesh(drawingMode, vertices, indices);
+        }
+    }
+
+    //
+    // A triangle mesh with a chain of levels of detail made by GenerateLODs, all of them in the mesh's index range.
+    // The vertex format's VA_POSITION attribute (floats or half floats) gives the bounding sphere.
+    //
+    ArenaMesh*                  CreateLODMesh(const void* vertices, unsigned numVertices, const VertexFormat& vertexFormat,
+                                              const std::vector<unsigned>& lodIndices, const std::vector<MeshLODLevel>& levels);
+
+    template <typename VertexType>
+    ArenaMesh*                  CreateLODMesh(const std::vector<VertexType>& vertices, const std::vector<unsigned>& lodIndices,
+                                              const std::vector<MeshLODLevel>& levels)
+    {
+        if (vertices.empty()) {
+            return NULL;
+        }
+        return CreateLODMesh(&vertices[0], (unsigned)vertices.size(), VertexType::GetFormat(), lodIndices, levels);
+    }
+
+    // move the meshes in every pool together, leaving all the free space at the end
+    void                        Compact();
+
+    unsigned                    numPools() const    { return (unsigned)mPools.size(); }
+    unsigned                    numMeshes() const;
+
+    // bytes in use and allocated, over all pools' vertex and index buffers
+    size_t                      getBytesUsed() const;
+    size_t                      getBytesAllocated() const;
+
+private:
+    ArenaPool*                  GetPool(const VertexFormat& vertexFormat);
+
+    bool                        AllocateVertices(ArenaPool* pool, unsigned count, unsigned& offset);
+    bool                        AllocateIndexBytes(ArenaPool* pool, unsigned size, unsigned& offset);
+
+    void                        Free(ArenaMesh* mesh);
+
+                                // noncopyable
+                                MeshArena(const MeshArena&);
+                                MeshArena& operator= (const MeshArena&);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,400 @@
+#include "GLSH_MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+namespace glsh {
+
+//
+// Cache analysis
+//
+
+VertexCacheStats AnalyzeVertexCache(const unsigned* indices, size_t numIndices, unsigned numVertices, unsigned cacheSize)
+{
+    VertexCacheStats stats;
+    stats.numTriangles = (unsigned)(numIndices / 3);
+    stats.numVertices = numVertices;
+    stats.verticesTransformed = 0;
+
+    // a vertex is in the FIFO if fewer than cacheSize misses happened since it went in
+    std::vector<unsigned> insertedAt(numVertices, 0);
+    unsigned time = cacheSize + 1;
+
+    for (size_t i = 0; i < 3 * (size_t)stats.numTriangles; i++) {
+        unsigned v = indices[i];
+        if (time - insertedAt[v] > cacheSize) {
+            insertedAt[v] = time++;
+            ++stats.verticesTransformed;
+        }
+    }
+
+    stats.acmr = stats.numTriangles ? (float)stats.verticesTransformed / stats.numTriangles : 0.0f;
+    stats.atvr = numVertices ? (float)stats.verticesTransformed / numVertices : 0.0f;
+
+    return stats;
+}
+
+void PrintMeshOptimizerReport(std::ostream& out, const MeshOptimizerReport& report)
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3)
+        << "ACMR " << report.before.acmr << " -> " << report.after.acmr
+        << ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+        << " (" << report.after.numTriangles << " triangles, " << report.after.numVertices << " vertices)" << std::endl;
+    out.flags(flags);
+}
+
+
+//
+// Vertex cache order (Forsyth)
+//
+
+// the cache the scores model, bigger than real ones so they pull in a neighbourhood
+static const int FORSYTH_CACHE_SIZE = 32;
+static const int FORSYTH_MAX_VALENCE = 64;      // beyond this the valence boost doesn't change much
+
+struct ForsythScores {
+    float   cache[FORSYTH_CACHE_SIZE];
+    float   valence[FORSYTH_MAX_VALENCE + 1];
+
+    ForsythScores()
+    {
+        for (int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+            // the last triangle's vertices get a fixed score, so it doesn't matter which way round it went
+            if (i < 3) {
+                cache[i] = 0.75f;
+            } else {
+                cache[i] = std::pow(1.0f - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        // vertices with few triangles left get a boost, to finish them off instead of leaving lone triangles behind
+        valence[0] = 0;
+        for (int i = 1; i <= FORSYTH_MAX_VALENCE; i++) {
+            valence[i] = 2.0f / std::sqrt((float)i);
+        }
+    }
+
+    float get(int cachePos, unsigned remaining) const
+    {
+        if (remaining == 0) {
+            return -1.0f;       // nothing left to draw with it
+        }
+        float score = cachePos >= 0 ? cache[cachePos] : 0.0f;
+        return score + valence[remaining < FORSYTH_MAX_VALENCE ? remaining : FORSYTH_MAX_VALENCE];
+    }
+};
+
+void OptimizeVertexCache(unsigned* dst, const unsigned* indices, size_t numIndices, unsigned numVertices)
+{
+    unsigned numTriangles = (unsigned)(numIndices / 3);
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // work from a copy, so dst can be the input
+    std::vector<unsigned> src(indices, indices + 3 * (size_t)numTriangles);
+
+    ForsythScores scores;
+
+    // triangles using each vertex, packed into one array; the ones still to draw come first in each run
+    std::vector<unsigned> adjOffset(numVertices + 1, 0);
+    std::vector<unsigned> remaining(numVertices, 0);
+    for (size_t i = 0; i < src.size(); i++) {
+        ++remaining[src[i]];
+    }
+    for (unsigned v = 0; v < numVertices; v++) {
+        adjOffset[v + 1] = adjOffset[v] + remaining[v];
+    }
+    std::vector<unsigned> adjTriangles(src.size());
+    {
+        std::vector<unsigned> fill(adjOffset.begin(), adjOffset.end() - 1);
+        for (unsigned t = 0; t < numTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned v = src[3 * t + k];
+                adjTriangles[fill[v]++] = t;
+            }
+        }
+    }
+
+    std::vector<float> vertexScore(numVertices);
+    for (unsigned v = 0; v < numVertices; v++) {
+        vertexScore[v] = scores.get(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(numTriangles);
+    std::vector<char> emitted(numTriangles, 0);
+    for (unsigned t = 0; t < numTriangles; t++) {
+        triangleScore[t] = vertexScore[src[3 * t]] + vertexScore[src[3 * t + 1]] + vertexScore[src[3 * t + 2]];
+    }
+
+    // the cache, plus room for the three vertices pushed out by each triangle
+    unsigned cache[FORSYTH_CACHE_SIZE + 3];
+    unsigned newCache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+
+    // start with the best triangle overall; later ones come from the cache's neighbourhood
+    unsigned best = 0;
+    for (unsigned t = 1; t < numTriangles; t++) {
+        if (triangleScore[t] > triangleScore[best]) {
+            best = t;
+        }
+    }
+
+    unsigned nextUnemitted = 0;      // for dead ends, the first triangle in input order not drawn yet
+
+    for (unsigned out = 0; out < numTriangles; out++) {
+        if (best == ~0u) {
+            while (emitted[nextUnemitted]) {
+                ++nextUnemitted;
+            }
+            best = nextUnemitted;
+        }
+
+        const unsigned* tri = &src[3 * best];
+        dst[3 * out] = tri[0];
+        dst[3 * out + 1] = tri[1];
+        dst[3 * out + 2] = tri[2];
+        emitted[best] = 1;
+
+        // take the triangle off its vertices' lists
+        for (int k = 0; k < 3; k++) {
+            unsigned v = tri[k];
+            unsigned* adj = &adjTriangles[adjOffset[v]];
+            unsigned n = remaining[v];
+            for (unsigned i = 0; i < n; i++) {
+                if (adj[i] == best) {
+                    adj[i] = adj[n - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        // the triangle's vertices go to the front of the cache, the rest move back
+        int newCount = 0;
+        for (int k = 0; k < 3; k++) {
+            newCache[newCount++] = tri[k];
+        }
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // rescore everything that moved, passing the change on to the triangles still to draw
+        for (int i = 0; i < newCount; i++) {
+            unsigned v = newCache[i];
+            int pos = i < FORSYTH_CACHE_SIZE ? i : -1;
+
+            float score = scores.get(pos, remaining[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            const unsigned* adj = &adjTriangles[adjOffset[v]];
+            for (unsigned j = 0; j < remaining[v]; j++) {
+                triangleScore[adj[j]] += delta;
+            }
+        }
+
+        cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+        memcpy(cache, newCache, cacheCount * sizeof(unsigned));
+
+        // the next triangle is the best one touching the cache
+        best = ~0u;
+        float bestScore = -1.0f;
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned v = cache[i];
+            const unsigned* adj = &adjTriangles[adjOffset[v]];
+            for (unsigned j = 0; j < remaining[v]; j++) {
+                if (triangleScore[adj[j]] > bestScore) {
+                    bestScore = triangleScore[adj[j]];
+                    best = adj[j];
+                }
+            }
+        }
+    }
+}
+
+
+//
+// Overdraw order
+//
+
+// the FIFO size used to find cluster boundaries; small, like the hardware's
+static const unsigned OVERDRAW_CACHE_SIZE = 16;
+
+struct OverdrawCluster {
+    unsigned    begin, end;     // triangles
+    float       sortKey;
+};
+
+// vertices of a triangle missing from a FIFO cache, which they are then added to; see AnalyzeVertexCache
+static unsigned CountCacheMisses(const unsigned* tri, std::vector<unsigned>& insertedAt, unsigned& time)
+{
+    unsigned misses = 0;
+    for (int k = 0; k < 3; k++) {
+        if (time - insertedAt[tri[k]] > OVERDRAW_CACHE_SIZE) {
+            insertedAt[tri[k]] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+static bool CompareClusters(const OverdrawCluster& a, const OverdrawCluster& b)
+{
+    return a.sortKey > b.sortKey;
+}
+
+void OptimizeOverdraw(unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices, size_t stride,
+                      float threshold)
+{
+    unsigned numTriangles = (unsigned)(numIndices / 3);
+    if (numTriangles == 0) {
+        return;
+    }
+
+    std::vector<unsigned> insertedAt(numVertices, 0);
+    unsigned time = OVERDRAW_CACHE_SIZE + 1;
+
+    // hard boundaries: triangles that miss on all three vertices start over anyway, so cutting there is free
+    std::vector<unsigned> hard;
+    for (unsigned t = 0; t < numTriangles; t++) {
+        if (CountCacheMisses(&indices[3 * t], insertedAt, time) == 3) {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(numTriangles);
+
+    // soft boundaries: within a hard cluster, cut wherever the miss ratio so far is within threshold of the cluster's
+    std::vector<OverdrawCluster> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        unsigned begin = hard[h];
+        unsigned end = hard[h + 1];
+
+        time += OVERDRAW_CACHE_SIZE + 1;    // empty the cache
+        unsigned clusterMisses = 0;
+        for (unsigned t = begin; t < end; t++) {
+            clusterMisses += CountCacheMisses(&indices[3 * t], insertedAt, time);
+        }
+        float limit = threshold * clusterMisses / (end - begin);
+
+        time += OVERDRAW_CACHE_SIZE + 1;
+        unsigned start = begin;
+        unsigned misses = 0;
+        for (unsigned t = begin; t < end; t++) {
+            misses += CountCacheMisses(&indices[3 * t], insertedAt, time);
+            if (t + 1 < end && misses <= limit * (t + 1 - start)) {
+                OverdrawCluster c = { start, t + 1, 0 };
+                clusters.push_back(c);
+                start = t + 1;
+                misses = 0;
+                time += OVERDRAW_CACHE_SIZE + 1;
+            }
+        }
+        OverdrawCluster c = { start, end, 0 };
+        clusters.push_back(c);
+    }
+
+    const char* base = (const char*)positions;
+
+    // area weighted centroid of the whole mesh
+    double meshCenter[3] = { 0, 0, 0 };
+    double meshArea = 0;
+    std::vector<float> clusterData(clusters.size() * 7);     // centroid, normal, area
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        double center[3] = { 0, 0, 0 };
+        double normal[3] = { 0, 0, 0 };
+        double area = 0;
+
+        for (unsigned t = clusters[c].begin; t < clusters[c].end; t++) {
+            const float* p0 = (const float*)(base + indices[3 * t] * stride);
+            const float* p1 = (const float*)(base + indices[3 * t + 1] * stride);
+            const float* p2 = (const float*)(base + indices[3 * t + 2] * stride);
+
+            double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);     // twice the area, as is the normal
+
+            for (int k = 0; k < 3; k++) {
+                center[k] += (p0[k] + p1[k] + p2[k]) * (a / 3);
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            meshCenter[k] += center[k];
+            clusterData[7 * c + k] = area > 0 ? (float)(center[k] / area) : 0.0f;
+            clusterData[7 * c + 3 + k] = (float)normal[k];
+        }
+        clusterData[7 * c + 6] = (float)area;
+        meshArea += area;
+    }
+
+    if (meshArea > 0) {
+        for (int k = 0; k < 3; k++) {
+            meshCenter[k] /= meshArea;
+        }
+    }
+
+    // clusters on the outside facing out go first: they are the ones most likely to hide the rest
+    for (size_t c = 0; c < clusters.size(); c++) {
+        const float* d = &clusterData[7 * c];
+        double len = std::sqrt(d[3] * d[3] + d[4] * d[4] + d[5] * d[5]);
+        double key = 0;
+        if (len > 0) {
+            for (int k = 0; k < 3; k++) {
+                key += (d[k] - meshCenter[k]) * d[3 + k];
+            }
+            key /= len;
+        }
+        clusters[c].sortKey = (float)key;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), CompareClusters);
+
+    std::vector<unsigned> sorted;
+    sorted.reserve(3 * (size_t)numTriangles);
+    for (size_t c = 0; c < clusters.size(); c++) {
+        sorted.insert(sorted.end(), indices + 3 * clusters[c].begin, indices + 3 * clusters[c].end);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+
+//
+// Vertex fetch order
+//
+
+unsigned OptimizeVertexFetch(void* vertices, unsigned* indices, size_t numIndices, unsigned numVertices, size_t vertexSize)
+{
+    std::vector<unsigned> remap(numVertices, ~0u);
+    unsigned next = 0;
+
+    for (size_t i = 0; i < numIndices; i++) {
+        unsigned& r = remap[indices[i]];
+        if (r == ~0u) {
+            r = next++;
+        }
+        indices[i] = r;
+    }
+
+    // move the vertices through a copy
+    std::vector<unsigned char> copy((const unsigned char*)vertices, (const unsigned char*)vertices + numVertices * vertexSize);
+    unsigned char* dst = (unsigned char*)vertices;
+    for (unsigned v = 0; v < numVertices; v++) {
+        if (remap[v] != ~0u) {
+            memcpy(dst + remap[v] * vertexSize, &copy[v * vertexSize], vertexSize);
+        }
+    }
+
+    return next;
+}
+
+} // end of namespace
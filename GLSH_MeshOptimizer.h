@@ -0,0 +1,84 @@
+#ifndef GLSH_MESHOPTIMIZER_H_
+#define GLSH_MESHOPTIMIZER_H_
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace glsh {
+
+//
+// Reordering of indexed triangle lists for faster drawing, run on the arrays before CreateMesh.
+// None of it changes what gets drawn, only the order:
+//
+//  - OptimizeVertexCache sorts the triangles so they reuse recently transformed vertices
+//    (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+//  - OptimizeOverdraw then cuts that order into clusters and draws the ones facing out from the middle
+//    of the mesh first, so they hide the rest, giving up a little cache efficiency for it.
+//  - OptimizeVertexFetch renumbers the vertices in the order the triangles first use them,
+//    so vertex fetches walk forward through memory, and drops vertices nothing uses.
+//
+// OptimizeMesh runs all three, in that order, on a vertex and index vector.
+//
+
+// how well an index order uses a FIFO post-transform cache
+struct VertexCacheStats {
+    unsigned        numTriangles;
+    unsigned        numVertices;
+    unsigned        verticesTransformed;    // cache misses
+    float           acmr;                   // average cache miss ratio, transformed vertices per triangle (0.5 at best, 3 at worst)
+    float           atvr;                   // average transformed to vertex ratio (1 at best)
+};
+
+struct MeshOptimizerReport {
+    VertexCacheStats    before;
+    VertexCacheStats    after;
+};
+
+// simulate a FIFO vertex cache of cacheSize entries over a triangle list
+VertexCacheStats AnalyzeVertexCache(const unsigned* indices, size_t numIndices, unsigned numVertices, unsigned cacheSize = 16);
+
+// reorder triangles for the post-transform cache; dst may be the same array as indices
+void OptimizeVertexCache(unsigned* dst, const unsigned* indices, size_t numIndices, unsigned numVertices);
+
+//
+// Reorder the clusters of a cache-optimized triangle list to cut overdraw.  positions points at the first vertex's
+// x, y, z floats, stride bytes apart.  Clusters are only split where the cache miss ratio stays within threshold
+// times what it was, so 1.05 costs at most 5% of the cache efficiency.
+//
+void OptimizeOverdraw(unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices, size_t stride,
+                      float threshold = 1.05f);
+
+// renumber vertices in the order of first use, in place; returns the new vertex count, without unused vertices
+unsigned OptimizeVertexFetch(void* vertices, unsigned* indices, size_t numIndices, unsigned numVertices, size_t vertexSize);
+
+//
+// All three passes, for vertex types with a glm::vec3 pos member (see GLSH_Vertex.h).
+// The vertex vector shrinks if some vertices weren't used.
+//
+template <typename VertexType>
+MeshOptimizerReport OptimizeMesh(std::vector<VertexType>& vertices, std::vector<unsigned>& indices, float overdrawThreshold = 1.05f)
+{
+    MeshOptimizerReport report;
+    report.before = AnalyzeVertexCache(indices.empty() ? NULL : &indices[0], indices.size(), (unsigned)vertices.size());
+    report.after = report.before;
+
+    if (indices.empty() || vertices.empty()) {
+        return report;
+    }
+
+    unsigned numVertices = (unsigned)vertices.size();
+    OptimizeVertexCache(&indices[0], &indices[0], indices.size(), numVertices);
+    OptimizeOverdraw(&indices[0], indices.size(), &vertices[0].pos.x, numVertices, sizeof(VertexType), overdrawThreshold);
+    vertices.resize(OptimizeVertexFetch(&vertices[0], &indices[0], indices.size(), numVertices, sizeof(VertexType)));
+
+    report.after = AnalyzeVertexCache(&indices[0], indices.size(), (unsigned)vertices.size());
+    return report;
+}
+
+// one line with the before and after ACMR and ATVR
+void PrintMeshOptimizerReport(std::ostream& out, const MeshOptimizerReport& report);
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,260 @@
+#include "GLSH_MeshRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace glsh {
+
+// the layouts glMultiDrawElementsIndirect and glMultiDrawArraysIndirect read
+struct DrawElementsIndirectCommand {
+    GLuint  count;
+    GLuint  instanceCount;
+    GLuint  firstIndex;
+    GLint   baseVertex;
+    GLuint  baseInstance;
+};
+
+struct DrawArraysIndirectCommand {
+    GLuint  count;
+    GLuint  instanceCount;
+    GLuint  first;
+    GLuint  baseInstance;
+};
+
+static unsigned GetIndexSize(GLenum indexType)
+{
+    switch (indexType) {
+    case GL_UNSIGNED_BYTE:  return 1;
+    case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT:   return 4;
+    default:                return 0;
+    }
+}
+
+// the batch a mesh goes in; meshes are grouped by this
+static GLenum GetIndexTypeKey(const ArenaMesh* mesh)
+{
+    return mesh->isIndexed() ? mesh->getIndexType() : GL_NONE;
+}
+
+// replace a buffer's contents, orphaning the old storage so the GPU can finish with it undisturbed
+static void UploadBuffer(GLuint& id, size_t& capacity, const void* data, size_t size)
+{
+    if (!id) {
+        glGenBuffers(1, &id);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    if (size > capacity) {
+        capacity = size;
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, data, GL_DYNAMIC_DRAW);
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+MeshRenderer::MeshRenderer(GLuint transformBinding)
+    : mBatchesDirty(false)
+    , mTransformsDirty(false)
+    , mTransformBinding(transformBinding)
+    , mCommandBuffer(0)
+    , mCommandCapacity(0)
+    , mTransformBuffer(0)
+    , mTransformCapacity(0)
+{
+}
+
+MeshRenderer::~MeshRenderer()
+{
+    glDeleteBuffers(1, &mCommandBuffer);
+    glDeleteBuffers(1, &mTransformBuffer);
+}
+
+bool MeshRenderer::IsSupported()
+{
+    bool multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object);
+    // the shaders read gl_DrawIDARB, so it's the extension they need, not the 4.6 core version of it
+    return multiDraw && GLEW_ARB_shader_draw_parameters && MeshArena::IsSupported();
+}
+
+unsigned MeshRenderer::Add(const ArenaMesh* mesh, const glm::mat4& transform)
+{
+    DrawItem item;
+    item.mesh = mesh;
+    item.transform = transform;
+    mItems.push_back(item);
+
+    mBatchesDirty = true;
+    return (unsigned)mItems.size() - 1;
+}
+
+void MeshRenderer::SetTransform(unsigned i, const glm::mat4& transform)
+{
+    mItems[i].transform = transform;
+    mTransformsDirty = true;
+}
+
+void MeshRenderer::Clear()
+{
+    mItems.clear();
+    mOrder.clear();
+    mBatches.clear();
+    mCommands.clear();
+    mBatchesDirty = false;
+    mTransformsDirty = false;
+}
+
+void MeshRenderer::BuildBatches()
+{
+    const std::vector<DrawItem>& items = mItems;
+
+    mOrder.resize(items.size());
+    for (unsigned i = 0; i < mOrder.size(); i++) {
+        mOrder[i] = i;
+    }
+
+    // stable, so meshes in the same batch keep the order they were added in
+    std::stable_sort(mOrder.begin(), mOrder.end(), [&](unsigned a, unsigned b) {
+        const ArenaMesh* ma = items[a].mesh;
+        const ArenaMesh* mb = items[b].mesh;
+        if (ma->getVAO() != mb->getVAO()) {
+            return ma->getVAO() < mb->getVAO();
+        }
+        if (ma->getDrawingMode() != mb->getDrawingMode()) {
+            return ma->getDrawingMode() < mb->getDrawingMode();
+        }
+        return GetIndexTypeKey(ma) < GetIndexTypeKey(mb);
+    });
+
+    // gl_DrawIDARB starts over at 0 for every multi-draw, so each batch gets its own range of the transform
+    // buffer, bound at an offset the driver accepts
+    GLint alignment = 0;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t alignTransforms = alignment > (GLint)sizeof(glm::mat4) ? alignment / sizeof(glm::mat4) : 1;
+
+    mBatches.clear();
+    size_t commandOffset = 0;
+    size_t numTransforms = 0;
+    for (unsigned i = 0; i < mOrder.size(); ) {
+        const ArenaMesh* mesh = items[mOrder[i]].mesh;
+
+        DrawBatch batch;
+        batch.vao = mesh->getVAO();
+        batch.drawingMode = mesh->getDrawingMode();
+        batch.indexType = GetIndexTypeKey(mesh);
+        batch.first = i;
+        batch.commandOffset = commandOffset;
+        batch.transformOffset = numTransforms * sizeof(glm::mat4);
+
+        do {
+            ++i;
+        } while (i < mOrder.size() && items[mOrder[i]].mesh->getVAO() == batch.vao
+                                   && items[mOrder[i]].mesh->getDrawingMode() == batch.drawingMode
+                                   && GetIndexTypeKey(items[mOrder[i]].mesh) == batch.indexType);
+
+        batch.count = i - batch.first;
+        mBatches.push_back(batch);
+
+        size_t commandSize = batch.indexType != GL_NONE ? sizeof(DrawElementsIndirectCommand) : sizeof(DrawArraysIndirectCommand);
+        commandOffset += batch.count * commandSize;
+        numTransforms += (batch.count + alignTransforms - 1) / alignTransforms * alignTransforms;
+    }
+
+    mTransforms.resize(numTransforms);
+    mBatchesDirty = false;
+    mTransformsDirty = true;
+}
+
+void MeshRenderer::BuildCommands(std::vector<unsigned char>& commands) const
+{
+    commands.clear();
+
+    for (unsigned b = 0; b < mBatches.size(); b++) {
+        const DrawBatch& batch = mBatches[b];
+        for (unsigned i = batch.first; i < batch.first + batch.count; i++) {
+            const ArenaMesh* mesh = mItems[mOrder[i]].mesh;
+            size_t offset = commands.size();
+
+            if (batch.indexType != GL_NONE) {
+                DrawElementsIndirectCommand cmd;
+                cmd.count = mesh->getDrawIndexCount();
+                cmd.instanceCount = 1;
+                cmd.firstIndex = mesh->getDrawIndexOffset() / GetIndexSize(batch.indexType);
+                cmd.baseVertex = mesh->getBaseVertex();
+                cmd.baseInstance = 0;
+                commands.resize(offset + sizeof(cmd));
+                memcpy(&commands[offset], &cmd, sizeof(cmd));
+            } else {
+                DrawArraysIndirectCommand cmd;
+                cmd.count = mesh->getVertexCount();
+                cmd.instanceCount = 1;
+                cmd.first = mesh->getBaseVertex();
+                cmd.baseInstance = 0;
+                commands.resize(offset + sizeof(cmd));
+                memcpy(&commands[offset], &cmd, sizeof(cmd));
+            }
+        }
+    }
+}
+
+bool MeshRenderer::Draw()
+{
+    if (!IsSupported()) {
+        std::cerr << "*** Can't draw mesh list: no driver support for multi-draw indirect" << std::endl;
+        return false;
+    }
+
+    if (mItems.empty()) {
+        return true;
+    }
+
+    if (mBatchesDirty) {
+        BuildBatches();
+    }
+
+    if (mTransformsDirty) {
+        for (unsigned b = 0; b < mBatches.size(); b++) {
+            const DrawBatch& batch = mBatches[b];
+            glm::mat4* dst = &mTransforms[batch.transformOffset / sizeof(glm::mat4)];
+            for (unsigned i = 0; i < batch.count; i++) {
+                dst[i] = mItems[mOrder[batch.first + i]].transform;
+            }
+        }
+        UploadBuffer(mTransformBuffer, mTransformCapacity, &mTransforms[0], mTransforms.size() * sizeof(glm::mat4));
+        mTransformsDirty = false;
+    }
+
+    // the commands are cheap to rebuild, and only go to the GPU if a mesh moved in its arena
+    // or switched to another level of detail since last time
+    BuildCommands(mNewCommands);
+    if (mNewCommands != mCommands) {
+        UploadBuffer(mCommandBuffer, mCommandCapacity, &mNewCommands[0], mNewCommands.size());
+        mCommands.swap(mNewCommands);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+
+    for (unsigned b = 0; b < mBatches.size(); b++) {
+        const DrawBatch& batch = mBatches[b];
+
+        glBindVertexArray(batch.vao);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, mTransformBinding, mTransformBuffer,
+                          batch.transformOffset, batch.count * sizeof(glm::mat4));
+
+        if (batch.indexType != GL_NONE) {
+            glMultiDrawElementsIndirect(batch.drawingMode, batch.indexType, GLSH_BUFFER_OFFSET(batch.commandOffset), batch.count, 0);
+        } else {
+            glMultiDrawArraysIndirect(batch.drawingMode, GLSH_BUFFER_OFFSET(batch.commandOffset), batch.count, 0);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    return true;
+}
+
+} // end of namespace
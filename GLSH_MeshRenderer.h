@@ -0,0 +1,95 @@
+#ifndef GLSH_MESHRENDERER_H_
+#define GLSH_MESHRENDERER_H_
+
+#include "GLSH_MeshArena.h"
+#include "GLSH_Math.h"
+
+#include <vector>
+
+namespace glsh {
+
+//
+// Draws a list of arena meshes with as few calls as it can: meshes that share an arena pool (so a VAO),
+// a drawing mode and an index type become one glMultiDrawElementsIndirect (or glMultiDrawArraysIndirect),
+// whatever their number.  Each mesh's model matrix goes into a shader storage buffer, which the vertex
+// shader indexes with gl_DrawIDARB; see shaders/TexNoLightMDI-vs.glsl:
+//
+//      layout(std430, binding = 0) readonly buffer DrawTransforms {
+//          mat4 u_ModelMatrices[];
+//      };
+//      ... u_ModelMatrices[gl_DrawIDARB] * in_Vertex ...
+//
+// The draw list stays put between frames.  The transforms are only uploaded again after they change,
+// and the commands only after the arena moves a mesh (MeshArena::Compact) or a mesh with levels of detail
+// switches level (ArenaMesh::SelectLOD, called before Draw), so a static scene costs the same few calls each
+// frame however many objects are in it.
+//
+// Remove meshes (Clear) before deleting them.  Needs GL 4.3, or ARB_multi_draw_indirect and
+// ARB_shader_storage_buffer_object, plus ARB_shader_draw_parameters; see IsSupported.
+//
+class MeshRenderer {
+    struct DrawItem {
+        const ArenaMesh*    mesh;
+        glm::mat4           transform;
+    };
+
+    // a run of items drawn by one multi-draw call
+    struct DrawBatch {
+        GLuint              vao;
+        GLenum              drawingMode;
+        GLenum              indexType;          // GL_NONE for meshes without indices
+        unsigned            first;              // into mOrder
+        unsigned            count;
+        size_t              commandOffset;      // in bytes, in the command buffer
+        size_t              transformOffset;    // in bytes, in the transform buffer
+    };
+
+    std::vector<DrawItem>       mItems;
+    std::vector<unsigned>       mOrder;             // items sorted into batches
+    std::vector<DrawBatch>      mBatches;
+    bool                        mBatchesDirty;      // items were added or removed
+    bool                        mTransformsDirty;
+
+    std::vector<unsigned char>  mCommands;          // as last uploaded
+    std::vector<unsigned char>  mNewCommands;       // scratch, to compare against mCommands
+    std::vector<glm::mat4>      mTransforms;        // scratch, in batch order with alignment gaps
+
+    GLuint                      mTransformBinding;  // shader storage binding point of DrawTransforms
+    GLuint                      mCommandBuffer;
+    size_t                      mCommandCapacity;
+    GLuint                      mTransformBuffer;
+    size_t                      mTransformCapacity;
+
+public:
+                                MeshRenderer(GLuint transformBinding = 0);
+                                ~MeshRenderer();
+
+    static bool                 IsSupported();
+
+    // returns the mesh's index in the draw list
+    unsigned                    Add(const ArenaMesh* mesh, const glm::mat4& transform = glm::mat4(1.0f));
+
+    void                        SetTransform(unsigned i, const glm::mat4& transform);
+
+    void                        Clear();
+
+    // draw everything in the list with the current program, which reads the transforms
+    bool                        Draw();
+
+    unsigned                    numDraws() const        { return (unsigned)mItems.size(); }
+
+    // multi-draw calls per Draw, one for each batch
+    unsigned                    numBatches() const      { return (unsigned)mBatches.size(); }
+
+private:
+    void                        BuildBatches();
+    void                        BuildCommands(std::vector<unsigned char>& commands) const;
+
+                                // noncopyable
+                                MeshRenderer(const MeshRenderer&);
+                                MeshRenderer& operator= (const MeshRenderer&);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,512 @@
+#include "GLSH_MeshSimplifier.h"
+#include "GLSH_MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace glsh {
+
+// a collapse is skipped if it turns a triangle further than this, the cosine of 60 degrees
+static const double SIMPLIFY_MIN_NORMAL_COS = 0.5;
+
+// how much harder seams and borders are held in place than the surface around them
+static const double SIMPLIFY_EDGE_WEIGHT = 10.0;
+
+// what a point of the surface is allowed to do
+enum PointKind {
+    POINT_MANIFOLD,     // one vertex, surrounded by triangles: can collapse onto any neighbour
+    POINT_BORDER,       // one vertex on an open border: can only slide along it
+    POINT_SEAM,         // two vertices, one each side of a seam: can only slide along it
+    POINT_LOCKED        // corners, branches and anything non-manifold: stays put
+};
+
+// the weighted squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+    double  a2, b2, c2, d2, ab, ac, ad, bc, bd, cd;
+    double  weight;
+
+    Quadric()
+        : a2(0), b2(0), c2(0), d2(0), ab(0), ac(0), ad(0), bc(0), bd(0), cd(0), weight(0)
+    { }
+
+    // the plane a x + b y + c z + d = 0, with a unit normal
+    void AddPlane(double a, double b, double c, double d, double w)
+    {
+        a2 += w * a * a;  b2 += w * b * b;  c2 += w * c * c;  d2 += w * d * d;
+        ab += w * a * b;  ac += w * a * c;  ad += w * a * d;
+        bc += w * b * c;  bd += w * b * d;  cd += w * c * d;
+        weight += w;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a2 += q.a2;  b2 += q.b2;  c2 += q.c2;  d2 += q.d2;
+        ab += q.ab;  ac += q.ac;  ad += q.ad;
+        bc += q.bc;  bd += q.bd;  cd += q.cd;
+        weight += q.weight;
+    }
+
+    // the weighted mean squared distance from p to the planes
+    double Error(const float* p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double e = a2 * x * x + b2 * y * y + c2 * z * z + d2
+                 + 2 * (ab * x * y + ac * x * z + bc * y * z)
+                 + 2 * (ad * x + bd * y + cd * z);
+        return weight > 0 && e > 0 ? e / weight : 0;
+    }
+};
+
+// the first triangle found with each directed edge between two points, and how many triangles have it
+struct SimplifyEdge {
+    unsigned    from, to;       // the vertices at either end
+    unsigned    triangle;
+    unsigned    count;
+};
+
+struct SimplifyCollapse {
+    unsigned    from, to;       // points
+    float       error;
+
+    bool operator< (const SimplifyCollapse& other) const
+    {
+        return error < other.error;
+    }
+};
+
+static inline unsigned long long EdgeKey(unsigned from, unsigned to)
+{
+    return (unsigned long long)from << 32 | to;
+}
+
+static void Cross(double* n, const float* p0, const float* p1, const float* p2)
+{
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static double Dot(const double* a, const double* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// a plane perpendicular to a triangle through one of its edges, which keeps a seam or border from wandering off sideways
+static void AddEdgeConstraint(Quadric& q0, Quadric& q1, const float* p0, const float* p1, const float* p2)
+{
+    double n[3];
+    Cross(n, p0, p1, p2);
+
+    double e[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+    double len = std::sqrt(Dot(m, m));
+    if (len == 0) {
+        return;
+    }
+    m[0] /= len;  m[1] /= len;  m[2] /= len;
+
+    double d = -(m[0] * p0[0] + m[1] * p0[1] + m[2] * p0[2]);
+    double w = Dot(e, e) * SIMPLIFY_EDGE_WEIGHT;
+    q0.AddPlane(m[0], m[1], m[2], d, w);
+    q1.AddPlane(m[0], m[1], m[2], d, w);
+}
+
+size_t SimplifyMesh(unsigned* dst, const unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices,
+                    size_t stride, size_t targetIndexCount, float maxError, float* resultError)
+{
+    size_t count = numIndices / 3 * 3;
+    if (dst != indices) {
+        memmove(dst, indices, count * sizeof(unsigned));
+    }
+
+    float error = 0;
+    if (resultError) {
+        *resultError = 0;
+    }
+    if (count <= targetIndexCount || numVertices == 0) {
+        return count;
+    }
+
+    const char* base = (const char*)positions;
+
+    //
+    // vertices at the same position are one point of the surface, and the vertices at a point are its wedges
+    //
+
+    std::vector<unsigned> wedges(numVertices);
+    for (unsigned v = 0; v < numVertices; v++) {
+        wedges[v] = v;
+    }
+    std::sort(wedges.begin(), wedges.end(), [&](unsigned a, unsigned b) {
+        const float* pa = (const float*)(base + a * stride);
+        const float* pb = (const float*)(base + b * stride);
+        if (pa[0] != pb[0]) return pa[0] < pb[0];
+        if (pa[1] != pb[1]) return pa[1] < pb[1];
+        return pa[2] < pb[2];
+    });
+
+    std::vector<unsigned> point(numVertices);
+    std::vector<unsigned> firstWedge;
+    for (unsigned i = 0; i < numVertices; i++) {
+        const float* p = (const float*)(base + wedges[i] * stride);
+        const float* prev = i > 0 ? (const float*)(base + wedges[i - 1] * stride) : NULL;
+        if (!prev || p[0] != prev[0] || p[1] != prev[1] || p[2] != prev[2]) {
+            firstWedge.push_back(i);
+        }
+        point[wedges[i]] = (unsigned)firstWedge.size() - 1;
+    }
+    unsigned numPoints = (unsigned)firstWedge.size();
+    firstWedge.push_back(numVertices);
+
+    std::vector<const float*> pointPos(numPoints);
+    for (unsigned p = 0; p < numPoints; p++) {
+        pointPos[p] = (const float*)(base + wedges[firstWedge[p]] * stride);
+    }
+
+    // triangles with two corners at one point draw nothing, and would confuse the topology below
+    size_t numKept = 0;
+    for (size_t i = 0; i < count; i += 3) {
+        unsigned a = dst[i], b = dst[i + 1], c = dst[i + 2];
+        if (point[a] != point[b] && point[b] != point[c] && point[c] != point[a]) {
+            dst[numKept++] = a;
+            dst[numKept++] = b;
+            dst[numKept++] = c;
+        }
+    }
+    count = numKept;
+
+    // every point starts out with the planes of the triangles around it, weighted by area
+    std::vector<Quadric> quadrics(numPoints);
+    for (size_t i = 0; i < count; i += 3) {
+        const float* p0 = pointPos[point[dst[i]]];
+        double n[3];
+        Cross(n, p0, pointPos[point[dst[i + 1]]], pointPos[point[dst[i + 2]]]);
+        double len = std::sqrt(Dot(n, n));
+        if (len == 0) {
+            continue;
+        }
+        n[0] /= len;  n[1] /= len;  n[2] /= len;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int k = 0; k < 3; k++) {
+            quadrics[point[dst[i + k]]].AddPlane(n[0], n[1], n[2], d, len / 2);
+        }
+    }
+
+    //
+    // collapse in passes: find the legal collapses, do the cheapest ones that don't touch each other,
+    // rebuild the triangle list, and go again until it's small enough or nothing can go
+    //
+
+    std::vector<unsigned> trianglesAt;          // the triangles around each point
+    std::vector<unsigned> firstTriangleAt(numPoints + 1);
+    std::unordered_map<unsigned long long, SimplifyEdge> edges;
+    std::vector<unsigned char> kind(numPoints);
+    std::vector<unsigned> seamEnds(numPoints * 2);     // the other ends of a border or seam point's two edges
+    std::vector<unsigned> numSeamEdges(numPoints);
+    std::vector<unsigned char> seamTypes(numPoints);   // 1 for border edges, 2 for seam edges
+    std::vector<unsigned> numUsedWedges(numPoints);
+    std::vector<unsigned char> usedVertex(numVertices);
+    std::vector<SimplifyCollapse> collapses;
+    std::vector<unsigned char> touched(numPoints);
+    std::vector<unsigned> remap(numVertices);
+    bool firstPass = true;
+
+    while (count > targetIndexCount) {
+        unsigned numTriangles = (unsigned)(count / 3);
+
+        std::fill(firstTriangleAt.begin(), firstTriangleAt.end(), 0);
+        for (size_t i = 0; i < count; i++) {
+            ++firstTriangleAt[point[dst[i]] + 1];
+        }
+        for (unsigned p = 0; p < numPoints; p++) {
+            firstTriangleAt[p + 1] += firstTriangleAt[p];
+        }
+        trianglesAt.resize(count);
+        std::vector<unsigned> fill(firstTriangleAt.begin(), firstTriangleAt.end() - 1);
+        for (size_t i = 0; i < count; i++) {
+            trianglesAt[fill[point[dst[i]]]++] = (unsigned)(i / 3);
+        }
+
+        edges.clear();
+        std::fill(usedVertex.begin(), usedVertex.end(), 0);
+        for (unsigned t = 0; t < numTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned a = dst[3 * t + k];
+                unsigned b = dst[3 * t + (k + 1) % 3];
+                usedVertex[a] = 1;
+                if (point[a] == point[b]) {
+                    continue;
+                }
+                SimplifyEdge& e = edges[EdgeKey(point[a], point[b])];
+                if (e.count++ == 0) {
+                    e.from = a;
+                    e.to = b;
+                    e.triangle = t;
+                }
+            }
+        }
+
+        // find the borders and seams
+        std::fill(numSeamEdges.begin(), numSeamEdges.end(), 0);
+        std::fill(seamTypes.begin(), seamTypes.end(), 0);
+        std::fill(kind.begin(), kind.end(), (unsigned char)POINT_MANIFOLD);
+
+        for (std::unordered_map<unsigned long long, SimplifyEdge>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+            unsigned pa = (unsigned)(it->first >> 32);
+            unsigned pb = (unsigned)(it->first & 0xffffffff);
+            const SimplifyEdge& e = it->second;
+
+            if (e.count > 1) {
+                // more than two triangles on an edge, or a flipped one
+                kind[pa] = kind[pb] = POINT_LOCKED;
+            }
+
+            std::unordered_map<unsigned long long, SimplifyEdge>::const_iterator rev = edges.find(EdgeKey(pb, pa));
+            unsigned char type = 0;
+            if (rev == edges.end()) {
+                type = 1;
+            } else if (rev->second.from != e.to || rev->second.to != e.from) {
+                type = 2;
+            }
+            if (!type) {
+                continue;
+            }
+
+            if (firstPass) {
+                const unsigned* tri = &dst[3 * e.triangle];
+                unsigned k = tri[0] == e.from ? 0 : tri[1] == e.from ? 1 : 2;
+                AddEdgeConstraint(quadrics[pa], quadrics[pb], pointPos[pa], pointPos[pb], pointPos[point[tri[(k + 2) % 3]]]);
+            }
+
+            // a seam has a directed edge each side, count it once
+            if (type == 2 && pa > pb) {
+                continue;
+            }
+            unsigned ends[2] = { pa, pb };
+            for (int k = 0; k < 2; k++) {
+                unsigned p = ends[k];
+                if (numSeamEdges[p] < 2) {
+                    seamEnds[2 * p + numSeamEdges[p]] = ends[1 - k];
+                }
+                ++numSeamEdges[p];
+                seamTypes[p] |= type;
+            }
+        }
+        firstPass = false;
+
+        for (unsigned p = 0; p < numPoints; p++) {
+            numUsedWedges[p] = 0;
+            for (unsigned w = firstWedge[p]; w < firstWedge[p + 1]; w++) {
+                numUsedWedges[p] += usedVertex[wedges[w]];
+            }
+
+            if (kind[p] == POINT_LOCKED) {
+                continue;
+            }
+            if (numSeamEdges[p] == 0 && numUsedWedges[p] == 1) {
+                kind[p] = POINT_MANIFOLD;
+            } else if (numSeamEdges[p] == 2 && seamTypes[p] == 1 && numUsedWedges[p] == 1) {
+                kind[p] = POINT_BORDER;
+            } else if (numSeamEdges[p] == 2 && seamTypes[p] == 2 && numUsedWedges[p] == 2) {
+                kind[p] = POINT_SEAM;
+            } else {
+                kind[p] = POINT_LOCKED;
+            }
+        }
+
+        // every legal collapse, cheapest first
+        collapses.clear();
+        for (std::unordered_map<unsigned long long, SimplifyEdge>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+            unsigned ends[2] = { (unsigned)(it->first >> 32), (unsigned)(it->first & 0xffffffff) };
+
+            // both directions from one of the edge's two sides, or from the only side of a border
+            if (ends[0] > ends[1] && edges.count(EdgeKey(ends[1], ends[0]))) {
+                continue;
+            }
+
+            for (int k = 0; k < 2; k++) {
+                unsigned from = ends[k];
+                unsigned to = ends[1 - k];
+
+                bool legal = kind[from] == POINT_MANIFOLD
+                          || ((kind[from] == POINT_BORDER || kind[from] == POINT_SEAM)
+                              && (seamEnds[2 * from] == to || seamEnds[2 * from + 1] == to));
+                if (!legal) {
+                    continue;
+                }
+
+                Quadric q = quadrics[from];
+                q.Add(quadrics[to]);
+
+                SimplifyCollapse c;
+                c.from = from;
+                c.to = to;
+                c.error = (float)std::sqrt(q.Error(pointPos[to]));
+                collapses.push_back(c);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        for (unsigned v = 0; v < numVertices; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+
+        unsigned trianglesLeft = numTriangles;
+        unsigned targetTriangles = (unsigned)(targetIndexCount / 3);
+        unsigned numCollapsed = 0;
+
+        for (size_t c = 0; c < collapses.size() && trianglesLeft > targetTriangles; c++) {
+            unsigned from = collapses[c].from;
+            unsigned to = collapses[c].to;
+
+            if (collapses[c].error > maxError) {
+                break;
+            }
+            if (touched[from] || touched[to]) {
+                continue;
+            }
+
+            // each wedge at from goes onto the vertex at to it shares an edge with, which is on the same side of any seam
+            unsigned moveFrom[2] = { ~0u, ~0u };
+            unsigned moveTo[2] = { ~0u, ~0u };
+            unsigned numMoves = 0;
+            unsigned removed = 0;
+            bool ok = true;
+
+            for (unsigned i = firstTriangleAt[from]; i < firstTriangleAt[from + 1] && ok; i++) {
+                const unsigned* tri = &dst[3 * trianglesAt[i]];
+                unsigned k = point[tri[0]] == from ? 0 : point[tri[1]] == from ? 1 : 2;
+                unsigned v = tri[k];
+                unsigned n1 = tri[(k + 1) % 3];
+                unsigned n2 = tri[(k + 2) % 3];
+
+                if (point[n1] == to || point[n2] == to) {
+                    // this triangle goes away; note where its wedge moves to
+                    unsigned target = point[n1] == to ? n1 : n2;
+                    unsigned m = 0;
+                    while (m < numMoves && moveFrom[m] != v) {
+                        ++m;
+                    }
+                    if (m == numMoves) {
+                        if (numMoves == 2) {
+                            ok = false;
+                            break;
+                        }
+                        moveFrom[numMoves] = v;
+                        moveTo[numMoves] = target;
+                        ++numMoves;
+                    } else if (moveTo[m] != target) {
+                        ok = false;
+                    }
+                    ++removed;
+                    continue;
+                }
+
+                // this one stays; it mustn't flip or turn too far
+                double before[3], after[3];
+                Cross(before, pointPos[from], pointPos[point[n1]], pointPos[point[n2]]);
+                Cross(after, pointPos[to], pointPos[point[n1]], pointPos[point[n2]]);
+                double lenBefore = std::sqrt(Dot(before, before));
+                double lenAfter = std::sqrt(Dot(after, after));
+                if (lenBefore > 0 && Dot(before, after) <= SIMPLIFY_MIN_NORMAL_COS * lenBefore * lenAfter) {
+                    ok = false;
+                }
+            }
+
+            if (!ok || numMoves != numUsedWedges[from]) {
+                continue;
+            }
+
+            // the wedges that had a triangle towards to are all of them, so every triangle at from follows along
+            for (unsigned m = 0; m < numMoves; m++) {
+                remap[moveFrom[m]] = moveTo[m];
+            }
+            quadrics[to].Add(quadrics[from]);
+
+            // the triangles around from change shape, so nothing else touching them can collapse this pass
+            for (unsigned i = firstTriangleAt[from]; i < firstTriangleAt[from + 1]; i++) {
+                const unsigned* tri = &dst[3 * trianglesAt[i]];
+                touched[point[tri[0]]] = touched[point[tri[1]]] = touched[point[tri[2]]] = 1;
+            }
+
+            trianglesLeft -= removed;
+            error = std::max(error, collapses[c].error);
+            ++numCollapsed;
+        }
+
+        if (numCollapsed == 0) {
+            break;
+        }
+
+        // move the collapsed wedges and drop the triangles that collapsed with them
+        size_t newCount = 0;
+        for (size_t i = 0; i < count; i += 3) {
+            unsigned a = remap[dst[i]];
+            unsigned b = remap[dst[i + 1]];
+            unsigned c = remap[dst[i + 2]];
+            if (point[a] == point[b] || point[b] == point[c] || point[c] == point[a]) {
+                continue;
+            }
+            dst[newCount++] = a;
+            dst[newCount++] = b;
+            dst[newCount++] = c;
+        }
+        count = newCount;
+    }
+
+    if (resultError) {
+        *resultError = error;
+    }
+    return count;
+}
+
+void GenerateLODs(std::vector<unsigned>& lodIndices, std::vector<MeshLODLevel>& levels,
+                  const unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices, size_t stride,
+                  unsigned maxLevels, float reduction)
+{
+    numIndices = numIndices / 3 * 3;
+
+    lodIndices.assign(indices, indices + numIndices);
+    levels.clear();
+
+    if (numIndices == 0 || maxLevels == 0) {
+        return;
+    }
+
+    MeshLODLevel full = { 0, numIndices, 0.0f };
+    levels.push_back(full);
+
+    std::vector<unsigned> simplified;
+    while (levels.size() < maxLevels) {
+        MeshLODLevel prev = levels.back();
+
+        size_t target = (size_t)(prev.numIndices / 3 * reduction) * 3;
+        if (target == 0) {
+            break;
+        }
+
+        simplified.assign(lodIndices.begin() + prev.firstIndex, lodIndices.begin() + prev.firstIndex + prev.numIndices);
+        float stepError = 0;
+        size_t n = SimplifyMesh(&simplified[0], &simplified[0], simplified.size(), positions, numVertices, stride,
+                                target, FLT_MAX, &stepError);
+
+        // not worth a level if it hardly got any smaller
+        if (n == 0 || n * 10 > prev.numIndices * 9) {
+            break;
+        }
+
+        OptimizeVertexCache(&simplified[0], &simplified[0], n, numVertices);
+
+        // the error against the previous level, on top of that level's own
+        MeshLODLevel level = { lodIndices.size(), n, prev.error + stepError };
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.begin() + n);
+        levels.push_back(level);
+    }
+}
+
+} // end of namespace
@@ -0,0 +1,68 @@
+#ifndef GLSH_MESHSIMPLIFIER_H_
+#define GLSH_MESHSIMPLIFIER_H_
+
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+namespace glsh {
+
+//
+// Levels of detail for indexed triangle lists, by edge collapses in order of quadric error
+// (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+//
+// Each collapse moves a vertex onto one of its neighbours rather than to a new position, so the simplified
+// indices still index the original vertices, and a whole chain of LODs can share one vertex buffer.
+//
+// Vertices at the same position are one point of the surface.  Where they differ in normal or texcoord
+// (a UV seam or a hard edge), they are only collapsed along the seam, each onto the vertex on its own side,
+// so the seam stays closed and both sides keep their attributes.  Open borders are kept the same way, and
+// points where seams or borders meet never move.  A collapse that would turn any triangle by more than
+// 60 degrees is skipped, so the surface keeps facing the way its vertex normals say.
+//
+
+// one level of the chain GenerateLODs makes
+struct MeshLODLevel {
+    size_t      firstIndex;     // into the chain's index array
+    size_t      numIndices;
+    float       error;          // how far this level's surface can be from the original, in position units
+};
+
+//
+// Simplify to at most targetIndexCount indices, or as far as collapses within maxError get.  positions points at
+// the first vertex's x, y, z floats, stride bytes apart.  dst may be the same array as indices.  Returns the new
+// index count; resultError, if given, gets the farthest the result is from the input.
+//
+size_t SimplifyMesh(unsigned* dst, const unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices,
+                    size_t stride, size_t targetIndexCount, float maxError = FLT_MAX, float* resultError = NULL);
+
+//
+// A chain of up to maxLevels LODs, all in lodIndices.  Level 0 is the triangles as given; each level after it has
+// about reduction times the indices of the one before and is simplified from it, so the errors only grow.
+// Stops early once a level wouldn't come out much smaller than the one before.  Each level is sorted for the
+// vertex cache (see GLSH_MeshOptimizer.h).
+//
+void GenerateLODs(std::vector<unsigned>& lodIndices, std::vector<MeshLODLevel>& levels,
+                  const unsigned* indices, size_t numIndices, const float* positions, unsigned numVertices, size_t stride,
+                  unsigned maxLevels = 4, float reduction = 0.5f);
+
+// for vertex types with a glm::vec3 pos member (see GLSH_Vertex.h)
+template <typename VertexType>
+void GenerateLODs(std::vector<unsigned>& lodIndices, std::vector<MeshLODLevel>& levels,
+                  const std::vector<VertexType>& vertices, const std::vector<unsigned>& indices,
+                  unsigned maxLevels = 4, float reduction = 0.5f)
+{
+    lodIndices.clear();
+    levels.clear();
+
+    if (vertices.empty() || indices.empty()) {
+        return;
+    }
+
+    GenerateLODs(lodIndices, levels, &indices[0], indices.size(), &vertices[0].pos.x, (unsigned)vertices.size(),
+                 sizeof(VertexType), maxLevels, reduction);
+}
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,598 @@
+#include "GLSH_PixelOps.h"
+
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#  define GLSH_X86 1
+#  include <immintrin.h>
+#  if _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+// MSVC lets us use any intrinsic anywhere; gcc and clang need to be told which functions may use what
+#if GLSH_X86 && !_MSC_VER
+#  define GLSH_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define GLSH_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#  define GLSH_TARGET_SSSE3
+#  define GLSH_TARGET_AVX2
+#endif
+
+namespace glsh {
+
+//
+// CPU feature detection
+//
+
+#if GLSH_X86
+
+static void Cpuid(int info[4], int leaf)
+{
+#if _MSC_VER
+    __cpuidex(info, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+static unsigned long long Xgetbv()
+{
+#if _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+#endif
+
+static CpuFeatures DetectCpuFeatures()
+{
+    CpuFeatures f;
+    f.sse2 = false;
+    f.ssse3 = false;
+    f.avx2 = false;
+
+#if GLSH_X86
+    int info[4];
+    Cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    if (maxLeaf >= 1) {
+        Cpuid(info, 1);
+        f.sse2 = (info[3] & (1 << 26)) != 0;
+        f.ssse3 = (info[2] & (1 << 9)) != 0;
+
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+
+        // AVX2 also needs the OS to save the YMM state on context switches
+        if (maxLeaf >= 7 && osxsave && avx && (Xgetbv() & 6) == 6) {
+            Cpuid(info, 7);
+            f.avx2 = (info[1] & (1 << 5)) != 0;
+        }
+    }
+#endif
+
+    return f;
+}
+
+//
+// Scalar kernels (also used for the leftovers of the SIMD kernels)
+//
+
+static void SwizzleBGRToRGB_Scalar(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        unsigned char b = src[0];
+        unsigned char g = src[1];
+        unsigned char r = src[2];
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        src += 3;
+        dst += 3;
+    }
+}
+
+static void SwizzleBGRAToRGBA_Scalar(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        unsigned char b = src[0];
+        unsigned char g = src[1];
+        unsigned char r = src[2];
+        unsigned char a = src[3];
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        dst[3] = a;
+        src += 4;
+        dst += 4;
+    }
+}
+
+static void ExpandRGBToRGBA_Scalar(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = alpha;
+        src += 3;
+        dst += 4;
+    }
+}
+
+static void ExpandGrayToRGBA_Scalar(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    for (size_t i = 0; i < n; i++) {
+        unsigned char g = *src++;
+        dst[0] = g;
+        dst[1] = g;
+        dst[2] = g;
+        dst[3] = alpha;
+        dst += 4;
+    }
+}
+
+static void DownsampleRow2x2_Scalar(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t n, int bpp)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (int c = 0; c < bpp; c++) {
+            unsigned sum = row0[c] + row0[c + bpp] + row1[c] + row1[c + bpp];
+            dst[c] = (unsigned char)((sum + 2) >> 2);
+        }
+        row0 += 2 * bpp;
+        row1 += 2 * bpp;
+        dst += bpp;
+    }
+}
+
+#if GLSH_X86
+
+//
+// SSSE3 kernels
+//
+
+GLSH_TARGET_SSSE3
+static void SwizzleBGRToRGB_SSSE3(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    // 16 pixels = 48 bytes = 3 registers per iteration; pixels straddle the register boundaries,
+    // so each output register is OR-ed together from shuffles of its neighbouring input registers
+    const __m128i m00 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -128);
+    const __m128i m01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1);
+    const __m128i m10 = _mm_setr_epi8(-128, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m128i m11 = _mm_setr_epi8(0, -128, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -128, 15);
+    const __m128i m12 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, -128);
+    const __m128i m21 = _mm_setr_epi8(14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m128i m22 = _mm_setr_epi8(-128, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+
+    size_t i = 0;
+    for ( ; i + 16 <= n; i += 16) {
+        __m128i in0 = _mm_loadu_si128((const __m128i*)(src));
+        __m128i in1 = _mm_loadu_si128((const __m128i*)(src + 16));
+        __m128i in2 = _mm_loadu_si128((const __m128i*)(src + 32));
+
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(in0, m00), _mm_shuffle_epi8(in1, m01));
+        __m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, m10), _mm_shuffle_epi8(in1, m11)), _mm_shuffle_epi8(in2, m12));
+        __m128i out2 = _mm_or_si128(_mm_shuffle_epi8(in1, m21), _mm_shuffle_epi8(in2, m22));
+
+        _mm_storeu_si128((__m128i*)(dst), out0);
+        _mm_storeu_si128((__m128i*)(dst + 16), out1);
+        _mm_storeu_si128((__m128i*)(dst + 32), out2);
+
+        src += 48;
+        dst += 48;
+    }
+
+    SwizzleBGRToRGB_Scalar(dst, src, n - i);
+}
+
+GLSH_TARGET_SSSE3
+static void SwizzleBGRAToRGBA_SSSE3(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(v, mask));
+        src += 16;
+        dst += 16;
+    }
+
+    SwizzleBGRAToRGBA_Scalar(dst, src, n - i);
+}
+
+GLSH_TARGET_SSSE3
+static void ExpandRGBToRGBA_SSSE3(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    // 16 pixels = 48 bytes in, 64 bytes out per iteration
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+    const __m128i a = _mm_set1_epi32((int)((unsigned)alpha << 24));
+
+    size_t i = 0;
+    for ( ; i + 16 <= n; i += 16) {
+        __m128i in0 = _mm_loadu_si128((const __m128i*)(src));
+        __m128i in1 = _mm_loadu_si128((const __m128i*)(src + 16));
+        __m128i in2 = _mm_loadu_si128((const __m128i*)(src + 32));
+
+        // line up each group of 4 pixels at the start of a register
+        __m128i p0 = in0;
+        __m128i p1 = _mm_alignr_epi8(in1, in0, 12);
+        __m128i p2 = _mm_alignr_epi8(in2, in1, 8);
+        __m128i p3 = _mm_srli_si128(in2, 4);
+
+        _mm_storeu_si128((__m128i*)(dst),      _mm_or_si128(_mm_shuffle_epi8(p0, mask), a));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_shuffle_epi8(p1, mask), a));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_shuffle_epi8(p2, mask), a));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_or_si128(_mm_shuffle_epi8(p3, mask), a));
+
+        src += 48;
+        dst += 64;
+    }
+
+    ExpandRGBToRGBA_Scalar(dst, src, n - i, alpha);
+}
+
+GLSH_TARGET_SSSE3
+static void ExpandGrayToRGBA_SSSE3(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    const __m128i a = _mm_set1_epi32((int)((unsigned)alpha << 24));
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+
+    size_t i = 0;
+    for ( ; i + 16 <= n; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i*)src);
+
+        // duplicate each gray byte 4 times, then patch in the alpha
+        __m128i lo = _mm_unpacklo_epi8(g, g);
+        __m128i hi = _mm_unpackhi_epi8(g, g);
+        __m128i q0 = _mm_unpacklo_epi16(lo, lo);
+        __m128i q1 = _mm_unpackhi_epi16(lo, lo);
+        __m128i q2 = _mm_unpacklo_epi16(hi, hi);
+        __m128i q3 = _mm_unpackhi_epi16(hi, hi);
+
+        _mm_storeu_si128((__m128i*)(dst),      _mm_or_si128(_mm_and_si128(q0, rgbMask), a));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_and_si128(q1, rgbMask), a));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_and_si128(q2, rgbMask), a));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_or_si128(_mm_and_si128(q3, rgbMask), a));
+
+        src += 16;
+        dst += 64;
+    }
+
+    ExpandGrayToRGBA_Scalar(dst, src, n - i, alpha);
+}
+
+//
+// 2x2 box filters: sums are formed in 16-bit lanes, so nothing overflows before the rounding shift
+//
+
+GLSH_TARGET_SSSE3
+static void DownsampleRow2x2_Gray_SSSE3(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t n)
+{
+    // 32 source pixels per row -> 16 output pixels per iteration
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    const __m128i two = _mm_set1_epi16(2);
+
+    size_t i = 0;
+    for ( ; i + 16 <= n; i += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(row0));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(row1));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 16));
+
+        // even + odd byte of each 16-bit lane is one horizontal pair
+        __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, lowBytes), _mm_srli_epi16(a0, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b0, lowBytes), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, lowBytes), _mm_srli_epi16(a1, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b1, lowBytes), _mm_srli_epi16(b1, 8)));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(s0, s1));
+
+        row0 += 32;
+        row1 += 32;
+        dst += 16;
+    }
+
+    DownsampleRow2x2_Scalar(dst, row0, row1, n - i, 1);
+}
+
+GLSH_TARGET_SSSE3
+static void DownsampleRow2x2_RGB_SSSE3(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t n)
+{
+    // 8 source pixels per row -> 4 output pixels per iteration, each widened into a 64-bit slot
+    const __m128i evenPixels = _mm_setr_epi8(0, -128, 1, -128, 2, -128, -128, -128, 6, -128, 7, -128, 8, -128, -128, -128);
+    const __m128i oddPixels = _mm_setr_epi8(3, -128, 4, -128, 5, -128, -128, -128, 9, -128, 10, -128, 11, -128, -128, -128);
+    const __m128i compact = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+    const __m128i two = _mm_set1_epi16(2);
+
+    // the second load of each row reads 4 bytes past the 8 pixels, so stop while that's still in bounds
+    size_t i = 0;
+    for ( ; i + 5 <= n; i += 4) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(row0));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 12));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(row1));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 12));
+
+        __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_shuffle_epi8(a0, evenPixels), _mm_shuffle_epi8(a0, oddPixels)),
+                                   _mm_add_epi16(_mm_shuffle_epi8(b0, evenPixels), _mm_shuffle_epi8(b0, oddPixels)));
+        __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_shuffle_epi8(a1, evenPixels), _mm_shuffle_epi8(a1, oddPixels)),
+                                   _mm_add_epi16(_mm_shuffle_epi8(b1, evenPixels), _mm_shuffle_epi8(b1, oddPixels)));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        __m128i out = _mm_shuffle_epi8(_mm_packus_epi16(s0, s1), compact);
+
+        _mm_storel_epi64((__m128i*)dst, out);
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+        memcpy(dst + 8, &tail, 4);
+
+        row0 += 24;
+        row1 += 24;
+        dst += 12;
+    }
+
+    DownsampleRow2x2_Scalar(dst, row0, row1, n - i, 3);
+}
+
+GLSH_TARGET_SSSE3
+static void DownsampleRow2x2_RGBA_SSSE3(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t n)
+{
+    // 8 source pixels per row -> 4 output pixels per iteration
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+
+    size_t i = 0;
+    for ( ; i + 4 <= n; i += 4) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(row0));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(row1));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 16));
+
+        // vertical sums, two pixels per register
+        __m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        __m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        __m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+        // horizontal sums: pair up the low and high halves
+        __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+        __m128i s1 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(s0, s1));
+
+        row0 += 32;
+        row1 += 32;
+        dst += 16;
+    }
+
+    DownsampleRow2x2_Scalar(dst, row0, row1, n - i, 4);
+}
+
+GLSH_TARGET_SSSE3
+static void DownsampleRow2x2_SSSE3(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t n, int bpp)
+{
+    switch (bpp) {
+    case 1:
+        DownsampleRow2x2_Gray_SSSE3(dst, row0, row1, n);
+        break;
+    case 3:
+        DownsampleRow2x2_RGB_SSSE3(dst, row0, row1, n);
+        break;
+    case 4:
+        DownsampleRow2x2_RGBA_SSSE3(dst, row0, row1, n);
+        break;
+    default:
+        DownsampleRow2x2_Scalar(dst, row0, row1, n, bpp);
+        break;
+    }
+}
+
+//
+// AVX2 kernels
+//
+// Byte shuffles only work within 128-bit lanes, so the 3-byte formats are handled as two
+// independent SSSE3-style streams, one per lane.
+//
+
+GLSH_TARGET_AVX2
+static void SwizzleBGRToRGB_AVX2(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    const __m256i m00 = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -128,
+                                         2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -128);
+    const __m256i m01 = _mm256_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1,
+                                         -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1);
+    const __m256i m10 = _mm256_setr_epi8(-128, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128,
+                                         -128, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m256i m11 = _mm256_setr_epi8(0, -128, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -128, 15,
+                                         0, -128, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -128, 15);
+    const __m256i m12 = _mm256_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, -128,
+                                         -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, -128);
+    const __m256i m21 = _mm256_setr_epi8(14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128,
+                                         14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m256i m22 = _mm256_setr_epi8(-128, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13,
+                                         -128, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+
+    size_t i = 0;
+    for ( ; i + 32 <= n; i += 32) {
+        // low lanes get pixels 0-15, high lanes get pixels 16-31
+        __m256i in0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src))),      _mm_loadu_si128((const __m128i*)(src + 48)), 1);
+        __m256i in1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + 16))), _mm_loadu_si128((const __m128i*)(src + 64)), 1);
+        __m256i in2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + 32))), _mm_loadu_si128((const __m128i*)(src + 80)), 1);
+
+        __m256i out0 = _mm256_or_si256(_mm256_shuffle_epi8(in0, m00), _mm256_shuffle_epi8(in1, m01));
+        __m256i out1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(in0, m10), _mm256_shuffle_epi8(in1, m11)), _mm256_shuffle_epi8(in2, m12));
+        __m256i out2 = _mm256_or_si256(_mm256_shuffle_epi8(in1, m21), _mm256_shuffle_epi8(in2, m22));
+
+        _mm_storeu_si128((__m128i*)(dst),      _mm256_castsi256_si128(out0));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm256_castsi256_si128(out1));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm256_castsi256_si128(out2));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm256_extracti128_si256(out0, 1));
+        _mm_storeu_si128((__m128i*)(dst + 64), _mm256_extracti128_si256(out1, 1));
+        _mm_storeu_si128((__m128i*)(dst + 80), _mm256_extracti128_si256(out2, 1));
+
+        src += 96;
+        dst += 96;
+    }
+
+    SwizzleBGRToRGB_SSSE3(dst, src, n - i);
+}
+
+GLSH_TARGET_AVX2
+static void SwizzleBGRAToRGBA_AVX2(unsigned char* dst, const unsigned char* src, size_t n)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    size_t i = 0;
+    for ( ; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)src);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_shuffle_epi8(v, mask));
+        src += 32;
+        dst += 32;
+    }
+
+    SwizzleBGRAToRGBA_Scalar(dst, src, n - i);
+}
+
+GLSH_TARGET_AVX2
+static void ExpandRGBToRGBA_AVX2(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    const __m256i mask = _mm256_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128,
+                                          0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+    const __m256i a = _mm256_set1_epi32((int)((unsigned)alpha << 24));
+
+    // each lane loads 16 bytes but only uses 12, so stop while the over-read is still in bounds
+    size_t i = 0;
+    for ( ; i + 10 <= n; i += 8) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src))), _mm_loadu_si128((const __m128i*)(src + 12)), 1);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(_mm256_shuffle_epi8(v, mask), a));
+        src += 24;
+        dst += 32;
+    }
+
+    ExpandRGBToRGBA_Scalar(dst, src, n - i, alpha);
+}
+
+GLSH_TARGET_AVX2
+static void ExpandGrayToRGBA_AVX2(unsigned char* dst, const unsigned char* src, size_t n, unsigned char alpha)
+{
+    const __m256i mask = _mm256_setr_epi8(0, 0, 0, -128, 4, 4, 4, -128, 8, 8, 8, -128, 12, 12, 12, -128,
+                                          0, 0, 0, -128, 4, 4, 4, -128, 8, 8, 8, -128, 12, 12, 12, -128);
+    const __m256i a = _mm256_set1_epi32((int)((unsigned)alpha << 24));
+
+    size_t i = 0;
+    for ( ; i + 16 <= n; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i*)src);
+
+        // widen each gray byte to its own 32-bit slot, then replicate it into r, g, and b
+        __m256i lo = _mm256_cvtepu8_epi32(g);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(g, 8));
+
+        _mm256_storeu_si256((__m256i*)(dst),      _mm256_or_si256(_mm256_shuffle_epi8(lo, mask), a));
+        _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_or_si256(_mm256_shuffle_epi8(hi, mask), a));
+
+        src += 16;
+        dst += 64;
+    }
+
+    ExpandGrayToRGBA_Scalar(dst, src, n - i, alpha);
+}
+
+#endif  // GLSH_X86
+
+//
+// Runtime dispatch
+//
+
+struct PixelKernels {
+    void        (*bgrToRgb)(unsigned char*, const unsigned char*, size_t);
+    void        (*bgraToRgba)(unsigned char*, const unsigned char*, size_t);
+    void        (*rgbToRgba)(unsigned char*, const unsigned char*, size_t, unsigned char);
+    void        (*grayToRgba)(unsigned char*, const unsigned char*, size_t, unsigned char);
+    void        (*downsample2x2)(unsigned char*, const unsigned char*, const unsigned char*, size_t, int);
+    const char* name;
+};
+
+static PixelKernels SelectPixelKernels(const CpuFeatures& cpu)
+{
+    PixelKernels k;
+    k.bgrToRgb = SwizzleBGRToRGB_Scalar;
+    k.bgraToRgba = SwizzleBGRAToRGBA_Scalar;
+    k.rgbToRgba = ExpandRGBToRGBA_Scalar;
+    k.grayToRgba = ExpandGrayToRGBA_Scalar;
+    k.downsample2x2 = DownsampleRow2x2_Scalar;
+    k.name = "scalar";
+
+#if GLSH_X86
+    if (cpu.avx2) {
+        k.bgrToRgb = SwizzleBGRToRGB_AVX2;
+        k.bgraToRgba = SwizzleBGRAToRGBA_AVX2;
+        k.rgbToRgba = ExpandRGBToRGBA_AVX2;
+        k.grayToRgba = ExpandGrayToRGBA_AVX2;
+        k.downsample2x2 = DownsampleRow2x2_SSSE3;   // memory bound already, wider registers don't help
+        k.name = "AVX2";
+    } else if (cpu.ssse3) {
+        k.bgrToRgb = SwizzleBGRToRGB_SSSE3;
+        k.bgraToRgba = SwizzleBGRAToRGBA_SSSE3;
+        k.rgbToRgba = ExpandRGBToRGBA_SSSE3;
+        k.grayToRgba = ExpandGrayToRGBA_SSSE3;
+        k.downsample2x2 = DownsampleRow2x2_SSSE3;
+        k.name = "SSSE3";
+    }
+#endif
+
+    return k;
+}
+
+// initialized during static initialization, before any loader threads can exist
+static const CpuFeatures g_cpuFeatures = DetectCpuFeatures();
+static const PixelKernels g_pixelKernels = SelectPixelKernels(g_cpuFeatures);
+
+const CpuFeatures& GetCpuFeatures()
+{
+    return g_cpuFeatures;
+}
+
+void SwizzleBGRToRGB(unsigned char* dst, const unsigned char* src, size_t numPixels)
+{
+    g_pixelKernels.bgrToRgb(dst, src, numPixels);
+}
+
+void SwizzleBGRAToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels)
+{
+    g_pixelKernels.bgraToRgba(dst, src, numPixels);
+}
+
+void ExpandRGBToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels, unsigned char alpha)
+{
+    g_pixelKernels.rgbToRgba(dst, src, numPixels, alpha);
+}
+
+void ExpandGrayToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels, unsigned char alpha)
+{
+    g_pixelKernels.grayToRgba(dst, src, numPixels, alpha);
+}
+
+void DownsampleRow2x2(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t dstWidth, int bytesPerPixel)
+{
+    g_pixelKernels.downsample2x2(dst, row0, row1, dstWidth, bytesPerPixel);
+}
+
+const char* GetPixelKernelName()
+{
+    return g_pixelKernels.name;
+}
+
+} // end of namespace
@@ -0,0 +1,51 @@
+#ifndef GLSH_PIXELOPS_H_
+#define GLSH_PIXELOPS_H_
+
+#include <cstddef>
+
+namespace glsh {
+
+//
+// CPU features relevant to the pixel kernels, detected once at startup.
+//
+struct CpuFeatures {
+    bool    sse2;
+    bool    ssse3;
+    bool    avx2;       // only set if the OS also saves the YMM registers
+};
+
+const CpuFeatures& GetCpuFeatures();
+
+//
+// Pixel swizzle and format conversion kernels.
+//
+// Each kernel has a scalar, SSSE3, and AVX2 implementation; the fastest one supported
+// by the CPU is picked once at startup.  Pointers don't need to be aligned.
+// The swizzles may work in place (dst == src), the expansions may not.
+//
+
+// BGR -> RGB (3 bytes per pixel)
+void SwizzleBGRToRGB(unsigned char* dst, const unsigned char* src, size_t numPixels);
+
+// BGRA -> RGBA (4 bytes per pixel)
+void SwizzleBGRAToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels);
+
+// RGB -> RGBA, using a constant alpha
+void ExpandRGBToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels, unsigned char alpha = 255);
+
+// gray -> RGBA (g, g, g, alpha)
+void ExpandGrayToRGBA(unsigned char* dst, const unsigned char* src, size_t numPixels, unsigned char alpha = 255);
+
+//
+// 2x2 box filter for mipmapping: each output pixel is the rounded average of a 2x2 block,
+// taken from pixels 2i and 2i+1 of row0 and row1 (which may be the same row).
+// Both rows must hold at least 2 * dstWidth pixels.  Any pixel size works; 1, 3, and 4 bytes are vectorized.
+//
+void DownsampleRow2x2(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, size_t dstWidth, int bytesPerPixel);
+
+// name of the instruction set the kernels ended up using ("AVX2", "SSSE3", or "scalar")
+const char* GetPixelKernelName();
+
+} // end of namespace
+
+#endif
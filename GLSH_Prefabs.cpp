@@ -304,6 +304,54 @@ Mesh* CreateSolidPlane(float xSize, float zSize, int xSegments, int zSegments, c
     return CreateMesh(GL_TRIANGLES, vertexData, indexData);
 }
 
+Mesh* CreateTiledPlane(float xSize, float zSize, int xTiles, int zTiles, const std::vector<int>& layers, const glm::mat4& transform)
+{
+    // sanity check
+    if (xTiles < 1 || zTiles < 1 || layers.empty()) {
+        return NULL;
+    }
+
+    // the tiles don't share vertices, since neighbours can be on different layers
+    std::vector<VertexPositionTextureLayer> vertexData;
+    std::vector<unsigned> indexData;
+    vertexData.reserve(4 * xTiles * zTiles);
+    indexData.reserve(6 * xTiles * zTiles);
+
+    float xStep = xSize / xTiles;
+    float zStep = zSize / zTiles;
+
+    for (int j = 0; j < zTiles; j++) {
+        float z1 = -0.5f * zSize + j * zStep;
+        float z2 = z1 + zStep;
+        for (int i = 0; i < xTiles; i++) {
+            float x1 = -0.5f * xSize + i * xStep;
+            float x2 = x1 + xStep;
+            int layer = layers[(j * xTiles + i) % layers.size()];
+
+            // the four corners of this tile, textured as seen from above
+            unsigned e = (unsigned)vertexData.size();
+            vertexData.push_back(VPTL(x1, 0, z2,  0, 0,  layer));
+            vertexData.push_back(VPTL(x2, 0, z2,  1, 0,  layer));
+            vertexData.push_back(VPTL(x1, 0, z1,  0, 1,  layer));
+            vertexData.push_back(VPTL(x2, 0, z1,  1, 1,  layer));
+
+            // triangle 1
+            indexData.push_back(e);
+            indexData.push_back(e + 1);
+            indexData.push_back(e + 3);
+            // triangle 2
+            indexData.push_back(e);
+            indexData.push_back(e + 3);
+            indexData.push_back(e + 2);
+        }
+    }
+
+    // transform the vertices using the user-supplied transformation matrix
+    TransformPositions(vertexData, transform);
+
+    return CreateMesh(GL_TRIANGLES, vertexData, indexData);
+}
+
 
 Mesh* CreateHalfAxes(float length, const glm::mat4& transform)
 {
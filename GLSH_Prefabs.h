@@ -22,6 +22,11 @@ Mesh* CreateChunkyCone      (float radius, float height, int numSegments, const
 Mesh* CreateWireframePlane  (float xSize, float zSize, int xSegments, int zSegments, const glm::mat4& transform = glm::mat4(1.0f));
 Mesh* CreateSolidPlane      (float xSize, float zSize, int xSegments, int zSegments, const glm::mat4& transform = glm::mat4(1.0f));
 
+// a plane of xTiles x zTiles textured quads, tile (i, j) showing texture array layer layers[j * xTiles + i],
+// with the list repeating if it's shorter than that; use with a TextureArray and VertexPositionTextureLayer shaders
+Mesh* CreateTiledPlane      (float xSize, float zSize, int xTiles, int zTiles, const std::vector<int>& layers,
+                             const glm::mat4& transform = glm::mat4(1.0f));
+
 Mesh* CreateHalfAxes        (float length = 1.0f, const glm::mat4& transform = glm::mat4(1.0f));
 Mesh* CreateFullAxes        (float length = 1.0f, const glm::mat4& transform = glm::mat4(1.0f));
 
@@ -0,0 +1,76 @@
+#include "GLSH_SamplerCache.h"
+
+namespace glsh {
+
+bool SamplerState::operator< (const SamplerState& other) const
+{
+    if (minFilter != other.minFilter) {
+        return minFilter < other.minFilter;
+    }
+    if (magFilter != other.magFilter) {
+        return magFilter < other.magFilter;
+    }
+    if (wrapS != other.wrapS) {
+        return wrapS < other.wrapS;
+    }
+    if (wrapT != other.wrapT) {
+        return wrapT < other.wrapT;
+    }
+    return anisotropy < other.anisotropy;
+}
+
+SamplerCache::SamplerCache()
+    : mMaxAnisotropy(0)
+{
+}
+
+SamplerCache::~SamplerCache()
+{
+    Clear();
+}
+
+float SamplerCache::getMaxAnisotropy()
+{
+    if (mMaxAnisotropy == 0) {
+        mMaxAnisotropy = 1.0f;
+        if (GLEW_EXT_texture_filter_anisotropic) {
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &mMaxAnisotropy);
+        }
+    }
+    return mMaxAnisotropy;
+}
+
+GLuint SamplerCache::GetSampler(const SamplerState& state)
+{
+    std::map<SamplerState, GLuint>::iterator it = mSamplers.find(state);
+    if (it != mSamplers.end()) {
+        return it->second;
+    }
+
+    GLuint sampler = 0;
+    glGenSamplers(1, &sampler);
+
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrapS);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrapT);
+
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        float anisotropy = state.anisotropy < getMaxAnisotropy() ? state.anisotropy : getMaxAnisotropy();
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy > 1.0f ? anisotropy : 1.0f);
+    }
+
+    mSamplers[state] = sampler;
+    return sampler;
+}
+
+void SamplerCache::Clear()
+{
+    std::map<SamplerState, GLuint>::iterator it = mSamplers.begin();
+    for (; it != mSamplers.end(); ++it) {
+        glDeleteSamplers(1, &it->second);
+    }
+    mSamplers.clear();
+}
+
+} // end of namespace
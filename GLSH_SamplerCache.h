@@ -0,0 +1,73 @@
+#ifndef GLSH_SAMPLERCACHE_H_
+#define GLSH_SAMPLERCACHE_H_
+
+#include <GL/glew.h>
+
+#include <map>
+
+namespace glsh {
+
+//
+// Everything a sampler object is set up with.  The defaults match a fresh sampler object.
+//
+struct SamplerState {
+    GLenum          minFilter;
+    GLenum          magFilter;
+    GLenum          wrapS, wrapT;
+    float           anisotropy;     // 1 for none
+
+    SamplerState()
+        : minFilter(GL_NEAREST_MIPMAP_LINEAR)
+        , magFilter(GL_LINEAR)
+        , wrapS(GL_REPEAT)
+        , wrapT(GL_REPEAT)
+        , anisotropy(1.0f)
+    { }
+
+    SamplerState(GLenum minFilter, GLenum magFilter, GLenum wrap, float anisotropy = 1.0f)
+        : minFilter(minFilter)
+        , magFilter(magFilter)
+        , wrapS(wrap)
+        , wrapT(wrap)
+        , anisotropy(anisotropy)
+    { }
+
+    bool operator< (const SamplerState& other) const;
+};
+
+//
+// One sampler object per distinct SamplerState, set up when it's first asked for and never changed
+// after that.  Get the samplers you'll switch between up front (at load time, say), and keep the ids:
+// switching filters is then a glBindSampler, with no sampler state changing while frames are drawn.
+//
+// Anisotropy is clamped to what the driver supports, and ignored without EXT_texture_filter_anisotropic.
+// Clear (or destroy) the cache while the GL context is still around, it deletes its samplers.
+//
+class SamplerCache {
+    std::map<SamplerState, GLuint>  mSamplers;
+    float                           mMaxAnisotropy;     // 0 until the first sampler is created
+
+public:
+                                    SamplerCache();
+                                    ~SamplerCache();
+
+    // the sampler for a state, created the first time
+    GLuint                          GetSampler(const SamplerState& state);
+
+    // delete all the samplers; ids handed out before are no good after this
+    void                            Clear();
+
+    unsigned                        numSamplers() const     { return (unsigned)mSamplers.size(); }
+
+    // the highest anisotropy the driver supports, 1 if it has no anisotropic filtering
+    float                           getMaxAnisotropy();
+
+private:
+                                    // noncopyable
+                                    SamplerCache(const SamplerCache&);
+                                    SamplerCache& operator= (const SamplerCache&);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,170 @@
+#include "GLSH_StaticBatch.h"
+
+#include <iostream>
+
+namespace glsh {
+
+// primitives that can be drawn back to back in one call without joining up
+static bool IsListMode(GLenum drawingMode)
+{
+    switch (drawingMode) {
+    case GL_POINTS:
+    case GL_LINES:
+    case GL_TRIANGLES:
+    case GL_LINES_ADJACENCY:
+    case GL_TRIANGLES_ADJACENCY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+StaticBatch::StaticBatch(GLuint vbo, GLuint vao, GLenum drawingMode, unsigned material,
+                         const std::vector<GLint>& firsts, const std::vector<GLsizei>& counts)
+    : Mesh(vao, drawingMode)
+    , mVBO(vbo)
+    , mMaterial(material)
+    , mVertexCount(0)
+    , mFirsts(firsts)
+    , mCounts(counts)
+{
+    for (unsigned i = 0; i < mCounts.size(); i++) {
+        mVertexCount += mCounts[i];
+    }
+}
+
+StaticBatch::~StaticBatch()
+{
+    if (mVBO) {
+        glDeleteBuffers(1, &mVBO);
+    }
+}
+
+void StaticBatch::drawImpl() const
+{
+    if (mCounts.empty()) {
+        return;
+    }
+
+    if (IsListMode(mDrawingMode)) {
+        // the ranges are back to back, so they are one range as far as a list is concerned
+        glDrawArrays(mDrawingMode, 0, mVertexCount);
+    } else {
+        glMultiDrawArrays(mDrawingMode, &mFirsts[0], &mCounts[0], (GLsizei)mCounts.size());
+    }
+}
+
+void StaticBatch::drawInstancedImpl(GLsizei numInstances) const
+{
+    if (mCounts.empty()) {
+        return;
+    }
+
+    if (IsListMode(mDrawingMode)) {
+        glDrawArraysInstanced(mDrawingMode, 0, mVertexCount, numInstances);
+    } else {
+        // there's no instanced multi-draw without indirect buffers, so it's a call per range
+        for (unsigned i = 0; i < mCounts.size(); i++) {
+            glDrawArraysInstanced(mDrawingMode, mFirsts[i], mCounts[i], numInstances);
+        }
+    }
+}
+
+void StaticBatch::drawRange(unsigned i) const
+{
+    glBindVertexArray(mVAO);
+
+    glDrawArrays(mDrawingMode, mFirsts[i], mCounts[i]);
+
+    glBindVertexArray(0);
+}
+
+void StaticBatchBuilder::Add(GLenum drawingMode, const void* vertices, unsigned numVertices,
+                             const VertexFormat& vertexFormat, unsigned material)
+{
+    if (numVertices == 0) {
+        return;
+    }
+
+    Group* group = NULL;
+    for (unsigned i = 0; i < mGroups.size(); i++) {
+        Group& g = mGroups[i];
+        if (g.format == &vertexFormat && g.drawingMode == drawingMode && g.material == material) {
+            group = &g;
+            break;
+        }
+    }
+
+    if (!group) {
+        mGroups.push_back(Group());
+        group = &mGroups.back();
+        group->format = &vertexFormat;
+        group->drawingMode = drawingMode;
+        group->material = material;
+    }
+
+    size_t vertexSize = vertexFormat.getVertexSizeInBytes();
+    size_t offset = group->vertices.size();
+
+    group->firsts.push_back((GLint)(offset / vertexSize));
+    group->counts.push_back((GLsizei)numVertices);
+
+    const unsigned char* src = (const unsigned char*)vertices;
+    group->vertices.insert(group->vertices.end(), src, src + vertexSize * numVertices);
+}
+
+bool StaticBatchBuilder::Build(std::vector<StaticBatch*>& batches)
+{
+    bool ok = true;
+
+    for (unsigned i = 0; i < mGroups.size(); i++) {
+        const Group& g = mGroups[i];
+        const VertexFormat& vertexFormat = *g.format;
+
+        GLuint vao = 0;
+        glGenVertexArrays(1, &vao);
+        if (!vao) {
+            std::cerr << "*** Failed to create VAO for static batch" << std::endl;
+            ok = false;
+            continue;
+        }
+        glBindVertexArray(vao);
+
+        GLuint vbo = 0;
+        glGenBuffers(1, &vbo);
+        if (!vbo) {
+            std::cerr << "*** Failed to create VBO for static batch" << std::endl;
+            glBindVertexArray(0);
+            glDeleteVertexArrays(1, &vao);
+            ok = false;
+            continue;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, g.vertices.size(), &g.vertices[0], GL_STATIC_DRAW);
+
+        for (unsigned j = 0; j < vertexFormat.numAttribs(); j++) {
+            const VertexAttrib& a = vertexFormat.getAttrib(j);
+            glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
+            glEnableVertexAttribArray(a.index);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+            std::cerr << "*** GL error creating static batch: " << gluErrorString(err) << std::endl;
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vbo);
+            ok = false;
+            continue;
+        }
+
+        batches.push_back(new StaticBatch(vbo, vao, g.drawingMode, g.material, g.firsts, g.counts));
+    }
+
+    mGroups.clear();
+    return ok;
+}
+
+} // end of namespace
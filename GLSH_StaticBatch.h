@@ -0,0 +1,90 @@
+#ifndef GLSH_STATICBATCH_H_
+#define GLSH_STATICBATCH_H_
+
+#include "GLSH_Mesh.h"
+
+#include <vector>
+
+namespace glsh {
+
+//
+// Many small static meshes merged into one VBO and VAO, each kept as a range of vertices.
+// Lists (GL_POINTS, GL_LINES, GL_TRIANGLES) are drawn with a single glDrawArrays over the whole buffer;
+// strips, fans and loops can't just be run together, so they are drawn with a single glMultiDrawArrays
+// over the ranges.  Either way it's one VAO bind and one draw call, however many meshes went in.
+//
+// Build them with StaticBatchBuilder.
+//
+class StaticBatch : public Mesh {
+    GLuint                  mVBO;
+    unsigned                mMaterial;      // whatever the builder was given, the batch doesn't use it
+    GLsizei                 mVertexCount;   // in all ranges
+    std::vector<GLint>      mFirsts;        // first vertex of each range
+    std::vector<GLsizei>    mCounts;        // number of vertices in each range
+
+public:
+    // NOTE: batch takes ownership of VBO and VAO
+    StaticBatch(GLuint vbo, GLuint vao, GLenum drawingMode, unsigned material,
+                const std::vector<GLint>& firsts, const std::vector<GLsizei>& counts);
+
+    virtual ~StaticBatch() override;
+
+    unsigned                getMaterial() const             { return mMaterial; }
+    GLenum                  getDrawingMode() const          { return mDrawingMode; }
+    GLsizei                 getVertexCount() const          { return mVertexCount; }
+
+    // one range per mesh added, in the order they were added
+    unsigned                numRanges() const               { return (unsigned)mCounts.size(); }
+    GLint                   getRangeFirst(unsigned i) const { return mFirsts[i]; }
+    GLsizei                 getRangeCount(unsigned i) const { return mCounts[i]; }
+
+    // draw a single range, for when the others are culled
+    void                    drawRange(unsigned i) const;
+
+protected:
+    virtual void            drawImpl() const override;
+    virtual void            drawInstancedImpl(GLsizei numInstances) const override;
+};
+
+
+//
+// Collects static geometry and merges it into StaticBatches, one for each vertex format, drawing mode and
+// material.  Formats are told apart by address, so use the ones from the vertex types' GetFormat.  The
+// material is any number the caller wants to group by, such as a texture id; the batch hands it back from
+// getMaterial so the caller can bind whatever it stands for before drawing.
+//
+class StaticBatchBuilder {
+    struct Group {
+        const VertexFormat*         format;
+        GLenum                      drawingMode;
+        unsigned                    material;
+        std::vector<unsigned char>  vertices;
+        std::vector<GLint>          firsts;
+        std::vector<GLsizei>        counts;
+    };
+
+    std::vector<Group>              mGroups;        // in the order they were first added to
+
+public:
+    void                            Add(GLenum drawingMode, const void* vertices, unsigned numVertices,
+                                        const VertexFormat& vertexFormat, unsigned material = 0);
+
+    template <typename VertexType>
+    void                            Add(GLenum drawingMode, const std::vector<VertexType>& vertices, unsigned material = 0)
+    {
+        if (!vertices.empty()) {
+            Add(drawingMode, &vertices[0], (unsigned)vertices.size(), VertexType::GetFormat(), material);
+        }
+    }
+
+    // upload every group and append its batch to batches; the builder is empty afterwards
+    bool                            Build(std::vector<StaticBatch*>& batches);
+
+    void                            Clear()             { mGroups.clear(); }
+
+    unsigned                        numGroups() const   { return (unsigned)mGroups.size(); }
+};
+
+} // end of namespace
+
+#endif
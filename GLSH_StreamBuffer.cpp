@@ -0,0 +1,261 @@
+#include "GLSH_StreamBuffer.h"
+
+#include <iostream>
+
+namespace glsh {
+
+// how long Map waits for the GPU to finish with a range before giving up and overwriting it anyway
+static const GLuint64 s_fenceTimeout = 1000000000;   // 1 second, in nanoseconds
+
+StreamBuffer::StreamBuffer(size_t size)
+    : mSize(size)
+    , mBuffer(0)
+    , mMapped(NULL)
+    , mCreated(false)
+    , mHead(0)
+    , mRetired(0)
+    , mFirstFence(0)
+    , mNumFences(0)
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    Release();
+}
+
+bool StreamBuffer::Create()
+{
+    glGenBuffers(1, &mBuffer);
+    if (!mBuffer) {
+        std::cerr << "*** Failed to create stream buffer" << std::endl;
+        return false;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, mSize, NULL, flags);
+        mMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mSize, flags);
+
+        if (!mMapped) {
+            // storage is immutable, so start over with a buffer that glBufferData can orphan
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &mBuffer);
+            glGenBuffers(1, &mBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        }
+    }
+
+    if (!mMapped) {
+        glBufferData(GL_COPY_WRITE_BUFFER, mSize, NULL, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    mHead = 0;
+    mRetired = 0;
+    mCreated = true;
+    return true;
+}
+
+void StreamBuffer::Release()
+{
+    while (mNumFences > 0) {
+        glDeleteSync(mFences[mFirstFence].sync);
+        mFirstFence = (mFirstFence + 1) % MaxFences;
+        --mNumFences;
+    }
+    mFirstFence = 0;
+
+    for (std::map<const VertexFormat*, GLuint>::iterator it = mVAOs.begin(); it != mVAOs.end(); ++it) {
+        glDeleteVertexArrays(1, &it->second);
+    }
+    mVAOs.clear();
+
+    // deleting the buffer unmaps it
+    if (mBuffer) {
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+    }
+    mMapped = NULL;
+    mCreated = false;
+}
+
+void StreamBuffer::WaitForOldestFence()
+{
+    PendingFence& fence = mFences[mFirstFence];
+
+    GLenum result = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, s_fenceTimeout);
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        std::cerr << "*** Stream buffer range still in use after waiting, overwriting it" << std::endl;
+    }
+    glDeleteSync(fence.sync);
+
+    mRetired = fence.end;
+    mFirstFence = (mFirstFence + 1) % MaxFences;
+    --mNumFences;
+}
+
+void* StreamBuffer::Map(size_t size, size_t alignment, size_t& offset)
+{
+    if (size == 0 || size > mSize) {
+        std::cerr << "*** Can't stream " << size << " bytes through a " << mSize << " byte stream buffer" << std::endl;
+        return NULL;
+    }
+
+    if (!mCreated && !Create()) {
+        return NULL;
+    }
+
+    if (alignment == 0) {
+        alignment = 1;
+    }
+
+    size_t ringOffset = (size_t)(mHead % mSize);
+    size_t start = (ringOffset + alignment - 1) / alignment * alignment;
+    bool wrapped = start + size > mSize;
+    if (wrapped) {
+        // the rest of the ring is too short, skip it and start over at the beginning
+        mHead += mSize - ringOffset;
+        start = 0;
+    } else {
+        mHead += start - ringOffset;
+    }
+
+    GLuint64 end = mHead + size;
+    offset = start;
+
+    if (mMapped) {
+        // the range last held what was written a ring ago; wait until the GPU has read all of that
+        if (end > mSize) {
+            GLuint64 needed = end - mSize;
+            if (mRetired < needed && (mNumFences == 0 || mFences[(mFirstFence + mNumFences - 1) % MaxFences].end < needed)) {
+                // the caller hasn't fenced what's there yet, so do it now
+                Fence();
+            }
+            while (mRetired < needed && mNumFences > 0) {
+                WaitForOldestFence();
+            }
+        }
+
+        mHead = end;
+        return mMapped + start;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+    if (wrapped) {
+        // orphan the old storage, the GPU keeps it until it's done drawing from it
+        glBufferData(GL_COPY_WRITE_BUFFER, mSize, NULL, GL_STREAM_DRAW);
+    }
+
+    // nothing drawn since the last orphaning reads this range, so there's nothing to wait for
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    void* ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, size, access);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!ptr) {
+        std::cerr << "*** Failed to map stream buffer range" << std::endl;
+        return NULL;
+    }
+
+    mHead = end;
+    return ptr;
+}
+
+void StreamBuffer::Unmap()
+{
+    if (mMapped || !mBuffer) {
+        // the mapping is coherent, so the writes are already visible
+        return;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    if (!glUnmapBuffer(GL_COPY_WRITE_BUFFER)) {
+        std::cerr << "*** Stream buffer contents were lost while mapped" << std::endl;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::Fence()
+{
+    // orphaning takes care of the fallback path
+    if (!mMapped) {
+        return;
+    }
+
+    if (mNumFences > 0) {
+        PendingFence& newest = mFences[(mFirstFence + mNumFences - 1) % MaxFences];
+        if (newest.end == mHead) {
+            return;     // nothing new to cover
+        }
+
+        if (mNumFences == MaxFences) {
+            // a later fence covers the earlier ones, so replace the newest rather than stall
+            glDeleteSync(newest.sync);
+            newest.end = mHead;
+            newest.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            return;
+        }
+    }
+
+    PendingFence& fence = mFences[(mFirstFence + mNumFences) % MaxFences];
+    fence.end = mHead;
+    fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++mNumFences;
+}
+
+GLuint StreamBuffer::GetVAO(const VertexFormat& vertexFormat)
+{
+    std::map<const VertexFormat*, GLuint>::iterator it = mVAOs.find(&vertexFormat);
+    if (it != mVAOs.end()) {
+        return it->second;
+    }
+
+    if (!mCreated && !Create()) {
+        return 0;
+    }
+
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    if (!vao) {
+        std::cerr << "*** Failed to create VAO for stream buffer" << std::endl;
+        return 0;
+    }
+
+    // orphaning keeps the buffer name, so the VAO stays good for the life of the buffer
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    for (unsigned i = 0; i < vertexFormat.numAttribs(); i++) {
+        const VertexAttrib& a = vertexFormat.getAttrib(i);
+        glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, a.offset);
+        glEnableVertexAttribArray(a.index);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mVAOs[&vertexFormat] = vao;
+    return vao;
+}
+
+static StreamBuffer* s_sharedStreamBuffer = NULL;
+
+StreamBuffer& GetSharedStreamBuffer()
+{
+    if (!s_sharedStreamBuffer) {
+        s_sharedStreamBuffer = new StreamBuffer();
+    }
+    return *s_sharedStreamBuffer;
+}
+
+void ReleaseSharedStreamBuffer()
+{
+    if (s_sharedStreamBuffer) {
+        s_sharedStreamBuffer->Release();
+    }
+}
+
+} // end of namespace
@@ -0,0 +1,91 @@
+#ifndef GLSH_STREAMBUFFER_H_
+#define GLSH_STREAMBUFFER_H_
+
+#include <GL/glew.h>
+
+#include <map>
+
+#include "GLSH_Vertex.h"
+
+namespace glsh {
+
+//
+// A ring of buffer memory for data that's written once and drawn right away, like DrawGeometry's vertices.
+// Map hands out the next free range of the ring, and the data is drawn from the offset it returns.
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently and coherently, so Map is just
+// pointer arithmetic.  Call Fence after the draws that read what was mapped: when the ring comes back around,
+// Map waits on the fences covering the range it's about to hand out, so nothing the GPU is still reading
+// gets overwritten.  Without buffer storage each Map maps the range unsynchronized, and when the ring wraps
+// the buffer is orphaned instead, so the GPU keeps the old storage for as long as it needs it.
+//
+// The buffer and VAOs are created on first use.  Release (or destroy) it while the GL context is still around.
+//
+class StreamBuffer {
+public:
+    static const unsigned   MaxFences = 64;
+
+private:
+    struct PendingFence {
+        GLuint64            end;            // everything written before this is covered
+        GLsync              sync;
+    };
+
+    size_t                  mSize;
+    GLuint                  mBuffer;
+    unsigned char*          mMapped;        // the whole persistent mapping, or NULL if there isn't one
+    bool                    mCreated;
+
+    GLuint64                mHead;          // bytes handed out since creation; the ring offset is mHead % mSize
+    GLuint64                mRetired;       // everything written before this the GPU is done with
+
+    PendingFence            mFences[MaxFences];     // oldest first, starting at mFirstFence
+    unsigned                mFirstFence;
+    unsigned                mNumFences;
+
+    std::map<const VertexFormat*, GLuint>   mVAOs;
+
+public:
+    explicit                StreamBuffer(size_t size = 4 * 1024 * 1024);
+                            ~StreamBuffer();
+
+    // room for size bytes starting at a multiple of alignment (which needn't be a power of 2), and the offset
+    // into the buffer it's at; NULL if the ring is too small for it or the buffer can't be created
+    void*                   Map(size_t size, size_t alignment, size_t& offset);
+
+    // done writing what Map handed out
+    void                    Unmap();
+
+    // call after the draws that read what was mapped so far
+    void                    Fence();
+
+    // a VAO that reads vertexFormat from the start of the buffer: draw with first = offset / vertex size.
+    // Formats are told apart by address, so use the ones from the vertex types' GetFormat
+    GLuint                  GetVAO(const VertexFormat& vertexFormat);
+
+    // delete the buffer and VAOs; they are created again if it's used again
+    void                    Release();
+
+    GLuint                  getBuffer() const               { return mBuffer; }
+    size_t                  getSize() const                 { return mSize; }
+    bool                    isPersistentlyMapped() const    { return mMapped != NULL; }
+
+private:
+    bool                    Create();
+    void                    WaitForOldestFence();
+
+                            // noncopyable
+                            StreamBuffer(const StreamBuffer&);
+                            StreamBuffer& operator= (const StreamBuffer&);
+};
+
+//
+// The stream buffer DrawGeometry uses.  It belongs to whichever GL context first draws with it;
+// System releases it when a window closes, while that window's context is still current.
+//
+StreamBuffer& GetSharedStreamBuffer();
+void ReleaseSharedStreamBuffer();
+
+} // end of namespace
+
+#endif
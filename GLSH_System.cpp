@@ -1,4 +1,5 @@
 #include "GLSH_System.h"
+#include "GLSH_StreamBuffer.h"
 
 #include <iostream>
 #include <fstream>
@@ -602,6 +603,9 @@ void System::WindowCloseCallback()
         std::cerr << "*** Exception\n" << e.what() << "\n*** End of Exception" << std::endl;
     }
 
+    // the window's context is still current, so its stream buffer can go with it
+    ReleaseSharedStreamBuffer();
+
     delete wnd;
 }
 
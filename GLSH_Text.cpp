@@ -344,9 +344,8 @@ void TextBatch::SetText(const Font* font, const std::vector<std::string>& textLi
 
 void TextBatch::DrawGeometry() const
 {
+    // streamed through the shared stream buffer; text changes often enough that a retained mesh wouldn't pay
     ::glsh::DrawGeometry(GL_TRIANGLES, mVerts);
-
-    // FUTURE: could implement a retained mode
 }
 
 
@@ -1,29 +1,362 @@
 #include "GLSH_Texture.h"
 #include "GLSH_Image.h"
+#include "GLSH_PixelOps.h"
+#include "GLSH_TextureCompression.h"
+#include "GLSH_TextureFile.h"
 #include "GLSH_Util.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cstring>
 
 namespace glsh {
 
-GLuint CreateTexture2D(const std::string& path, bool genMipmaps)
+GLuint CreateTexture2D(const std::string& path, bool genMipmaps, bool compress)
 {
+    if (GetFileExtension(path) == ".gtex") {
+        TextureFile tf;
+        if (tf.Open(path)) {
+            return CreateTexture2D(tf);
+        } else {
+            std::cerr << "*** Failed to load texture from " << path << std::endl;
+            return 0;
+        }
+    }
+
     Image img;
-    if (img.LoadTarga(path)) {
-        return CreateTexture2D(img, genMipmaps);
+    if (img.Load(path)) {
+        return CreateTexture2D(img, genMipmaps, compress);
     } else {
         std::cerr << "*** Failed to load texture from " << path << std::endl;
         return 0;
     }
 }
 
-GLuint CreateTexture2D(const Image& img, bool genMipmaps)
+static bool IsCompressedFormatSupported(CompressedFormat fmt)
+{
+    switch (fmt) {
+    case COMPRESSED_BC1:
+    case COMPRESSED_BC3:
+        return GLEW_EXT_texture_compression_s3tc != 0;
+    case COMPRESSED_BC4:
+    case COMPRESSED_BC5:
+        // the one and two channel formats need swizzles to stand in for luminance (alpha)
+        return (GLEW_ARB_texture_compression_rgtc || GLEW_VERSION_3_0) && (GLEW_ARB_texture_swizzle || GLEW_VERSION_3_3);
+    default:
+        return false;
+    }
+}
+
+static GLenum GetCompressedInternalFormat(CompressedFormat fmt)
+{
+    switch (fmt) {
+    case COMPRESSED_BC1:    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case COMPRESSED_BC3:    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case COMPRESSED_BC4:    return GL_COMPRESSED_RED_RGTC1;
+    case COMPRESSED_BC5:    return GL_COMPRESSED_RG_RGTC2;
+    default:                return GL_NONE;
+    }
+}
+
+// make red (and green) read back the way luminance (and alpha) used to, on the bound texture
+static void SetLuminanceSwizzle(bool withAlpha)
+{
+    GLint swizzle[] = { GL_RED, GL_RED, GL_RED, withAlpha ? GL_GREEN : GL_ONE };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+//
+// Compress the image and upload all of its levels.  Returns 0 if the format isn't supported,
+// so the caller can fall back to an uncompressed texture.
+//
+static GLuint CreateCompressedTexture2D(const Image& img, bool genMipmaps)
+{
+    CompressedFormat fmt = ChooseCompressedFormat(img.getBytesPerPixel());
+    if (!IsCompressedFormatSupported(fmt)) {
+        return 0;
+    }
+
+    // compressed textures can't use glGenerateMipmap, so build the chain on the CPU,
+    // but only when the image has none; otherwise encode straight from the caller's levels
+    const Image* src = &img;
+    Image mipmapped;
+    if (genMipmaps && img.numMipmaps() == 1 && (img.getWidth() > 1 || img.getHeight() > 1)) {
+        // room for the whole chain, so GenerateMipmaps doesn't copy level 0 again
+        if (!mipmapped.Allocate(img.getWidth(), img.getHeight(), img.getBytesPerPixel(), 0)) {
+            std::cerr << "*** Failed to allocate memory for texture levels" << std::endl;
+            return 0;
+        }
+        memcpy(mipmapped.getData(), img.getData(), img.getMipmapSize(0));
+        mipmapped.GenerateMipmaps(1);
+        src = &mipmapped;
+    }
+
+    CompressedImage cimg;
+    if (!cimg.Compress(*src, fmt, genMipmaps ? 0 : 1)) {
+        return 0;
+    }
+
+    GLuint texId = 0;
+    glGenTextures(1, &texId);
+    glBindTexture(GL_TEXTURE_2D, texId);
+
+    GLenum texFormat = GetCompressedInternalFormat(fmt);
+    for (int level = 0; level < cimg.numLevels(); level++) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texFormat, cimg.getLevelWidth(level), cimg.getLevelHeight(level),
+                               0, (GLsizei)cimg.getLevelSize(level), cimg.getLevelData(level));
+    }
+
+    // tell OpenGL how many levels there are (texture completeness)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, cimg.numLevels() - 1);
+
+    if (fmt == COMPRESSED_BC4 || fmt == COMPRESSED_BC5) {
+        SetLuminanceSwizzle(fmt == COMPRESSED_BC5);
+    }
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::cerr << "*** GL error creating compressed texture: " << gluErrorString(err) << std::endl;
+        glDeleteTextures(1, &texId);
+        return 0;
+    }
+
+    return texId;
+}
+
+// storage with a sized internal format for numLevels levels of bpp bytes per pixel; leaves the texture bound
+static GLuint AllocateTexture2D(int width, int height, int bpp, int numLevels, GLenum* pImageFormat)
+{
+    // red and red-green with swizzles where we can, the sized luminance formats otherwise
+    bool haveRG = (GLEW_ARB_texture_rg || GLEW_VERSION_3_0) && (GLEW_ARB_texture_swizzle || GLEW_VERSION_3_3);
+
+    GLenum texFormat, imgFormat;
+    switch (bpp) {
+    case 1:
+        texFormat = haveRG ? GL_R8 : GL_LUMINANCE8;
+        imgFormat = haveRG ? GL_RED : GL_LUMINANCE;
+        break;
+    case 2:
+        texFormat = haveRG ? GL_RG8 : GL_LUMINANCE8_ALPHA8;
+        imgFormat = haveRG ? GL_RG : GL_LUMINANCE_ALPHA;
+        break;
+    case 3:
+        // only if it wasn't prepared, the driver converts it
+        texFormat = GL_RGBA8;
+        imgFormat = GL_RGB;
+        break;
+    default:
+        texFormat = GL_RGBA8;
+        imgFormat = GL_RGBA;
+        break;
+    }
+
+    GLuint texId = 0;
+    glGenTextures(1, &texId);
+    if (!texId) {
+        std::cerr << "*** Failed to create texture" << std::endl;
+        return 0;
+    }
+    glBindTexture(GL_TEXTURE_2D, texId);
+
+    if (GLEW_ARB_texture_storage || GLEW_VERSION_4_2) {
+        glTexStorage2D(GL_TEXTURE_2D, numLevels, texFormat, width, height);
+    } else {
+        for (int level = 0; level < numLevels; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, texFormat, std::max(width >> level, 1), std::max(height >> level, 1),
+                         0, imgFormat, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+    if (haveRG && bpp <= 2) {
+        SetLuminanceSwizzle(bpp == 2);
+    }
+
+    if (pImageFormat) {
+        *pImageFormat = imgFormat;
+    }
+
+    return texId;
+}
+
+GLuint AllocateTexture2D(const Image& img, GLenum* pImageFormat)
+{
+    return AllocateTexture2D(img.getWidth(), img.getHeight(), img.getBytesPerPixel(), img.numMipmaps(), pImageFormat);
+}
+
+size_t GetTextureMemorySize(GLuint texId)
+{
+    glBindTexture(GL_TEXTURE_2D, texId);
+
+    GLint maxLevel = 0;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+    // the sizes of whatever components the internal format has
+    static const GLenum componentSizes[] = {
+        GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE,
+        GL_TEXTURE_LUMINANCE_SIZE, GL_TEXTURE_INTENSITY_SIZE, GL_TEXTURE_DEPTH_SIZE,
+    };
+
+    size_t size = 0;
+    for (GLint level = 0; level <= maxLevel; level++) {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0) {
+            break;      // past the last level
+        }
+
+        GLint compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint levelSize = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+            size += levelSize;
+        } else {
+            GLint bits = 0;
+            for (unsigned i = 0; i < sizeof(componentSizes) / sizeof(componentSizes[0]); i++) {
+                GLint componentBits = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, componentSizes[i], &componentBits);
+                bits += componentBits;
+            }
+            size += (size_t)width * height * ((bits + 7) / 8);
+        }
+    }
+
+    return size;
+}
+
+//
+// Allocate immutable storage with a sized internal format and upload every level with glTexSubImage2D.
+// RGB is padded to RGBA8 and missing mipmaps are built on the CPU, so the driver has nothing to
+// convert and no glGenerateMipmap to run.
+//
+static GLuint CreateImmutableTexture2D(const Image& img, bool genMipmaps)
+{
+    Image scratch;
+    const Image* src = PrepareTextureImage(img, genMipmaps, scratch);
+    if (!src) {
+        return 0;
+    }
+
+    GLenum imgFormat;
+    GLuint texId = AllocateTexture2D(*src, &imgFormat);
+    if (!texId) {
+        return 0;
+    }
+
+    // levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int level = 0; level < src->numMipmaps(); level++) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, src->getMipmapWidth(level), src->getMipmapHeight(level),
+                        imgFormat, GL_UNSIGNED_BYTE, src->getMipmapData(level));
+    }
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::cerr << "*** GL error creating texture: " << gluErrorString(err) << std::endl;
+        glDeleteTextures(1, &texId);
+        return 0;
+    }
+
+    return texId;
+}
+
+GLuint CreateTexture2D(const TextureFile& tf)
+{
+    if (!tf.isOpen()) {
+        return 0;
+    }
+
+    if (!tf.isCompressed()) {
+        // same storage as CreateImmutableTexture2D, and the levels straight from the mapping; gtexbake pads RGB
+        // to RGBA, the driver converts the RGB levels of files baked without that
+        GLenum imgFormat;
+        GLuint texId = AllocateTexture2D(tf.getLevelWidth(0), tf.getLevelHeight(0), tf.getBytesPerPixel(), tf.numLevels(), &imgFormat);
+        if (!texId) {
+            return 0;
+        }
+
+        // levels are tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (int level = 0; level < tf.numLevels(); level++) {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, tf.getLevelWidth(level), tf.getLevelHeight(level),
+                            imgFormat, GL_UNSIGNED_BYTE, tf.getLevelData(level));
+        }
+
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+            std::cerr << "*** GL error creating texture from baked file: " << gluErrorString(err) << std::endl;
+            glDeleteTextures(1, &texId);
+            return 0;
+        }
+
+        return texId;
+    }
+
+    if (!IsCompressedFormatSupported(tf.getCompression())) {
+        std::cerr << "*** Can't create texture: no driver support for " << GetCompressedFormatName(tf.getCompression()) << std::endl;
+        return 0;
+    }
+    GLenum texFormat = GetCompressedInternalFormat(tf.getCompression());
+
+    GLuint texId = 0;
+    glGenTextures(1, &texId);
+    glBindTexture(GL_TEXTURE_2D, texId);
+
+    // levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // straight from the mapping to the driver, one level at a time
+    for (int level = 0; level < tf.numLevels(); level++) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texFormat, tf.getLevelWidth(level), tf.getLevelHeight(level),
+                               0, (GLsizei)tf.getLevelSize(level), tf.getLevelData(level));
+    }
+
+    // tell OpenGL how many levels there are (texture completeness)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tf.numLevels() - 1);
+
+    if (tf.getCompression() == COMPRESSED_BC4 || tf.getCompression() == COMPRESSED_BC5) {
+        SetLuminanceSwizzle(tf.getCompression() == COMPRESSED_BC5);
+    }
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::cerr << "*** GL error creating texture from baked file: " << gluErrorString(err) << std::endl;
+        glDeleteTextures(1, &texId);
+        return 0;
+    }
+
+    return texId;
+}
+
+GLuint CreateTexture2D(const Image& img, bool genMipmaps, bool compress)
 {
     if (!img.isGood()) {
         std::cout << "*** Can't create texture from image: it ain't no good" << std::endl;
         return 0;
     }
 
+    if (compress) {
+        GLuint texId = CreateCompressedTexture2D(img, genMipmaps);
+        if (texId) {
+            return texId;
+        }
+        // no driver support, fall through to the uncompressed path
+    }
+
+    if (GLEW_ARB_texture_storage || GLEW_VERSION_4_2) {
+        return CreateImmutableTexture2D(img, genMipmaps);
+    }
+
+    // old drivers: unsized formats, and the driver generates the mipmaps
+
     int bpp = img.getBytesPerPixel();
 
     // GL texture format lookup table indexed by image color depth in bytes-per-pixel
@@ -9,12 +9,34 @@
 namespace glsh {
 
 class Image;
+class TextureFile;
 
-// load texture from file
-GLuint CreateTexture2D(const std::string& path, bool genMipmaps);
+// load texture from a .tga file, or a baked .gtex file (which ignores genMipmaps and compress)
+GLuint CreateTexture2D(const std::string& path, bool genMipmaps, bool compress = false);
 
+//
 // create texture from Image data in memory
-GLuint CreateTexture2D(const Image& img, bool genMipmaps);
+//
+// With compress set, the image is block compressed on the CPU (BC1/BC3/BC4/BC5, see GLSH_TextureCompression.h)
+// and every mip level is uploaded with glCompressedTexImage2D, as long as the driver supports the format.
+// Otherwise the texture is uploaded uncompressed: into glTexStorage2D immutable storage with a sized format
+// (RGB padded to RGBA8) and the image's own mip chain, built on the CPU if it has none, when the driver
+// has ARB_texture_storage, or the old way with glGenerateMipmap when it doesn't.
+//
+GLuint CreateTexture2D(const Image& img, bool genMipmaps, bool compress = false);
+
+// create texture from a mapped .gtex file, uploading its levels as they are
+GLuint CreateTexture2D(const TextureFile& tf);
+
+//
+// Create a texture with storage for every level of an image made ready by PrepareTextureImage (GLSH_Image.h),
+// for loaders that fill the levels in with glTexSubImage2D over several frames.  Leaves the texture bound
+// and returns the format to pass to glTexSubImage2D.
+//
+GLuint AllocateTexture2D(const Image& img, GLenum* pImageFormat);
+
+// GPU memory used by a 2D texture and its mip levels, as far as the driver tells; leaves the texture bound
+size_t GetTextureMemorySize(GLuint texId);
 
 
 struct TexRect {
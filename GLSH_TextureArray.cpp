@@ -0,0 +1,196 @@
+#include "GLSH_TextureArray.h"
+#include "GLSH_Image.h"
+#include "GLSH_PixelOps.h"
+#include "GLSH_ThreadPool.h"
+
+#include <iostream>
+#include <functional>
+
+namespace glsh {
+
+// one layer on its way from file to upload
+struct LayerImage {
+    Image           loaded;
+    Image           rgba;
+    Image           resized;
+    Image           scratch;
+    const Image*    ready;      // what gets uploaded, one of the above
+
+    LayerImage() : ready(NULL) { }
+};
+
+// level 0 of an image as RGBA, or the image itself if it already is
+static const Image* ExpandToRGBA(const Image& img, Image& rgba)
+{
+    int bpp = img.getBytesPerPixel();
+    if (bpp == 4) {
+        return &img;
+    }
+
+    if (!rgba.Allocate(img.getWidth(), img.getHeight(), 4)) {
+        return NULL;
+    }
+
+    size_t numPixels = (size_t)img.getWidth() * img.getHeight();
+    const unsigned char* src = img.getData();
+    unsigned char* dst = rgba.getData();
+
+    switch (bpp) {
+    case 1:
+        ExpandGrayToRGBA(dst, src, numPixels);
+        break;
+    case 2:
+        // gray and alpha
+        for (size_t i = 0; i < numPixels; i++) {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = src[1];
+            src += 2;
+            dst += 4;
+        }
+        break;
+    default:
+        ExpandRGBToRGBA(dst, src, numPixels);
+        break;
+    }
+
+    return &rgba;
+}
+
+TextureArray::TextureArray()
+    : mTexId(0)
+    , mWidth(0)
+    , mHeight(0)
+    , mNumLevels(0)
+{
+}
+
+TextureArray::~TextureArray()
+{
+    Destroy();
+}
+
+void TextureArray::Destroy()
+{
+    glDeleteTextures(1, &mTexId);
+    mTexId = 0;
+    mWidth = 0;
+    mHeight = 0;
+    mNumLevels = 0;
+    mLayerNames.clear();
+}
+
+bool TextureArray::Create(const std::vector<std::string>& fnames, const std::string& dir, bool genMipmaps)
+{
+    Destroy();
+
+    if (fnames.empty()) {
+        std::cerr << "*** No images for texture array" << std::endl;
+        return false;
+    }
+
+    if (!GLEW_VERSION_3_0 && !GLEW_EXT_texture_array) {
+        std::cerr << "*** Can't create texture array: no driver support" << std::endl;
+        return false;
+    }
+
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (fnames.size() > (size_t)maxLayers) {
+        std::cerr << "*** Can't create texture array: " << fnames.size() << " layers, the driver allows " << maxLayers << std::endl;
+        return false;
+    }
+
+    unsigned numLayers = (unsigned)fnames.size();
+    std::vector<LayerImage> layers(numLayers);
+    GetSharedThreadPool().parallelFor(numLayers, 1, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            layers[i].loaded.Load(dir + fnames[i]);
+        }
+    });
+
+    // the layers are as big as the biggest image
+    int width = 0, height = 0;
+    for (unsigned i = 0; i < numLayers; i++) {
+        const Image& img = layers[i].loaded;
+        if (!img.isGood()) {
+            std::cerr << "*** Failed to load texture array layer from " << dir + fnames[i] << std::endl;
+            return false;
+        }
+        if (img.getWidth() > width) {
+            width = img.getWidth();
+        }
+        if (img.getHeight() > height) {
+            height = img.getHeight();
+        }
+    }
+
+    // convert, resize, and mipmap the layers in parallel; parallelFor nests, so the resizing and mipmapping can spread out too
+    GetSharedThreadPool().parallelFor(numLayers, 1, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            LayerImage& layer = layers[i];
+            const Image* img = ExpandToRGBA(layer.loaded, layer.rgba);
+            if (img && (img->getWidth() != width || img->getHeight() != height)) {
+                img = ResizeImage(*img, width, height, layer.resized) ? &layer.resized : NULL;
+            }
+            if (img) {
+                layer.ready = PrepareTextureImage(*img, genMipmaps, layer.scratch);
+            }
+        }
+    });
+
+    for (unsigned i = 0; i < numLayers; i++) {
+        if (!layers[i].ready) {
+            std::cerr << "*** Failed to prepare texture array layer from " << dir + fnames[i] << std::endl;
+            return false;
+        }
+    }
+
+    // every layer was built the same way, so they all have the same chain
+    int numLevels = layers[0].ready->numMipmaps();
+
+    glGenTextures(1, &mTexId);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mTexId);
+
+    if (GLEW_ARB_texture_storage || GLEW_VERSION_4_2) {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, GL_RGBA8, width, height, numLayers);
+    } else {
+        const Image* img = layers[0].ready;
+        for (int level = 0; level < numLevels; level++) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, img->getMipmapWidth(level), img->getMipmapHeight(level),
+                         numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+    // levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (unsigned i = 0; i < numLayers; i++) {
+        const Image* img = layers[i].ready;
+        for (int level = 0; level < numLevels; level++) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, i, img->getMipmapWidth(level), img->getMipmapHeight(level), 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, img->getMipmapData(level));
+        }
+    }
+
+    mWidth = width;
+    mHeight = height;
+    mNumLevels = numLevels;
+    mLayerNames = fnames;
+
+    return true;
+}
+
+int TextureArray::getLayer(const std::string& fname) const
+{
+    for (unsigned i = 0; i < mLayerNames.size(); i++) {
+        if (mLayerNames[i] == fname) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+} // end of namespace
@@ -0,0 +1,58 @@
+#ifndef GLSH_TEXTUREARRAY_H_
+#define GLSH_TEXTUREARRAY_H_
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+namespace glsh {
+
+//
+// A set of interchangeable images (tiles, say) packed into the layers of one GL_TEXTURE_2D_ARRAY,
+// so a mesh can pick its image per vertex (see VertexPositionTextureLayer) and a whole floor or
+// room draws with a single texture bind.  Sample it with a sampler2DArray in the shaders.
+//
+// Every layer is stored as RGBA8 at the same size.  That's the size of the largest image in the set;
+// smaller ones are enlarged with a bilinear filter, so sets that are the same size to begin with
+// come out best.
+//
+class TextureArray {
+    GLuint                          mTexId;
+    int                             mWidth, mHeight;
+    int                             mNumLevels;
+    std::vector<std::string>        mLayerNames;    // file names as passed to Create, by layer
+
+public:
+                                    TextureArray();
+                                    ~TextureArray();    // deletes the texture
+
+    //
+    // Load the files (dir + fname, .tga or .qoi) in parallel and upload them, one layer per file
+    // in list order.  Mipmaps are built on the CPU.  Fails if any file fails to load.
+    //
+    bool                            Create(const std::vector<std::string>& fnames, const std::string& dir, bool genMipmaps);
+
+    void                            Destroy();
+
+    bool                            isGood() const          { return mTexId != 0; }
+    GLuint                          getTexture() const      { return mTexId; }
+    int                             getWidth() const        { return mWidth; }
+    int                             getHeight() const       { return mHeight; }
+    int                             numLevels() const       { return mNumLevels; }
+    int                             numLayers() const       { return (int)mLayerNames.size(); }
+
+    // the layer holding a file, by the name it was passed to Create with, or -1; a linear search, so look it up once
+    int                             getLayer(const std::string& fname) const;
+
+    const std::string&              getLayerName(int layer) const   { return mLayerNames[layer]; }
+
+private:
+                                    // noncopyable
+                                    TextureArray(const TextureArray&);
+                                    TextureArray& operator= (const TextureArray&);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,826 @@
+#include "GLSH_TextureCompression.h"
+#include "GLSH_Image.h"
+#include "GLSH_ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+// SSE2 is part of x64, and the default for 32-bit builds of every compiler we care about
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define GLSH_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+namespace glsh {
+
+int GetCompressedBlockSize(CompressedFormat fmt)
+{
+    switch (fmt) {
+    case COMPRESSED_BC1:
+    case COMPRESSED_BC4:
+        return 8;
+    case COMPRESSED_BC3:
+    case COMPRESSED_BC5:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+int GetCompressedChannels(CompressedFormat fmt)
+{
+    switch (fmt) {
+    case COMPRESSED_BC1:    return 3;
+    case COMPRESSED_BC3:    return 4;
+    case COMPRESSED_BC4:    return 1;
+    case COMPRESSED_BC5:    return 2;
+    default:                return 0;
+    }
+}
+
+const char* GetCompressedFormatName(CompressedFormat fmt)
+{
+    switch (fmt) {
+    case COMPRESSED_BC1:    return "BC1";
+    case COMPRESSED_BC3:    return "BC3";
+    case COMPRESSED_BC4:    return "BC4";
+    case COMPRESSED_BC5:    return "BC5";
+    default:                return "none";
+    }
+}
+
+CompressedFormat ChooseCompressedFormat(int bytesPerPixel)
+{
+    switch (bytesPerPixel) {
+    case 1:     return COMPRESSED_BC4;
+    case 2:     return COMPRESSED_BC5;
+    case 3:     return COMPRESSED_BC1;
+    case 4:     return COMPRESSED_BC3;
+    default:    return COMPRESSED_NONE;
+    }
+}
+
+//
+// Block fetching
+//
+
+// a pixel of any size as RGBA: gray is replicated, a missing alpha is opaque
+static inline void ExpandPixelRGBA(unsigned char* q, const unsigned char* p, int bpp)
+{
+    switch (bpp) {
+    case 1:
+        q[0] = q[1] = q[2] = p[0];
+        q[3] = 255;
+        break;
+    case 2:
+        q[0] = q[1] = q[2] = p[0];
+        q[3] = p[1];
+        break;
+    case 3:
+        q[0] = p[0];
+        q[1] = p[1];
+        q[2] = p[2];
+        q[3] = 255;
+        break;
+    default:
+        q[0] = p[0];
+        q[1] = p[1];
+        q[2] = p[2];
+        q[3] = p[3];
+        break;
+    }
+}
+
+// address of pixel (x, y) of block (bx, by), repeating the last column and row past the edges
+static inline const unsigned char* BlockPixel(const unsigned char* src, int width, int height, int bpp,
+                                              int bx, int by, int x, int y)
+{
+    int sx = 4 * bx + x;
+    int sy = 4 * by + y;
+    if (sx >= width) {
+        sx = width - 1;
+    }
+    if (sy >= height) {
+        sy = height - 1;
+    }
+    return src + ((size_t)sy * width + sx) * bpp;
+}
+
+static void FetchBlockRGBA(unsigned char rgba[64], const unsigned char* src, int width, int height, int bpp, int bx, int by)
+{
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            ExpandPixelRGBA(rgba + 4 * (4 * y + x), BlockPixel(src, width, height, bpp, bx, by, x, y), bpp);
+        }
+    }
+}
+
+static void FetchBlockChannel(unsigned char values[16], const unsigned char* src, int width, int height, int bpp, int bx, int by, int channel)
+{
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            values[4 * y + x] = BlockPixel(src, width, height, bpp, bx, by, x, y)[channel];
+        }
+    }
+}
+
+//
+// Single channel blocks (BC4, and the alpha of BC3)
+//
+
+// the 8 values a block can hold; a0 > a1 selects 6 interpolated values, otherwise 4 plus 0 and 255
+static void MakeAlphaPalette(int palette[8], int a0, int a1)
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 2; i < 8; i++) {
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; i++) {
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static void EncodeAlphaBlock(unsigned char* dst, const unsigned char values[16])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        if (values[i] < lo) {
+            lo = values[i];
+        }
+        if (values[i] > hi) {
+            hi = values[i];
+        }
+    }
+
+    dst[0] = (unsigned char)hi;
+    dst[1] = (unsigned char)lo;
+
+    if (hi == lo) {
+        // flat block, every pixel uses a0
+        memset(dst + 2, 0, 6);
+        return;
+    }
+
+    // always use the 8-value ramp between the block's extremes
+    int palette[8];
+    MakeAlphaPalette(palette, hi, lo);
+
+    unsigned long long bits = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        int bestDist = 256;
+        for (int k = 0; k < 8; k++) {
+            int d = values[i] - palette[k];
+            if (d < 0) {
+                d = -d;
+            }
+            if (d < bestDist) {
+                bestDist = d;
+                best = k;
+            }
+        }
+        bits |= (unsigned long long)best << (3 * i);
+    }
+
+    for (int k = 0; k < 6; k++) {
+        dst[2 + k] = (unsigned char)(bits >> (8 * k));
+    }
+}
+
+static void DecodeAlphaBlock(unsigned char values[16], const unsigned char* src)
+{
+    int palette[8];
+    MakeAlphaPalette(palette, src[0], src[1]);
+
+    unsigned long long bits = 0;
+    for (int k = 0; k < 6; k++) {
+        bits |= (unsigned long long)src[2 + k] << (8 * k);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        values[i] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+    }
+}
+
+//
+// Color blocks (BC1, and the color of BC3)
+//
+
+static inline unsigned short PackRGB565(int r, int g, int b)
+{
+    return (unsigned short)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+}
+
+static inline void UnpackRGB565(unsigned short c, int rgb[3])
+{
+    int r = (c >> 11) & 31;
+    int g = (c >> 5) & 63;
+    int b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the 4 colors of a block in 4-color mode, as RGBA with zero alpha so alpha never counts in matching
+static void MakeColorPalette(unsigned char palette[16], unsigned short c0, unsigned short c1)
+{
+    int a[3], b[3];
+    UnpackRGB565(c0, a);
+    UnpackRGB565(c1, b);
+
+    for (int c = 0; c < 3; c++) {
+        palette[c] = (unsigned char)a[c];
+        palette[4 + c] = (unsigned char)b[c];
+        palette[8 + c] = (unsigned char)((2 * a[c] + b[c] + 1) / 3);
+        palette[12 + c] = (unsigned char)((a[c] + 2 * b[c] + 1) / 3);
+    }
+    palette[3] = palette[7] = palette[11] = palette[15] = 0;
+}
+
+#if GLSH_SSE2
+
+static void BlockMinMax(const unsigned char rgba[64], unsigned char lo[4], unsigned char hi[4])
+{
+    __m128i p0 = _mm_loadu_si128((const __m128i*)(rgba));
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(rgba + 16));
+    __m128i p2 = _mm_loadu_si128((const __m128i*)(rgba + 32));
+    __m128i p3 = _mm_loadu_si128((const __m128i*)(rgba + 48));
+
+    // fold the 4 pixels of each register down to one
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+
+    int vlo = _mm_cvtsi128_si32(mn);
+    int vhi = _mm_cvtsi128_si32(mx);
+    memcpy(lo, &vlo, 4);
+    memcpy(hi, &vhi, 4);
+}
+
+// pick the nearest palette color for every pixel; returns the total squared error
+static unsigned MatchColors(unsigned* pIndices, const unsigned char rgba[64], const unsigned char palette[16])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+
+    __m128i px[4];
+    for (int r = 0; r < 4; r++) {
+        px[r] = _mm_and_si128(_mm_loadu_si128((const __m128i*)(rgba + 16 * r)), rgbMask);
+    }
+
+    __m128i bestDist[4], bestIndex[4];
+
+    for (int k = 0; k < 4; k++) {
+        int color;
+        memcpy(&color, palette + 4 * k, 4);
+        __m128i pal = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+        __m128i index = _mm_set1_epi32(k);
+
+        for (int r = 0; r < 4; r++) {
+            // squared distances of 4 pixels, widened to 16 bits and summed pairwise by madd
+            __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(px[r], zero), pal);
+            __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(px[r], zero), pal);
+            __m128 slo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));
+            __m128 shi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+            __m128i dist = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(2, 0, 2, 0))),
+                                         _mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(3, 1, 3, 1))));
+
+            if (k == 0) {
+                bestDist[r] = dist;
+                bestIndex[r] = zero;
+            } else {
+                __m128i closer = _mm_cmplt_epi32(dist, bestDist[r]);
+                bestDist[r] = _mm_or_si128(_mm_and_si128(closer, dist), _mm_andnot_si128(closer, bestDist[r]));
+                bestIndex[r] = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, bestIndex[r]));
+            }
+        }
+    }
+
+    int dist[16], index[16];
+    for (int r = 0; r < 4; r++) {
+        _mm_storeu_si128((__m128i*)(dist + 4 * r), bestDist[r]);
+        _mm_storeu_si128((__m128i*)(index + 4 * r), bestIndex[r]);
+    }
+
+    unsigned indices = 0;
+    unsigned error = 0;
+    for (int i = 0; i < 16; i++) {
+        indices |= (unsigned)index[i] << (2 * i);
+        error += (unsigned)dist[i];
+    }
+
+    *pIndices = indices;
+    return error;
+}
+
+#else
+
+static void BlockMinMax(const unsigned char rgba[64], unsigned char lo[4], unsigned char hi[4])
+{
+    for (int c = 0; c < 4; c++) {
+        lo[c] = 255;
+        hi[c] = 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            unsigned char v = rgba[4 * i + c];
+            if (v < lo[c]) {
+                lo[c] = v;
+            }
+            if (v > hi[c]) {
+                hi[c] = v;
+            }
+        }
+    }
+}
+
+static unsigned MatchColors(unsigned* pIndices, const unsigned char rgba[64], const unsigned char palette[16])
+{
+    unsigned indices = 0;
+    unsigned error = 0;
+    for (int i = 0; i < 16; i++) {
+        const unsigned char* p = rgba + 4 * i;
+        unsigned best = 0;
+        unsigned bestDist = ~0u;
+        for (unsigned k = 0; k < 4; k++) {
+            const unsigned char* q = palette + 4 * k;
+            int dr = p[0] - q[0];
+            int dg = p[1] - q[1];
+            int db = p[2] - q[2];
+            unsigned dist = (unsigned)(dr * dr + dg * dg + db * db);
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = k;
+            }
+        }
+        indices |= best << (2 * i);
+        error += bestDist;
+    }
+
+    *pIndices = indices;
+    return error;
+}
+
+#endif
+
+// order the endpoints for 4-color mode and match the pixels against them; returns the total squared error
+static unsigned FitColorIndices(unsigned short* pc0, unsigned short* pc1, unsigned* pIndices, const unsigned char rgba[64])
+{
+    if (*pc0 < *pc1) {
+        unsigned short t = *pc0;
+        *pc0 = *pc1;
+        *pc1 = t;
+    }
+
+    unsigned char palette[16];
+    MakeColorPalette(palette, *pc0, *pc1);
+    return MatchColors(pIndices, rgba, palette);
+}
+
+//
+// Least squares fit of the endpoints for a given set of indices.
+// Returns false if the indices don't constrain both endpoints.
+//
+static bool RefineColorEndpoints(unsigned short* pc0, unsigned short* pc1, unsigned indices, const unsigned char rgba[64])
+{
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    float aa = 0, bb = 0, ab = 0;
+    float ap[3] = { 0, 0, 0 };
+    float bp[3] = { 0, 0, 0 };
+
+    for (int i = 0; i < 16; i++) {
+        float a = weights[(indices >> (2 * i)) & 3];
+        float b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < 3; c++) {
+            ap[c] += a * rgba[4 * i + c];
+            bp[c] += b * rgba[4 * i + c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) {
+        return false;
+    }
+
+    int e0[3], e1[3];
+    for (int c = 0; c < 3; c++) {
+        float v0 = (ap[c] * bb - bp[c] * ab) / det;
+        float v1 = (bp[c] * aa - ap[c] * ab) / det;
+        e0[c] = v0 < 0 ? 0 : v0 > 255 ? 255 : (int)(v0 + 0.5f);
+        e1[c] = v1 < 0 ? 0 : v1 > 255 ? 255 : (int)(v1 + 0.5f);
+    }
+
+    *pc0 = PackRGB565(e0[0], e0[1], e0[2]);
+    *pc1 = PackRGB565(e1[0], e1[1], e1[2]);
+    return true;
+}
+
+static void EncodeColorBlock(unsigned char* dst, const unsigned char rgba[64])
+{
+    unsigned char lo[4], hi[4];
+    BlockMinMax(rgba, lo, hi);
+
+    // the box corners are usually outliers, so pull them in a little
+    int e0[3], e1[3];
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) >> 4;
+        e0[c] = hi[c] - inset;
+        e1[c] = lo[c] + inset;
+    }
+
+    //
+    // Use the box diagonal that follows the colors: relative to the channel with the widest range,
+    // flip any channel that runs the other way.
+    //
+    int axis = 0;
+    for (int c = 1; c < 3; c++) {
+        if (hi[c] - lo[c] > hi[axis] - lo[axis]) {
+            axis = c;
+        }
+    }
+
+    // 16x the mean, so the covariance stays in integers
+    int mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += rgba[4 * i + c];
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        if (c == axis) {
+            continue;
+        }
+        int cov = 0;
+        for (int i = 0; i < 16; i++) {
+            cov += (16 * rgba[4 * i + axis] - mean[axis]) * (16 * rgba[4 * i + c] - mean[c]);
+        }
+        if (cov < 0) {
+            int t = e0[c];
+            e0[c] = e1[c];
+            e1[c] = t;
+        }
+    }
+
+    unsigned short c0 = PackRGB565(e0[0], e0[1], e0[2]);
+    unsigned short c1 = PackRGB565(e1[0], e1[1], e1[2]);
+    unsigned indices = 0;
+    unsigned error = FitColorIndices(&c0, &c1, &indices, rgba);
+
+    // one round of least squares usually takes a good chunk off the error
+    unsigned short r0 = c0, r1 = c1;
+    if (error > 0 && c0 != c1 && RefineColorEndpoints(&r0, &r1, indices, rgba)) {
+        unsigned refinedIndices = 0;
+        unsigned refinedError = FitColorIndices(&r0, &r1, &refinedIndices, rgba);
+        if (refinedError < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refinedIndices;
+        }
+    }
+
+    if (c0 == c1) {
+        // 3-color mode; index 0 is still c0
+        indices = 0;
+    }
+
+    dst[0] = (unsigned char)c0;
+    dst[1] = (unsigned char)(c0 >> 8);
+    dst[2] = (unsigned char)c1;
+    dst[3] = (unsigned char)(c1 >> 8);
+    dst[4] = (unsigned char)indices;
+    dst[5] = (unsigned char)(indices >> 8);
+    dst[6] = (unsigned char)(indices >> 16);
+    dst[7] = (unsigned char)(indices >> 24);
+}
+
+// BC3 color blocks always use 4 colors; BC1 blocks with c0 <= c1 use 3 colors plus transparent black
+static void DecodeColorBlock(unsigned char rgba[64], const unsigned char* src, bool alwaysFourColors)
+{
+    unsigned short c0 = (unsigned short)(src[0] | (src[1] << 8));
+    unsigned short c1 = (unsigned short)(src[2] | (src[3] << 8));
+    unsigned indices = src[4] | (src[5] << 8) | (src[6] << 16) | ((unsigned)src[7] << 24);
+
+    unsigned char palette[16];
+    if (c0 > c1 || alwaysFourColors) {
+        MakeColorPalette(palette, c0, c1);
+        palette[3] = palette[7] = palette[11] = palette[15] = 255;
+    } else {
+        int a[3], b[3];
+        UnpackRGB565(c0, a);
+        UnpackRGB565(c1, b);
+        for (int c = 0; c < 3; c++) {
+            palette[c] = (unsigned char)a[c];
+            palette[4 + c] = (unsigned char)b[c];
+            palette[8 + c] = (unsigned char)((a[c] + b[c]) / 2);
+            palette[12 + c] = 0;
+        }
+        palette[3] = palette[7] = palette[11] = 255;
+        palette[15] = 0;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        memcpy(rgba + 4 * i, palette + 4 * ((indices >> (2 * i)) & 3), 4);
+    }
+}
+
+//
+// Whole blocks
+//
+
+static void EncodeBlock(CompressedFormat fmt, unsigned char* dst, const unsigned char* src,
+                        int width, int height, int bpp, int bx, int by)
+{
+    unsigned char rgba[64];
+    unsigned char values[16];
+
+    switch (fmt) {
+    case COMPRESSED_BC1:
+        FetchBlockRGBA(rgba, src, width, height, bpp, bx, by);
+        EncodeColorBlock(dst, rgba);
+        break;
+
+    case COMPRESSED_BC3:
+        FetchBlockRGBA(rgba, src, width, height, bpp, bx, by);
+        for (int i = 0; i < 16; i++) {
+            values[i] = rgba[4 * i + 3];
+        }
+        EncodeAlphaBlock(dst, values);
+        EncodeColorBlock(dst + 8, rgba);
+        break;
+
+    case COMPRESSED_BC4:
+        FetchBlockChannel(values, src, width, height, bpp, bx, by, 0);
+        EncodeAlphaBlock(dst, values);
+        break;
+
+    case COMPRESSED_BC5:
+        FetchBlockChannel(values, src, width, height, bpp, bx, by, 0);
+        EncodeAlphaBlock(dst, values);
+        FetchBlockChannel(values, src, width, height, bpp, bx, by, bpp > 1 ? 1 : 0);
+        EncodeAlphaBlock(dst + 8, values);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// decode a block into 16 pixels of GetCompressedChannels(fmt) bytes each
+static void DecodeBlock(CompressedFormat fmt, unsigned char* pixels, const unsigned char* src)
+{
+    unsigned char rgba[64];
+    unsigned char values[16];
+
+    switch (fmt) {
+    case COMPRESSED_BC1:
+        DecodeColorBlock(rgba, src, false);
+        for (int i = 0; i < 16; i++) {
+            memcpy(pixels + 3 * i, rgba + 4 * i, 3);
+        }
+        break;
+
+    case COMPRESSED_BC3:
+        DecodeColorBlock(pixels, src + 8, true);
+        DecodeAlphaBlock(values, src);
+        for (int i = 0; i < 16; i++) {
+            pixels[4 * i + 3] = values[i];
+        }
+        break;
+
+    case COMPRESSED_BC4:
+        DecodeAlphaBlock(pixels, src);
+        break;
+
+    case COMPRESSED_BC5:
+        DecodeAlphaBlock(values, src);
+        for (int i = 0; i < 16; i++) {
+            pixels[2 * i] = values[i];
+        }
+        DecodeAlphaBlock(values, src + 8);
+        for (int i = 0; i < 16; i++) {
+            pixels[2 * i + 1] = values[i];
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+//
+// CompressedImage
+//
+
+// levels with at least this many blocks are encoded in bands of block rows on the thread pool...
+static const int COMPRESS_PARALLEL_BLOCKS = 1024;
+
+// ...with about this many blocks per band
+static const int COMPRESS_BAND_BLOCKS = 256;
+
+CompressedImage::CompressedImage()
+    : mFormat(COMPRESSED_NONE)
+    , mWidth(0)
+    , mHeight(0)
+    , mData(NULL)
+    , mDataSize(0)
+{
+}
+
+CompressedImage::~CompressedImage()
+{
+    Deallocate();
+}
+
+void CompressedImage::Deallocate()
+{
+    delete [] mData;
+    mData = NULL;
+    mDataSize = 0;
+    mFormat = COMPRESSED_NONE;
+    mWidth = 0;
+    mHeight = 0;
+    mLevels.clear();
+}
+
+bool CompressedImage::Compress(const Image& img, CompressedFormat fmt, int numLevels)
+{
+    Deallocate();
+
+    int blockSize = GetCompressedBlockSize(fmt);
+    if (!img.isGood() || blockSize == 0) {
+        return false;
+    }
+
+    int n = img.numMipmaps();
+    if (numLevels > 0 && numLevels < n) {
+        n = numLevels;
+    }
+
+    // levels are packed back to back; they're all multiples of the block size
+    size_t offset = 0;
+    for (int i = 0; i < n; i++) {
+        Level lv;
+        lv.width = img.getMipmapWidth(i);
+        lv.height = img.getMipmapHeight(i);
+        lv.offset = offset;
+        lv.size = (size_t)((lv.width + 3) / 4) * ((lv.height + 3) / 4) * blockSize;
+        mLevels.push_back(lv);
+        offset += lv.size;
+    }
+
+    mData = new unsigned char[offset];
+    mDataSize = offset;
+    mFormat = fmt;
+    mWidth = img.getWidth();
+    mHeight = img.getHeight();
+
+    int bpp = img.getBytesPerPixel();
+
+    for (int i = 0; i < n; i++) {
+        const unsigned char* src = img.getMipmapData(i);
+        unsigned char* dst = mData + mLevels[i].offset;
+        int width = mLevels[i].width;
+        int height = mLevels[i].height;
+        int blocksX = (width + 3) / 4;
+        int blocksY = (height + 3) / 4;
+
+        std::function<void(unsigned, unsigned)> encodeRows = [=](unsigned rowBegin, unsigned rowEnd) {
+            for (unsigned by = rowBegin; by < rowEnd; by++) {
+                unsigned char* q = dst + (size_t)by * blocksX * blockSize;
+                for (int bx = 0; bx < blocksX; bx++) {
+                    EncodeBlock(fmt, q, src, width, height, bpp, bx, by);
+                    q += blockSize;
+                }
+            }
+        };
+
+        if (blocksX * blocksY >= COMPRESS_PARALLEL_BLOCKS) {
+            unsigned bandRows = COMPRESS_BAND_BLOCKS / blocksX;
+            GetSharedThreadPool().parallelFor(blocksY, bandRows > 0 ? bandRows : 1, encodeRows);
+        } else {
+            encodeRows(0, blocksY);
+        }
+    }
+
+    return true;
+}
+
+bool CompressedImage::Decompress(int level, Image& out) const
+{
+    if (!isGood() || level < 0 || level >= numLevels()) {
+        return false;
+    }
+
+    int channels = GetCompressedChannels(mFormat);
+    int blockSize = GetCompressedBlockSize(mFormat);
+    int width = mLevels[level].width;
+    int height = mLevels[level].height;
+
+    if (!out.Allocate(width, height, channels)) {
+        return false;
+    }
+
+    const unsigned char* src = getLevelData(level);
+    unsigned char* dst = out.getData();
+    unsigned char pixels[64];
+
+    for (int by = 0; by < (height + 3) / 4; by++) {
+        for (int bx = 0; bx < (width + 3) / 4; bx++) {
+            DecodeBlock(mFormat, pixels, src);
+            src += blockSize;
+
+            // copy out the part of the block that's inside the image
+            for (int y = 0; y < 4 && 4 * by + y < height; y++) {
+                int w = width - 4 * bx < 4 ? width - 4 * bx : 4;
+                memcpy(dst + ((size_t)(4 * by + y) * width + 4 * bx) * channels, pixels + 4 * y * channels, w * channels);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool MeasureCompressionError(const Image& original, const CompressedImage& compressed, CompressionError* pRet)
+{
+    if (!original.isGood() || !compressed.isGood() || original.numMipmaps() < compressed.numLevels()) {
+        return false;
+    }
+
+    CompressedFormat fmt = compressed.getFormat();
+    int channels = GetCompressedChannels(fmt);
+    int bpp = original.getBytesPerPixel();
+    bool rgba = (fmt == COMPRESSED_BC1 || fmt == COMPRESSED_BC3);
+
+    double sse = 0;
+    double count = 0;
+    int maxError = 0;
+
+    for (int level = 0; level < compressed.numLevels(); level++) {
+        int width = original.getMipmapWidth(level);
+        int height = original.getMipmapHeight(level);
+        if (width != compressed.getLevelWidth(level) || height != compressed.getLevelHeight(level)) {
+            return false;
+        }
+
+        Image decoded;
+        if (!compressed.Decompress(level, decoded)) {
+            return false;
+        }
+
+        const unsigned char* p = original.getMipmapData(level);
+        const unsigned char* q = decoded.getData();
+
+        for (int i = 0; i < width * height; i++) {
+            // compare against what the encoder saw
+            unsigned char expected[4];
+            if (rgba) {
+                ExpandPixelRGBA(expected, p, bpp);
+            } else {
+                expected[0] = p[0];
+                expected[1] = p[bpp > 1 ? 1 : 0];
+            }
+
+            for (int c = 0; c < channels; c++) {
+                int d = (int)q[c] - (int)expected[c];
+                if (d < 0) {
+                    d = -d;
+                }
+                if (d > maxError) {
+                    maxError = d;
+                }
+                sse += d * d;
+            }
+
+            count += channels;
+            p += bpp;
+            q += channels;
+        }
+    }
+
+    double mse = count > 0 ? sse / count : 0;
+    pRet->rmse = std::sqrt(mse);
+    pRet->psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 100.0;
+    if (pRet->psnr > 100.0) {
+        pRet->psnr = 100.0;
+    }
+    pRet->maxError = maxError;
+
+    return true;
+}
+
+} // end of namespace
@@ -0,0 +1,107 @@
+#ifndef GLSH_TEXTURECOMPRESSION_H_
+#define GLSH_TEXTURECOMPRESSION_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace glsh {
+
+class Image;
+
+//
+// Block compressed formats.  Every block covers 4x4 pixels; partial blocks at the right
+// and bottom edges are padded by repeating the last column and row.
+// The values are stored in .gtex files, so don't renumber them.
+//
+enum CompressedFormat {
+    COMPRESSED_NONE,
+    COMPRESSED_BC1,         // RGB, 8 bytes per block (DXT1)
+    COMPRESSED_BC3,         // RGBA, 16 bytes per block (DXT5)
+    COMPRESSED_BC4,         // one channel, 8 bytes per block (RGTC1)
+    COMPRESSED_BC5,         // two channels, 16 bytes per block (RGTC2)
+};
+
+// bytes per 4x4 block
+int GetCompressedBlockSize(CompressedFormat fmt);
+
+// number of channels a format stores: 3, 4, 1, and 2 respectively
+int GetCompressedChannels(CompressedFormat fmt);
+
+const char* GetCompressedFormatName(CompressedFormat fmt);
+
+// pick a format for an image with the given pixel size: 1 -> BC4, 2 -> BC5, 3 -> BC1, 4 -> BC3
+CompressedFormat ChooseCompressedFormat(int bytesPerPixel);
+
+
+//
+// The block compressed version of an Image and its mip chain, kept in one block of memory
+// with a table of level offsets, like Image itself.
+//
+class CompressedImage {
+public:
+    struct Level {
+        int             width, height;      // in pixels, not blocks
+        size_t          offset;
+        size_t          size;
+    };
+
+private:
+    CompressedFormat        mFormat;
+    int                     mWidth, mHeight;
+    unsigned char*          mData;
+    size_t                  mDataSize;
+    std::vector<Level>      mLevels;
+
+public:
+                            CompressedImage();
+                            ~CompressedImage();
+
+    //
+    // Encode the first numLevels mip levels of img (all of them if numLevels < 1).
+    // BC1 and BC3 encode the image's colors (gray is replicated, a missing alpha is opaque);
+    // BC4 and BC5 encode the first one or two bytes of each pixel as they are.
+    // Blocks are encoded in parallel on the shared thread pool.
+    //
+    bool                    Compress(const Image& img, CompressedFormat fmt, int numLevels = 0);
+    void                    Deallocate();
+
+    //
+    // Reference decoder: expand one level back into an image with GetCompressedChannels(fmt) bytes per pixel.
+    //
+    bool                    Decompress(int level, Image& out) const;
+
+    bool                    isGood() const                      { return mData != 0; }
+    CompressedFormat        getFormat() const                   { return mFormat; }
+    int                     getWidth() const                    { return mWidth; }
+    int                     getHeight() const                   { return mHeight; }
+    const unsigned char*    getData() const                     { return mData; }
+    size_t                  getDataSize() const                 { return mDataSize; }
+
+    int                     numLevels() const                   { return (int)mLevels.size(); }
+    int                     getLevelWidth(int level) const      { return mLevels[level].width; }
+    int                     getLevelHeight(int level) const     { return mLevels[level].height; }
+    size_t                  getLevelSize(int level) const       { return mLevels[level].size; }
+    const unsigned char*    getLevelData(int level) const       { return mData + mLevels[level].offset; }
+
+private:
+                            // noncopyable
+                            CompressedImage(const CompressedImage&);
+                            CompressedImage& operator= (const CompressedImage&);
+};
+
+
+//
+// Encoding error of a compressed image, measured against the image it was made from.
+//
+struct CompressionError {
+    double      rmse;           // root mean square error per channel, 0-255 scale
+    double      psnr;           // peak signal to noise ratio in dB, capped at 100 for lossless results
+    int         maxError;       // largest error of any single channel
+};
+
+// decode every level of compressed and compare the channels it stores with the same levels of original
+bool MeasureCompressionError(const Image& original, const CompressedImage& compressed, CompressionError* pRet);
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,188 @@
+#include "GLSH_TextureFile.h"
+#include "GLSH_Image.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace glsh {
+
+// level data alignment within the file
+static const unsigned GTEX_ALIGNMENT = 16;
+
+TextureFile::TextureFile()
+    : mHeader(NULL)
+    , mLevels(NULL)
+{
+}
+
+bool TextureFile::Open(const std::string& path)
+{
+    Close();
+
+    if (!mFile.Open(path)) {
+        std::cerr << "*** Failed to open texture file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    const unsigned char* buf = mFile.getData();
+    size_t len = mFile.getSize();
+
+    const GTexHeader* hdr = reinterpret_cast<const GTexHeader*>(buf);
+    if (len < sizeof(GTexHeader) || hdr->magic != GTEX_MAGIC) {
+        std::cerr << "*** '" << path << "' is not a texture file" << std::endl;
+        mFile.Close();
+        return false;
+    }
+    if (hdr->version != GTEX_VERSION) {
+        std::cerr << "*** Texture file '" << path << "' has unsupported version " << hdr->version << std::endl;
+        mFile.Close();
+        return false;
+    }
+
+    bool formatOk = hdr->compression == COMPRESSED_NONE ? (hdr->bytesPerPixel >= 1 && hdr->bytesPerPixel <= 4)
+                                                        : GetCompressedBlockSize((CompressedFormat)hdr->compression) != 0;
+    if (!formatOk || hdr->width == 0 || hdr->height == 0 || hdr->numLevels == 0 ||
+        (len - sizeof(GTexHeader)) / sizeof(GTexLevel) < hdr->numLevels) {
+        std::cerr << "*** Texture file '" << path << "' is corrupt" << std::endl;
+        mFile.Close();
+        return false;
+    }
+
+    // every level has to be where the table says, in full
+    const GTexLevel* levels = reinterpret_cast<const GTexLevel*>(buf + sizeof(GTexHeader));
+    for (unsigned i = 0; i < hdr->numLevels; i++) {
+        const GTexLevel& lv = levels[i];
+        size_t expected;
+        if (hdr->compression == COMPRESSED_NONE) {
+            expected = (size_t)lv.width * lv.height * hdr->bytesPerPixel;
+        } else {
+            expected = (size_t)((lv.width + 3) / 4) * ((lv.height + 3) / 4) * GetCompressedBlockSize((CompressedFormat)hdr->compression);
+        }
+        if (lv.size != expected || lv.offset > len || len - lv.offset < lv.size) {
+            std::cerr << "*** Texture file '" << path << "' is truncated" << std::endl;
+            mFile.Close();
+            return false;
+        }
+    }
+
+    mHeader = hdr;
+    mLevels = levels;
+
+    return true;
+}
+
+void TextureFile::Close()
+{
+    mFile.Close();
+    mHeader = NULL;
+    mLevels = NULL;
+}
+
+//
+// Writing
+//
+
+// the level data to write, wherever it lives
+struct LevelSource {
+    int                     width, height;
+    const unsigned char*    data;
+    size_t                  size;
+};
+
+static bool WriteTextureFile(const std::string& path, GTexHeader hdr, const std::vector<LevelSource>& src)
+{
+    hdr.magic = GTEX_MAGIC;
+    hdr.version = GTEX_VERSION;
+    hdr.numLevels = (unsigned)src.size();
+    hdr.reserved = 0;
+
+    // lay out the levels after the level table
+    std::vector<GTexLevel> levels(src.size());
+    size_t offset = sizeof(GTexHeader) + src.size() * sizeof(GTexLevel);
+    for (unsigned i = 0; i < src.size(); i++) {
+        offset = (offset + GTEX_ALIGNMENT - 1) & ~(size_t)(GTEX_ALIGNMENT - 1);
+        levels[i].width = src[i].width;
+        levels[i].height = src[i].height;
+        levels[i].offset = (unsigned)offset;
+        levels[i].size = (unsigned)src[i].size;
+        offset += src[i].size;
+    }
+
+    if (offset > 0xffffffffu) {
+        std::cerr << "*** Texture too big for texture file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    std::ofstream f(path.c_str(), std::ios::binary);
+    if (!f) {
+        std::cerr << "*** Failed to create texture file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    f.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    f.write(reinterpret_cast<const char*>(&levels[0]), levels.size() * sizeof(GTexLevel));
+
+    static const char padding[GTEX_ALIGNMENT] = { 0 };
+    size_t pos = sizeof(GTexHeader) + levels.size() * sizeof(GTexLevel);
+    for (unsigned i = 0; i < src.size(); i++) {
+        f.write(padding, levels[i].offset - pos);
+        f.write(reinterpret_cast<const char*>(src[i].data), src[i].size);
+        pos = levels[i].offset + src[i].size;
+    }
+
+    if (!f) {
+        std::cerr << "*** Failed to write texture file '" << path << "'" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteTextureFile(const std::string& path, const Image& img)
+{
+    if (!img.isGood()) {
+        return false;
+    }
+
+    GTexHeader hdr;
+    hdr.width = img.getWidth();
+    hdr.height = img.getHeight();
+    hdr.bytesPerPixel = img.getBytesPerPixel();
+    hdr.compression = COMPRESSED_NONE;
+
+    std::vector<LevelSource> src(img.numMipmaps());
+    for (int i = 0; i < img.numMipmaps(); i++) {
+        src[i].width = img.getMipmapWidth(i);
+        src[i].height = img.getMipmapHeight(i);
+        src[i].data = img.getMipmapData(i);
+        src[i].size = img.getMipmapSize(i);
+    }
+
+    return WriteTextureFile(path, hdr, src);
+}
+
+bool WriteTextureFile(const std::string& path, const CompressedImage& cimg)
+{
+    if (!cimg.isGood()) {
+        return false;
+    }
+
+    GTexHeader hdr;
+    hdr.width = cimg.getWidth();
+    hdr.height = cimg.getHeight();
+    hdr.bytesPerPixel = 0;
+    hdr.compression = cimg.getFormat();
+
+    std::vector<LevelSource> src(cimg.numLevels());
+    for (int i = 0; i < cimg.numLevels(); i++) {
+        src[i].width = cimg.getLevelWidth(i);
+        src[i].height = cimg.getLevelHeight(i);
+        src[i].data = cimg.getLevelData(i);
+        src[i].size = cimg.getLevelSize(i);
+    }
+
+    return WriteTextureFile(path, hdr, src);
+}
+
+} // end of namespace
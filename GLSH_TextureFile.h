@@ -0,0 +1,80 @@
+#ifndef GLSH_TEXTUREFILE_H_
+#define GLSH_TEXTUREFILE_H_
+
+#include "GLSH_FileMap.h"
+#include "GLSH_TextureCompression.h"
+
+#include <string>
+
+namespace glsh {
+
+class Image;
+
+//
+// Baked texture container (.gtex)
+//
+// Holds a texture exactly as it gets uploaded: pixels already in RGB(A) order, the whole
+// mip chain, and optionally BCn blocks instead of pixels.  All values are little-endian.
+//
+//   GTexHeader                 magic, size, pixel format, number of levels
+//   GTexLevel[numLevels]       size and file offset of each level, largest first
+//   level data                 each level starts at a 16-byte aligned offset
+//
+
+static const unsigned GTEX_MAGIC = 0x58455447;     // "GTEX"
+static const unsigned GTEX_VERSION = 1;
+
+struct GTexHeader {
+    unsigned    magic;
+    unsigned    version;
+    unsigned    width, height;
+    unsigned    bytesPerPixel;      // 1-4 for uncompressed textures, 0 for compressed ones
+    unsigned    compression;        // a CompressedFormat, COMPRESSED_NONE for plain pixels
+    unsigned    numLevels;
+    unsigned    reserved;
+};
+
+struct GTexLevel {
+    unsigned    width, height;
+    unsigned    offset;             // from the start of the file
+    unsigned    size;
+};
+
+
+//
+// A .gtex file mapped into memory.  Level data points straight into the mapping,
+// so it's only valid while the file is open.
+//
+class TextureFile {
+    MappedFile              mFile;
+    const GTexHeader*       mHeader;
+    const GTexLevel*        mLevels;
+
+public:
+                            TextureFile();
+
+    // map the file and validate the header and level table against the file size
+    bool                    Open(const std::string& path);
+    void                    Close();
+
+    bool                    isOpen() const                      { return mHeader != NULL; }
+    int                     getWidth() const                    { return (int)mHeader->width; }
+    int                     getHeight() const                   { return (int)mHeader->height; }
+    int                     getBytesPerPixel() const            { return (int)mHeader->bytesPerPixel; }
+    CompressedFormat        getCompression() const              { return (CompressedFormat)mHeader->compression; }
+    bool                    isCompressed() const                { return mHeader->compression != COMPRESSED_NONE; }
+
+    int                     numLevels() const                   { return (int)mHeader->numLevels; }
+    int                     getLevelWidth(int level) const      { return (int)mLevels[level].width; }
+    int                     getLevelHeight(int level) const     { return (int)mLevels[level].height; }
+    size_t                  getLevelSize(int level) const       { return mLevels[level].size; }
+    const unsigned char*    getLevelData(int level) const       { return mFile.getData() + mLevels[level].offset; }
+};
+
+// write all the levels of an image, or of its compressed version
+bool WriteTextureFile(const std::string& path, const Image& img);
+bool WriteTextureFile(const std::string& path, const CompressedImage& cimg);
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,176 @@
+#include "GLSH_ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+
+namespace glsh {
+
+ThreadPool::ThreadPool(unsigned numThreads)
+    : mNumBusy(0)
+    , mQuit(false)
+{
+    if (numThreads == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        numThreads = hw > 1 ? hw - 1 : 1;
+    }
+
+    for (unsigned i = 0; i < numThreads; i++) {
+        mThreads.push_back(std::thread(&ThreadPool::workerMain, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mJobAvailable.notify_all();
+
+    for (unsigned i = 0; i < mThreads.size(); i++) {
+        mThreads[i].join();
+    }
+}
+
+void ThreadPool::schedule(const std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(job);
+    }
+    mJobAvailable.notify_one();
+}
+
+void ThreadPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mJobs.empty() || mNumBusy > 0) {
+        mIdle.wait(lock);
+    }
+}
+
+void ThreadPool::workerMain()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (mJobs.empty() && !mQuit) {
+                mJobAvailable.wait(lock);
+            }
+            if (mJobs.empty()) {
+                return;  // quitting, and nothing left to do
+            }
+            job = mJobs.front();
+            mJobs.pop_front();
+            ++mNumBusy;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mNumBusy;
+            if (mJobs.empty() && mNumBusy == 0) {
+                mIdle.notify_all();
+            }
+        }
+    }
+}
+
+namespace {
+
+// bookkeeping for one parallelFor call; shared with the helper jobs, which may outlive the call
+struct ParallelForState {
+    std::function<void(unsigned, unsigned)>     body;
+    unsigned                                    count;
+    unsigned                                    batchSize;
+    unsigned                                    numBatches;
+    std::atomic<unsigned>                       nextBatch;
+
+    std::mutex                                  mutex;
+    std::condition_variable                     done;
+    unsigned                                    numDone;
+
+    // grab and run batches until there are none left
+    void run()
+    {
+        unsigned finished = 0;
+        for (;;) {
+            unsigned b = nextBatch++;
+            if (b >= numBatches) {
+                break;
+            }
+            unsigned begin = b * batchSize;
+            unsigned end = begin + batchSize < count ? begin + batchSize : count;
+            body(begin, end);
+            ++finished;
+        }
+
+        if (finished > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            numDone += finished;
+            if (numDone == numBatches) {
+                done.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+void ThreadPool::parallelFor(unsigned count, unsigned minBatch, const std::function<void(unsigned begin, unsigned end)>& body)
+{
+    if (count == 0) {
+        return;
+    }
+    if (minBatch == 0) {
+        minBatch = 1;
+    }
+
+    // aim for a few batches per thread so uneven batches balance out
+    unsigned numWorkers = numThreads() + 1;
+    unsigned batchSize = count / (4 * numWorkers);
+    if (batchSize < minBatch) {
+        batchSize = minBatch;
+    }
+    unsigned numBatches = (count + batchSize - 1) / batchSize;
+
+    if (numBatches == 1) {
+        // not worth waking anybody up
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->body = body;
+    state->count = count;
+    state->batchSize = batchSize;
+    state->numBatches = numBatches;
+    state->nextBatch = 0;
+    state->numDone = 0;
+
+    unsigned numHelpers = numBatches - 1 < numThreads() ? numBatches - 1 : numThreads();
+    for (unsigned i = 0; i < numHelpers; i++) {
+        schedule([state]() { state->run(); });
+    }
+
+    // pitch in, then wait for the batches other threads are still working on
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (state->numDone < state->numBatches) {
+        state->done.wait(lock);
+    }
+}
+
+ThreadPool& GetSharedThreadPool()
+{
+    // function-local statics aren't initialized thread-safely by every compiler we use
+    static std::once_flag once;
+    static ThreadPool* pool = NULL;
+    std::call_once(once, []() { pool = new ThreadPool(); });
+    return *pool;
+}
+
+} // end of namespace
@@ -0,0 +1,61 @@
+#ifndef GLSH_THREADPOOL_H_
+#define GLSH_THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace glsh {
+
+//
+// A fixed set of worker threads that run queued jobs in FIFO order.
+//
+class ThreadPool {
+    std::vector<std::thread>            mThreads;
+    std::deque<std::function<void()> >  mJobs;
+
+    std::mutex                          mMutex;
+    std::condition_variable             mJobAvailable;
+    std::condition_variable             mIdle;
+
+    unsigned                            mNumBusy;       // jobs currently running
+    bool                                mQuit;
+
+public:
+    // numThreads == 0 means one thread per hardware thread, minus one for the caller
+    explicit                            ThreadPool(unsigned numThreads = 0);
+                                        ~ThreadPool();      // finishes queued jobs first
+
+    unsigned                            numThreads() const  { return (unsigned)mThreads.size(); }
+
+    // queue a job to run on one of the workers
+    void                                schedule(const std::function<void()>& job);
+
+    // block until the queue is empty and no job is running
+    void                                waitIdle();
+
+    //
+    // Split [0, count) into batches of at least minBatch items and run body(begin, end) on each.
+    // The calling thread works on batches too, and the call returns once all of them are done,
+    // so it's safe to use from inside a job.
+    //
+    void                                parallelFor(unsigned count, unsigned minBatch,
+                                                    const std::function<void(unsigned begin, unsigned end)>& body);
+
+private:
+    void                                workerMain();
+
+                                        // noncopyable
+                                        ThreadPool(const ThreadPool&);
+                                        ThreadPool& operator= (const ThreadPool&);
+};
+
+// a pool shared by the engine's loaders and image processing, created on first use
+ThreadPool& GetSharedThreadPool();
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,145 @@
+#include "GLSH_TileCache.h"
+
+#include <iostream>
+
+namespace glsh {
+
+TileCache::TileCache()
+    : mTileSize(0)
+    , mNumTilesX(0)
+    , mNumTilesY(0)
+    , mMaxTiles(0)
+    , mGeneration(0)
+    , mHits(0)
+    , mMisses(0)
+{
+}
+
+bool TileCache::Open(const std::string& path, int tileSize, unsigned maxTiles)
+{
+    std::lock_guard<std::mutex> readLock(mReadMutex);
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mTiles.clear();
+    mLru.clear();
+    ++mGeneration;
+    mHits = 0;
+    mMisses = 0;
+
+    if (tileSize <= 0 || maxTiles == 0) {
+        std::cerr << "*** Bad tile cache settings for '" << path << "'" << std::endl;
+        mReader.Close();
+        return false;
+    }
+
+    if (!mReader.Open(path)) {
+        return false;
+    }
+
+    mTileSize = tileSize;
+    mNumTilesX = (mReader.getWidth() + tileSize - 1) / tileSize;
+    mNumTilesY = (mReader.getHeight() + tileSize - 1) / tileSize;
+    mMaxTiles = maxTiles;
+
+    return true;
+}
+
+void TileCache::Close()
+{
+    std::lock_guard<std::mutex> readLock(mReadMutex);
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mTiles.clear();
+    mLru.clear();
+    ++mGeneration;
+    mReader.Close();
+    mTileSize = 0;
+    mNumTilesX = 0;
+    mNumTilesY = 0;
+}
+
+void TileCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mTiles.clear();
+    mLru.clear();
+}
+
+unsigned TileCache::numCachedTiles() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return (unsigned)mTiles.size();
+}
+
+TileCache::TilePtr TileCache::getTile(int tx, int ty)
+{
+    unsigned key, generation;
+    int x, y, w, h;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if (!mReader.isOpen() || tx < 0 || ty < 0 || tx >= mNumTilesX || ty >= mNumTilesY) {
+            return TilePtr();
+        }
+
+        key = (unsigned)ty * mNumTilesX + tx;
+
+        std::unordered_map<unsigned, Entry>::iterator it = mTiles.find(key);
+        if (it != mTiles.end()) {
+            // move to the front of the LRU list
+            mLru.splice(mLru.begin(), mLru, it->second.lruPos);
+            ++mHits;
+            return it->second.tile;
+        }
+
+        ++mMisses;
+
+        generation = mGeneration;
+        x = tx * mTileSize;
+        y = ty * mTileSize;
+        w = mReader.getWidth() - x < mTileSize ? mReader.getWidth() - x : mTileSize;
+        h = mReader.getHeight() - y < mTileSize ? mReader.getHeight() - y : mTileSize;
+    }
+
+    // the slow part, without holding up the threads that hit
+    std::shared_ptr<Image> tile = std::make_shared<Image>();
+    {
+        std::lock_guard<std::mutex> readLock(mReadMutex);
+
+        // Open and Close hold both locks, so mGeneration can be read under either
+        if (generation != mGeneration || !mReader.ReadRegion(x, y, w, h, *tile)) {
+            return TilePtr();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (generation != mGeneration) {
+        // opened or closed since the read, the tile is from the image that was open then
+        return tile;
+    }
+
+    std::unordered_map<unsigned, Entry>::iterator it = mTiles.find(key);
+    if (it != mTiles.end()) {
+        // another thread read the same tile meanwhile, share its copy
+        mLru.splice(mLru.begin(), mLru, it->second.lruPos);
+        return it->second.tile;
+    }
+
+    // make room first, so we never hold more than mMaxTiles
+    while (mTiles.size() >= mMaxTiles) {
+        mTiles.erase(mLru.back());
+        mLru.pop_back();
+    }
+
+    mLru.push_front(key);
+    Entry& e = mTiles[key];
+    e.tile = tile;
+    e.lruPos = mLru.begin();
+
+    return tile;
+}
+
+} // end of namespace
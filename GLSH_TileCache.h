@@ -0,0 +1,83 @@
+#ifndef GLSH_TILECACHE_H_
+#define GLSH_TILECACHE_H_
+
+#include "GLSH_Image.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace glsh {
+
+//
+// Square tiles of a huge uncompressed TGA, read on demand and kept in a fixed-size LRU cache,
+// so the memory used stays bounded no matter how big the image is.
+//
+// Tile (0, 0) is at the bottom left, like Image rows.  Tiles on the right and top edges
+// are clipped to the image.  Safe to use from several threads: tiles are read from disk outside
+// the cache lock, so hits don't wait on other threads' misses.
+//
+class TileCache {
+public:
+    typedef std::shared_ptr<const Image>    TilePtr;
+
+private:
+    struct Entry {
+        TilePtr                     tile;
+        std::list<unsigned>::iterator lruPos;
+    };
+
+    TargaRegionReader               mReader;
+    int                             mTileSize;
+    int                             mNumTilesX, mNumTilesY;
+    unsigned                        mMaxTiles;
+
+    std::unordered_map<unsigned, Entry> mTiles;
+    std::list<unsigned>             mLru;           // most recently used first
+
+    unsigned                        mGeneration;    // bumped by Open and Close, so reads that raced them aren't cached
+
+    std::atomic<unsigned>           mHits, mMisses;
+
+    mutable std::mutex              mMutex;         // the tiles and LRU list
+    std::mutex                      mReadMutex;     // the reader, one region at a time
+
+public:
+                                    TileCache();
+
+    // maxTiles is the most tiles kept in memory at once
+    bool                            Open(const std::string& path, int tileSize, unsigned maxTiles);
+    void                            Close();
+
+    //
+    // Get a tile, reading it from disk if it isn't cached.  Returns NULL on failure.
+    // A tile stays valid for as long as the caller holds on to it, even if the cache drops it.
+    //
+    TilePtr                         getTile(int tx, int ty);
+
+    // drop all cached tiles
+    void                            Clear();
+
+    bool                            isOpen() const          { return mReader.isOpen(); }
+    int                             getImageWidth() const   { return mReader.getWidth(); }
+    int                             getImageHeight() const  { return mReader.getHeight(); }
+    int                             getTileSize() const     { return mTileSize; }
+    int                             numTilesX() const       { return mNumTilesX; }
+    int                             numTilesY() const       { return mNumTilesY; }
+
+    unsigned                        numCachedTiles() const;
+    unsigned                        numHits() const         { return mHits; }
+    unsigned                        numMisses() const       { return mMisses; }
+
+private:
+                                    // noncopyable
+                                    TileCache(const TileCache&);
+                                    TileCache& operator= (const TileCache&);
+};
+
+} // end of namespace
+
+#endif
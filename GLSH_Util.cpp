@@ -2,6 +2,15 @@
 
 #include <fstream>
 #include <stdexcept>
+#include <cctype>
+
+#if _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
 
 namespace glsh {
 
@@ -29,6 +38,42 @@ std::string ReadTextFile(const std::string& fname)
     return ss.str();
 }
 
+bool FileExists(const std::string& fname)
+{
+    std::ifstream f(fname.c_str());
+    return f.good();
+}
+
+// position of the dot starting the extension, or npos
+static std::string::size_type FindExtension(const std::string& fname)
+{
+    std::string::size_type dot = fname.find_last_of('.');
+    std::string::size_type slash = fname.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return std::string::npos;
+    }
+    return dot;
+}
+
+std::string GetFileExtension(const std::string& fname)
+{
+    std::string::size_type dot = FindExtension(fname);
+    if (dot == std::string::npos) {
+        return std::string();
+    }
+
+    std::string ext = fname.substr(dot);
+    for (unsigned i = 0; i < ext.size(); i++) {
+        ext[i] = (char)std::tolower((unsigned char)ext[i]);
+    }
+    return ext;
+}
+
+std::string ReplaceFileExtension(const std::string& fname, const std::string& ext)
+{
+    return fname.substr(0, FindExtension(fname)) + ext;
+}
+
 std::vector<std::string> Split(const std::string& s, char delimiter)
 {
     std::vector<std::string> tokens;
@@ -66,4 +111,25 @@ std::vector<std::string> Tokenize(const std::string& str)
     return tokens;
 }
 
+#if _WIN32
+
+double GetPerfTime()
+{
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / freq.QuadPart;
+}
+
+#else
+
+double GetPerfTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+#endif
+
 }
@@ -50,6 +50,23 @@ inline int RandomInt(int upper)
 
 std::string ReadTextFile(const std::string& fname);
 
+bool FileExists(const std::string& fname);
+
+//
+// Extension of a file name, including the dot, in lower case
+//
+// GetFileExtension("textures/grass.TGA")  -->  ".tga"
+// GetFileExtension("textures.d/grass")    -->  ""
+//
+std::string GetFileExtension(const std::string& fname);
+
+//
+// Replace the extension of a file name, or add one if there is none
+//
+// ReplaceFileExtension("textures/grass.tga", ".gtex")  -->  "textures/grass.gtex"
+//
+std::string ReplaceFileExtension(const std::string& fname, const std::string& ext);
+
 
 //
 // string handling stuff
@@ -95,6 +112,14 @@ inline bool StringBeginsWith(const std::string& s, const std::string& prefix)
     return s.compare(0, prefix.length(), prefix) == 0;
 }
 
+
+//
+// Timing
+//
+
+// seconds from an arbitrary starting point, with sub-microsecond resolution; works without a GL context
+double GetPerfTime();
+
 // magic
 inline bool IsPowerOf2(int x)
 {
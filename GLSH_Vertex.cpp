@@ -1,5 +1,7 @@
 #include "GLSH_Vertex.h"
 
+#include <cstring>
+
 namespace glsh {
 
 // default constructor (creates empty attribute list)
@@ -75,6 +77,53 @@ const VertexFormat& VertexPositionNormalTexture::GetFormat()
     return fmt;
 }
 
+const VertexFormat& VertexPositionTextureLayer::GetFormat()
+{
+    static VertexFormat fmt(VertexAttrib(VA_POSITION, 3, GL_FLOAT, 6 * sizeof(GLfloat), (void*)0),
+                            VertexAttrib(VA_TEXCOORD, 3, GL_FLOAT, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat))));
+    return fmt;
+}
+
+const VertexFormat& VertexPositionNormalPacked::GetFormat()
+{
+    static VertexFormat fmt(VertexAttrib(VA_POSITION, 4, GL_HALF_FLOAT, 12, (void*)0),
+                            VertexAttrib(VA_NORMAL,   4, GL_INT_2_10_10_10_REV, 12, (void*)8, GL_TRUE));
+    return fmt;
+}
+
+const VertexFormat& VertexPositionTexturePacked::GetFormat()
+{
+    static VertexFormat fmt(VertexAttrib(VA_POSITION, 4, GL_HALF_FLOAT, 12, (void*)0),
+                            VertexAttrib(VA_TEXCOORD, 2, GL_HALF_FLOAT, 12, (void*)8));
+    return fmt;
+}
+
+const VertexFormat& VertexPositionNormalTexturePacked::GetFormat()
+{
+    static VertexFormat fmt(VertexAttrib(VA_POSITION, 4, GL_HALF_FLOAT, 16, (void*)0),
+                            VertexAttrib(VA_NORMAL,   4, GL_INT_2_10_10_10_REV, 16, (void*)8, GL_TRUE),
+                            VertexAttrib(VA_TEXCOORD, 2, GL_HALF_FLOAT, 16, (void*)12));
+    return fmt;
+}
+
+static VertexFormat CreateInstanceTransformTintFormat()
+{
+    const GLsizei stride = sizeof(InstanceTransformTint);
+
+    VertexFormat fmt;
+    for (int i = 0; i < 4; i++) {
+        fmt.addAttrib(VertexAttrib(VA_INSTANCE_TRANSFORM + i, 4, GL_FLOAT, stride, (void*)(i * 4 * sizeof(GLfloat)), GL_FALSE, 1));
+    }
+    fmt.addAttrib(VertexAttrib(VA_INSTANCE_TINT, 4, GL_FLOAT, stride, (void*)(16 * sizeof(GLfloat)), GL_FALSE, 1));
+    return fmt;
+}
+
+const VertexFormat& InstanceTransformTint::GetFormat()
+{
+    static VertexFormat fmt = CreateInstanceTransformTintFormat();
+    return fmt;
+}
+
 
 GLsizei GetGLTypeSize(GLenum type)
 {
@@ -96,4 +145,101 @@ GLsizei GetGLTypeSize(GLenum type)
     };
 }
 
+
+GLhalf FloatToHalf(float f)
+{
+    unsigned x;
+    memcpy(&x, &f, sizeof(x));
+
+    unsigned sign = (x >> 16) & 0x8000;
+    unsigned absx = x & 0x7fffffff;
+
+    // infinity and NaN (keeping NaNs NaN)
+    if (absx >= 0x7f800000) {
+        return (GLhalf)(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+    }
+
+    // rounds past the largest half (65504)
+    if (absx >= 0x477ff000) {
+        return (GLhalf)(sign | 0x7c00);
+    }
+
+    // below the smallest normal half (2^-14), the result is denormal
+    if (absx < 0x38800000) {
+        if (absx <= 0x33000000) {
+            return (GLhalf)sign;    // half of the smallest denormal or less rounds to zero
+        }
+        unsigned shift = 126 - (absx >> 23);
+        unsigned mantissa = (absx & 0x7fffff) | 0x800000;
+        unsigned h = mantissa >> shift;
+        unsigned rest = mantissa & ((1u << shift) - 1);
+        unsigned halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (h & 1))) {
+            ++h;
+        }
+        return (GLhalf)(sign | h);
+    }
+
+    // normal: rebias the exponent and round the mantissa; a carry into the exponent is still right
+    unsigned h = (absx - 0x38000000) >> 13;
+    unsigned rest = absx & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+        ++h;
+    }
+    return (GLhalf)(sign | h);
+}
+
+float HalfToFloat(GLhalf h)
+{
+    unsigned sign = (unsigned)(h & 0x8000) << 16;
+    unsigned exponent = (h >> 10) & 0x1f;
+    unsigned mantissa = h & 0x3ff;
+
+    unsigned x;
+    if (exponent == 0x1f) {
+        x = sign | 0x7f800000 | (mantissa << 13);       // infinity or NaN
+    } else if (exponent != 0) {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa != 0) {
+        // denormal: normalize it
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    } else {
+        x = sign;
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// a float in [-1, 1] as a signed normalized 10-bit field
+static GLuint PackSnorm10(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    int i = (int)(v * 511.0f + (v < 0 ? -0.5f : 0.5f));
+    return (GLuint)i & 0x3ff;
+}
+
+static float UnpackSnorm10(GLuint bits)
+{
+    int i = (int)(bits << 22) >> 22;   // sign extend
+    float v = i / 511.0f;
+    return v < -1.0f ? -1.0f : v;
+}
+
+GLuint PackNormal(const glm::vec3& n)
+{
+    return PackSnorm10(n.x) | (PackSnorm10(n.y) << 10) | (PackSnorm10(n.z) << 20);
+}
+
+glm::vec3 UnpackNormal(GLuint packed)
+{
+    return glm::vec3(UnpackSnorm10(packed), UnpackSnorm10(packed >> 10), UnpackSnorm10(packed >> 20));
+}
+
 }
@@ -17,6 +17,10 @@ enum VertexAttribIndex {
     VA_COLOR     = 1,
     VA_NORMAL    = 2,
     VA_TEXCOORD  = 3,
+
+    // per-instance attributes (see InstanceTransformTint and InstancedMesh)
+    VA_INSTANCE_TRANSFORM   = 4,    // a mat4 takes four locations, one per column: 4 to 7
+    VA_INSTANCE_TINT        = 8,
 };
 
 //
@@ -24,6 +28,18 @@ enum VertexAttribIndex {
 //
 GLsizei GetGLTypeSize(GLenum type);  // get the size of GL_FLOAT, GL_INT, GL_UNSIGNED_SHORT, etc.
 
+//
+// Packing helpers for the packed vertex types
+//
+
+// IEEE half precision, rounded to nearest even; overflows to infinity
+GLhalf FloatToHalf(float f);
+float HalfToFloat(GLhalf h);
+
+// a unit vector as signed normalized GL_INT_2_10_10_10_REV, x in the low bits, w = 0
+GLuint PackNormal(const glm::vec3& n);
+glm::vec3 UnpackNormal(GLuint packed);
+
 //
 // A structure that holds the arguments to glVertexAttribPointer.
 // In essence, it defines the layout of a vertex attribute in a vertex array or a VBO.
@@ -34,18 +50,26 @@ struct VertexAttrib {
     GLenum          type;
     GLsizei         stride;
     const GLvoid*   offset;
+    GLboolean       normalized;     // integers map to [0, 1] or [-1, 1] instead of converting straight to float
+    GLuint          divisor;        // 0 to advance every vertex, n to advance every n instances (glVertexAttribDivisor)
 
     // default constructor initializes everything to 0 (meaningless values)
     VertexAttrib()
-        : index(0), size(0), type(0), stride(0), offset(0)
+        : index(0), size(0), type(0), stride(0), offset(0), normalized(GL_FALSE), divisor(0)
     { }
 
-    VertexAttrib(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid* offset)
-        : index(index), size(size), type(type), stride(stride), offset(offset)
+    VertexAttrib(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid* offset, GLboolean normalized = GL_FALSE, GLuint divisor = 0)
+        : index(index), size(size), type(type), stride(stride), offset(offset), normalized(normalized), divisor(divisor)
     { }
 
     GLsizei getSizeInBytes() const
-    { return size * GetGLTypeSize(type); }  // number of components times component size
+    {
+        // the packed types hold all four components in one 32-bit value
+        if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV) {
+            return 4;
+        }
+        return size * GetGLTypeSize(type);  // number of components times component size
+    }
 };
 
 
@@ -204,6 +228,151 @@ struct VertexPositionNormalTexture {
     static const VertexFormat& GetFormat();
 };
 
+//
+// a structure that stores vertex position and texture coordinates into a texture array (see GLSH_TextureArray.h)
+//
+struct VertexPositionTextureLayer {
+
+    // the following floats will be laid out consecutively in memory like this: { pos.x, pos.y, pos.z, texcoord.u, texcoord.v, texcoord.layer }
+    glm::vec3 pos;
+    glm::vec3 texcoord;     // the layer goes in z, as a float holding a whole number
+
+    // default constructor initializes all members to 0
+    VertexPositionTextureLayer()
+        : pos(0.0f, 0.0f, 0.0f)
+        , texcoord(0.0f, 0.0f, 0.0f)
+    { }
+
+    // fully parameterized constructor initializes all members from arguments
+    VertexPositionTextureLayer(GLfloat x, GLfloat y, GLfloat z, GLfloat u, GLfloat v, int layer)
+        : pos(x, y, z)
+        , texcoord(u, v, (GLfloat)layer)
+    { }
+
+    static const VertexFormat& GetFormat();
+};
+
+//
+// Packed vertex types, for big meshes: half the size of the float ones, so half the memory and vertex bandwidth.
+// Positions and texture coordinates are half floats, with 11 significant bits: the step between values is
+// 1/1024 of the power of two below them, so about 0.001 between 1 and 2, 0.016 between 16 and 32, but already
+// 0.125 between 128 and 256 and 0.25 between 256 and 512.  Only pack meshes that stay within a few tens of units
+// of the origin.  Normals are GL_INT_2_10_10_10_REV, which the vertex fetch unpacks, so the shaders read them as
+// vec3/vec4 like the float types.
+// Each converts from its float counterpart, so build (and optimize) float vertices and pack them last:
+//
+//     std::vector<VPNTPacked> packed(vertices.begin(), vertices.end());
+//
+
+//
+// a packed VertexPositionNormal: 12 bytes instead of 24
+//
+struct VertexPositionNormalPacked {
+
+    GLhalf pos[4];          // x, y, z, and w = 1, so there's no padding
+    GLuint normal;
+
+    VertexPositionNormalPacked()
+        : normal(0)
+    {
+        pos[0] = pos[1] = pos[2] = 0;
+        pos[3] = FloatToHalf(1.0f);
+    }
+
+    explicit VertexPositionNormalPacked(const VertexPositionNormal& v)
+        : normal(PackNormal(v.normal))
+    {
+        pos[0] = FloatToHalf(v.pos.x);
+        pos[1] = FloatToHalf(v.pos.y);
+        pos[2] = FloatToHalf(v.pos.z);
+        pos[3] = FloatToHalf(1.0f);
+    }
+
+    static const VertexFormat& GetFormat();
+};
+
+//
+// a packed VertexPositionTexture: 12 bytes instead of 20
+//
+struct VertexPositionTexturePacked {
+
+    GLhalf pos[4];          // x, y, z, and w = 1
+    GLhalf texcoord[2];     // half floats rather than normalized shorts, so coordinates can go past 1 to repeat
+
+    VertexPositionTexturePacked()
+    {
+        pos[0] = pos[1] = pos[2] = 0;
+        pos[3] = FloatToHalf(1.0f);
+        texcoord[0] = texcoord[1] = 0;
+    }
+
+    explicit VertexPositionTexturePacked(const VertexPositionTexture& v)
+    {
+        pos[0] = FloatToHalf(v.pos.x);
+        pos[1] = FloatToHalf(v.pos.y);
+        pos[2] = FloatToHalf(v.pos.z);
+        pos[3] = FloatToHalf(1.0f);
+        texcoord[0] = FloatToHalf(v.texcoord.x);
+        texcoord[1] = FloatToHalf(v.texcoord.y);
+    }
+
+    static const VertexFormat& GetFormat();
+};
+
+//
+// a packed VertexPositionNormalTexture: 16 bytes instead of 32
+//
+struct VertexPositionNormalTexturePacked {
+
+    GLhalf pos[4];          // x, y, z, and w = 1
+    GLuint normal;
+    GLhalf texcoord[2];
+
+    VertexPositionNormalTexturePacked()
+        : normal(0)
+    {
+        pos[0] = pos[1] = pos[2] = 0;
+        pos[3] = FloatToHalf(1.0f);
+        texcoord[0] = texcoord[1] = 0;
+    }
+
+    explicit VertexPositionNormalTexturePacked(const VertexPositionNormalTexture& v)
+        : normal(PackNormal(v.normal))
+    {
+        pos[0] = FloatToHalf(v.pos.x);
+        pos[1] = FloatToHalf(v.pos.y);
+        pos[2] = FloatToHalf(v.pos.z);
+        pos[3] = FloatToHalf(1.0f);
+        texcoord[0] = FloatToHalf(v.texcoord.x);
+        texcoord[1] = FloatToHalf(v.texcoord.y);
+    }
+
+    static const VertexFormat& GetFormat();
+};
+
+//
+// Per-instance attributes for InstancedMesh: a model matrix and a color to multiply by.
+// The attributes have divisor 1, so each instance reads the next one.
+//
+struct InstanceTransformTint {
+
+    glm::mat4 transform;
+    glm::vec4 tint;
+
+    // default constructor: identity transform, white tint
+    InstanceTransformTint()
+        : transform(1.0f)
+        , tint(1.0f, 1.0f, 1.0f, 1.0f)
+    { }
+
+    InstanceTransformTint(const glm::mat4& transform, const glm::vec4& tint)
+        : transform(transform)
+        , tint(tint)
+    { }
+
+    static const VertexFormat& GetFormat();
+};
+
 //
 // Short aliases for vertex types (saves some typing and horizontal space)
 //
@@ -213,6 +382,10 @@ typedef VertexPositionColor             VPC;
 typedef VertexPositionNormal            VPN;
 typedef VertexPositionTexture           VPT;
 typedef VertexPositionNormalTexture     VPNT;
+typedef VertexPositionTextureLayer      VPTL;
+typedef VertexPositionNormalPacked      VPNPacked;
+typedef VertexPositionTexturePacked     VPTPacked;
+typedef VertexPositionNormalTexturePacked VPNTPacked;
 
 }
 
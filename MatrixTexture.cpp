@@ -1,8 +1,9 @@
 #include "MatrixTexture.h"
 
-MatrixTexture::MatrixTexture(std::string fontName) 
+MatrixTexture::MatrixTexture(std::string fontName, glsh::SamplerCache& samplers) 
 	: mTextTintProgram(0)
 	, mFont(nullptr)
+	, mSamplers(samplers)
 	, mSampler(0)
 	, mSymTableWidth(0)
 	, mSymTableHeight(0)
@@ -35,7 +36,8 @@ void MatrixTexture::initialize(int w, int h)
     // build shader programs
 	mTextTintProgram = glsh::BuildShaderProgram("shaders/TexNoLight-vs.glsl", "shaders/TexTintNoLight-fs.glsl");
 
-	glGenSamplers(1, &mSampler);
+	// the font texture is sampled with clamped coordinates
+	mSampler = mSamplers.GetSampler(glsh::SamplerState(GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE));
 
 	mFont = glsh::CreateFont(mFontName);
 
@@ -92,8 +94,6 @@ void MatrixTexture::draw()
     glDisable(GL_MULTISAMPLE);
 
 	glBindSampler(0, mSampler);
-	glSamplerParameteri(mSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glSamplerParameteri(mSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 	glUseProgram(mTextTintProgram);
     glm::vec4 textColor(0.0f, 0.7f, 0.0f, 1.0f);
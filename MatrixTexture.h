@@ -13,6 +13,7 @@ class MatrixTexture : public glsh::App {
 	glsh::TextBatch         mTextBatch;
 	std::string				mFontName;
 
+	glsh::SamplerCache&     mSamplers;
 	GLuint                  mSampler;
 
 	float                   mScrWidth;
@@ -26,7 +27,7 @@ class MatrixTexture : public glsh::App {
 	int*					mGapes;
 	
 public:
-                            MatrixTexture(std::string fontName);
+                            MatrixTexture(std::string fontName, glsh::SamplerCache& samplers);
                             ~MatrixTexture();
 
     void                    initialize(int w, int h)    override;
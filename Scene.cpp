@@ -32,8 +32,26 @@ const MinFilter g_minFilters[] = {
 };
 const int g_numMinFilters = sizeof(g_minFilters) / sizeof(g_minFilters[0]);
 
+// the instanced cubes are a square grid this many on a side
+const int g_instanceGridSize = 16;
+
+// sampler settings for a minification filter, with repeating texture coordinates
+static glsh::SamplerState GetSamplerState(const MinFilter& minFilter)
+{
+    return glsh::SamplerState(minFilter.mode, GL_LINEAR, GL_REPEAT, minFilter.anisotropy);
+}
+
 Scene::Scene()
     : mTexProgram(0)
+    , mTexMDIProgram(0)
+    , mTexInstancedProgram(0)
+    , mActiveProgram(0)
+    , mInstanceBase(NULL)
+    , mInstancedCubes(NULL)
+    , mInstanceAngle(0.0f)
+    , mMeshArena(NULL)
+    , mMeshRenderer(NULL)
+    , mUseMeshRenderer(false)
     , mCamera(NULL)
     , mSampler(0)
     , mMatrixGenerator(NULL)
@@ -58,23 +76,56 @@ void Scene::initialize(int w, int h)
     mUColorProgram = glsh::BuildShaderProgram("shaders/ucolor-vs.glsl", "shaders/ucolor-fs.glsl");
     mTexProgram = glsh::BuildShaderProgram("shaders/TexNoLight-vs.glsl", "shaders/TexNoLight-fs.glsl");
     mTexTintProgram = glsh::BuildShaderProgram("shaders/TexNoLight-vs.glsl", "shaders/TexTintNoLight-fs.glsl");
+    mTexInstancedProgram = glsh::BuildShaderProgram("shaders/TexInstanced-vs.glsl", "shaders/TexInstanced-fs.glsl");
 
     // create mesh geometry
 	// create textured cube
 	mCreatedMeshes.push_back(glsh::CreateTexturedCube(2.5f));
 
-	// load geometry from OBJ file
-	mLoadedMeshes.push_back(LoadWavefrontOBJ("models/hall.obj"));
+	// load geometry from OBJ file, with levels of detail: into the arena for the mesh renderer
+	// if the driver can draw arena meshes, otherwise as a mesh of its own
+	mMeshArena = new glsh::MeshArena;
+	mLoadedMeshes.push_back(LoadWavefrontOBJ("models/hall.obj", true, mMeshArena, 4));
+
+	// draw the loaded meshes with a multi-draw per arena pool, if they all ended up in the arena
+	// and the program for it builds; the plain loop in draw() covers them otherwise
+	if (glsh::MeshRenderer::IsSupported()) {
+		mTexMDIProgram = glsh::BuildShaderProgram("shaders/TexNoLightMDI-vs.glsl", "shaders/TexNoLight-fs.glsl");
+	}
+	if (mTexMDIProgram) {
+		mMeshRenderer = new glsh::MeshRenderer;
+		for (unsigned i = 0; i < mLoadedMeshes.size(); i++) {
+			glsh::ArenaMesh* mesh = dynamic_cast<glsh::ArenaMesh*>(mLoadedMeshes[i]);
+			if (!mesh) {
+				delete mMeshRenderer;
+				mMeshRenderer = NULL;
+				break;
+			}
+			mMeshRenderer->Add(mesh);
+		}
+	}
 
 	// procedurally generate a room from textured qauds
 	generateGeometry();
 
+	// a grid of small cubes, all drawn in one call
+	mInstanceBase = glsh::CreateTexturedCube(0.5f);
+	mInstancedCubes = glsh::CreateInstancedMesh<glsh::InstanceTransformTint>(mInstanceBase, g_instanceGridSize * g_instanceGridSize);
+	if (mInstancedCubes) {
+		mInstancedMeshes.push_back(mInstancedCubes);
+		updateInstances(0.0f);
+	}
+
 	mActiveMeshes = mCreatedMeshes;
+	mActiveProgram = mTexProgram;
 
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &mMaxAnisotropy);
+	mMaxAnisotropy = mSamplers.getMaxAnisotropy();
 
-    glGenSamplers(1, &mSampler);
-	applyFilteringSettings(mSampler);
+    // create the samplers for all the filters now, so switching filters is only a bind
+    for (int i = 0; i < g_numMinFilters; i++) {
+        mSamplers.GetSampler(GetSamplerState(g_minFilters[i]));
+    }
+	applyFilteringSettings();
 
     mCamera = new glsh::FreeLookCamera(this);
     mCamera->setPosition(0.0f, 1.0f, 7.0f);
@@ -104,7 +155,7 @@ void Scene::initialize(int w, int h)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);  // unbind for now
     
 
-	mMatrixGenerator = new MatrixTexture("fonts/mcode17");
+	mMatrixGenerator = new MatrixTexture("fonts/mcode17", mSamplers);
     mMatrixGenerator->initialize(mFBOWidth, mFBOHeight);
 	mMatrixGenerator->resize(mFBOWidth, mFBOHeight);
 }
@@ -114,6 +165,12 @@ void Scene::shutdown()
     mMatrixGenerator->shutdown();
     delete mMatrixGenerator;
 
+    mSamplers.Clear();
+
+	// before the meshes it draws
+	delete mMeshRenderer;
+	mMeshRenderer = NULL;
+
 	for (std::vector<glsh::Mesh*>::iterator meshItr = mCreatedMeshes.begin(); meshItr != mCreatedMeshes.end(); meshItr++) {
 		delete *meshItr;
 	}
@@ -128,6 +185,20 @@ void Scene::shutdown()
 		delete *meshItr;
 	}
 	mLoadedMeshes.clear();
+
+	for (std::vector<glsh::Mesh*>::iterator meshItr = mInstancedMeshes.begin(); meshItr != mInstancedMeshes.end(); meshItr++) {
+		delete *meshItr;
+	}
+	mInstancedMeshes.clear();
+	mInstancedCubes = NULL;
+
+	// after the instanced meshes that draw it
+	delete mInstanceBase;
+	mInstanceBase = NULL;
+
+	// after the meshes allocated from it
+	delete mMeshArena;
+	mMeshArena = NULL;
 }
 
 void Scene::resize(int w, int h)
@@ -173,20 +244,38 @@ void Scene::draw()
     glm::mat4 projMatrix = mCamera->getProjectionMatrix();
     glm::mat4 viewMatrix = mCamera->getViewMatrix();
 
-    glUseProgram(mTexProgram);
+	// meshes with levels of detail draw the one that suits their size on screen, either way they're drawn
+	for (unsigned int i = 0; i < mActiveMeshes.size(); i++) {
+		glsh::LODMesh* lodMesh = dynamic_cast<glsh::LODMesh*>(mActiveMeshes[i]);
+		glsh::ArenaMesh* arenaMesh = dynamic_cast<glsh::ArenaMesh*>(mActiveMeshes[i]);
+		if (lodMesh) {
+			lodMesh->SelectLOD(*mCamera, mMeshRotMatrix);
+		} else if (arenaMesh) {
+			arenaMesh->SelectLOD(*mCamera, mMeshRotMatrix);
+		}
+	}
 
-    glsh::SetShaderUniformInt("u_TexSampler", 0);
-    glsh::SetShaderUniform("u_ProjectionMatrix", projMatrix);
+	if (mUseMeshRenderer) {
+		glUseProgram(mTexMDIProgram);
 
-    glSamplerParameteri(mSampler, GL_TEXTURE_WRAP_S, GL_REPEAT);    
-    glSamplerParameteri(mSampler, GL_TEXTURE_WRAP_T, GL_REPEAT);    
+		glsh::SetShaderUniformInt("u_TexSampler", 0);
+		glsh::SetShaderUniform("u_ProjectionMatrix", projMatrix);
+		glsh::SetShaderUniform("u_ViewMatrix", viewMatrix * mMeshRotMatrix);
 
-    glsh::SetShaderUniform("u_ModelviewMatrix", viewMatrix * mMeshRotMatrix);
+		mMeshRenderer->Draw();
+	} else {
+		glUseProgram(mActiveProgram);
 
-	//calculateFrustum(projMatrix, viewMatrix * mMeshRotMatrix);
+		glsh::SetShaderUniformInt("u_TexSampler", 0);
+		glsh::SetShaderUniform("u_ProjectionMatrix", projMatrix);
 
-	for (unsigned int i = 0; i < mActiveMeshes.size(); i++) {
-		mActiveMeshes[i]->draw();
+		glsh::SetShaderUniform("u_ModelviewMatrix", viewMatrix * mMeshRotMatrix);
+
+		//calculateFrustum(projMatrix, viewMatrix * mMeshRotMatrix);
+
+		for (unsigned int i = 0; i < mActiveMeshes.size(); i++) {
+			mActiveMeshes[i]->draw();
+		}
 	}
 	
 	GLSH_CHECK_GL_ERRORS("drawing");
@@ -280,18 +369,36 @@ bool Scene::update(float dt)
 	// draw primitive meshes
 	if (kb->keyPressed(glsh::KC_1)) {
 		mActiveMeshes = mCreatedMeshes;
+		mActiveProgram = mTexProgram;
+		mUseMeshRenderer = false;
     }
 
 	// draw procedurally generated geometry
 	if (kb->keyPressed(glsh::KC_2)) {
 		mActiveMeshes = mGeneratedMeshes;
+		mActiveProgram = mTexProgram;
+		mUseMeshRenderer = false;
     }
 
 	// draw geometry loaded from OBJ file
 	if (kb->keyPressed(glsh::KC_3)) {
 		mActiveMeshes = mLoadedMeshes;
+		mActiveProgram = mTexProgram;
+		mUseMeshRenderer = mMeshRenderer != NULL;
     }
 
+	// draw instanced cubes
+	if (kb->keyPressed(glsh::KC_4)) {
+		mActiveMeshes = mInstancedMeshes;
+		mActiveProgram = mTexInstancedProgram;
+		mUseMeshRenderer = false;
+    }
+
+	// only stream the instances while they're being drawn
+	if (mActiveMeshes == mInstancedMeshes) {
+		updateInstances(dt);
+	}
+
 	bool filteringChanged = false;
 	// cycle through minification filters
     if (kb->keyPressed(glsh::KC_9)) {
@@ -315,7 +422,7 @@ bool Scene::update(float dt)
     // update our texture sampler
     //
     if (filteringChanged) {
-        applyFilteringSettings(mSampler);
+        applyFilteringSettings();
     }
 
     mCamera->update(dt);
@@ -323,14 +430,10 @@ bool Scene::update(float dt)
     return true; // request to keep going
 }
 
-void Scene::applyFilteringSettings(GLuint sampler)
+void Scene::applyFilteringSettings()
 {
-    // get current settings
-    const MinFilter& minFilter = g_minFilters[mMinFilterIndex];
-    
-    // configure the sampler
-    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter.mode);
-    glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, minFilter.anisotropy);
+    // pick the sampler for the current settings; it was set up in initialize, so nothing changes on it here
+    mSampler = mSamplers.GetSampler(GetSamplerState(g_minFilters[mMinFilterIndex]));
 }
 
 void Scene::generateGeometry() {
@@ -339,6 +442,9 @@ void Scene::generateGeometry() {
 	float unitLength = 1.0f; // lenght of the side of one quad; should not be modified!
 	int roomWidth = 4; // width of the room; can be modified just for fun
 
+	// all the quads share a format and texture, so they go into one buffer and draw in one call
+	glsh::StaticBatchBuilder batch;
+
 	// far wall
 	for (int i = 0; i < roomWidth - 1; i++) {
 		vertices.push_back(glsh::VPNT(0.0f - unitLength * i - unitLength, 0.0f, 0.0f, 0, 0, 1, 0.5f, 0));
@@ -346,7 +452,7 @@ void Scene::generateGeometry() {
 		vertices.push_back(glsh::VPNT(0.0f - unitLength * i - unitLength, 2 * unitLength, 0.0f, 0, 0, 1, 0.5f, 1));
 		vertices.push_back(glsh::VPNT(0.0f - unitLength * i, 2 * unitLength, 0.0f, 0, 0, 1, 1, 1));
 
-		mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+		batch.Add(GL_TRIANGLE_STRIP, vertices);
 		vertices.clear();
 
 		vertices.push_back(glsh::VPNT(0.0f + unitLength * i, 0.0f, 0.0f, 0, 0, 1, 0.5f, 0));
@@ -354,7 +460,7 @@ void Scene::generateGeometry() {
 		vertices.push_back(glsh::VPNT(0.0f + unitLength * i, 2 * unitLength, 0.0f, 0, 0, 1, 0.5f, 1));
 		vertices.push_back(glsh::VPNT(0.0f + unitLength * i + unitLength, 2 * unitLength, 0.0f, 0, 0, 1, 1, 1));
 
-		mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+		batch.Add(GL_TRIANGLE_STRIP, vertices);
 		vertices.clear();
 	}
 
@@ -365,7 +471,7 @@ void Scene::generateGeometry() {
 		vertices.push_back(glsh::VPNT(roomWidth - unitLength, 2 * unitLength, unitLength * i, -1, 0, 0, 0.5f, 1));
 		vertices.push_back(glsh::VPNT(roomWidth - unitLength, 2 * unitLength, unitLength * i + unitLength, -1, 0, 0, 1, 1));
 
-		mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+		batch.Add(GL_TRIANGLE_STRIP, vertices);
 		vertices.clear();
 	}
 
@@ -376,7 +482,7 @@ void Scene::generateGeometry() {
 		vertices.push_back(glsh::VPNT(-roomWidth + unitLength, 2 * unitLength, unitLength * i + unitLength, 1, 0, 0, 0.5f, 1));
 		vertices.push_back(glsh::VPNT(-roomWidth + unitLength, 2 * unitLength, unitLength * i, 1, 0, 0, 1, 1));
 
-		mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+		batch.Add(GL_TRIANGLE_STRIP, vertices);
 		vertices.clear();
 	}
 
@@ -389,7 +495,7 @@ void Scene::generateGeometry() {
 			vertices.push_back(glsh::VPNT(-roomWidth + unitLength * i, 0.0f, 0.0f + unitLength * j, 0, 1, 0, 0.5f, 1));
 			vertices.push_back(glsh::VPNT(-roomWidth + unitLength * i + unitLength, 0.0f, 0.0f + unitLength * j, 0, 1, 0, 1, 1));
 
-			mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+			batch.Add(GL_TRIANGLE_STRIP, vertices);
 			vertices.clear();
 		}
 	}
@@ -402,10 +508,38 @@ void Scene::generateGeometry() {
 			vertices.push_back(glsh::VPNT(-roomWidth + unitLength * i, 2 * unitLength, 2 * unitLength + unitLength * j, 0, -1, 0, 0.5, 1));
 			vertices.push_back(glsh::VPNT(-roomWidth + unitLength * i + unitLength, 2 * unitLength, 2 * unitLength + unitLength * j, 0, -1, 0, 1, 1));
 
-			mGeneratedMeshes.push_back(glsh::CreateMesh(GL_TRIANGLE_STRIP, vertices));
+			batch.Add(GL_TRIANGLE_STRIP, vertices);
 			vertices.clear();
 		}
 	}
+
+	std::vector<glsh::StaticBatch*> batches;
+	batch.Build(batches);
+	mGeneratedMeshes.insert(mGeneratedMeshes.end(), batches.begin(), batches.end());
+}
+
+void Scene::updateInstances(float dt)
+{
+	if (!mInstancedCubes) {
+		return;
+	}
+
+	mInstanceAngle += dt;
+
+	// rewrite every instance in place; each cube spins at its own speed and gets a tint from its grid position
+	glsh::InstanceTransformTint* instances = (glsh::InstanceTransformTint*)mInstancedCubes->Map();
+	float spacing = 1.0f;
+	float start = -0.5f * spacing * (g_instanceGridSize - 1);
+	for (int j = 0; j < g_instanceGridSize; j++) {
+		for (int i = 0; i < g_instanceGridSize; i++) {
+			glm::vec3 pos(start + i * spacing, 0.5f, start + j * spacing);
+			float angle = mInstanceAngle * (1.0f + 0.1f * (i + j));
+			glm::mat4 transform = glsh::CreateTranslation(pos) * glsh::CreateRotationY(angle);
+			glm::vec4 tint((float)i / (g_instanceGridSize - 1), 1.0f, (float)j / (g_instanceGridSize - 1), 1.0f);
+			instances[j * g_instanceGridSize + i] = glsh::InstanceTransformTint(transform, tint);
+		}
+	}
+	mInstancedCubes->Unmap(g_instanceGridSize * g_instanceGridSize);
 }
 
 void Scene::calculateFrustum(glm::mat4 projMatrix, glm::mat4 mdvMatrix) {
@@ -13,17 +13,30 @@ class Scene : public glsh::App {
     GLuint							mUColorProgram;
     GLuint							mTexProgram;
     GLuint							mTexTintProgram;
+    GLuint							mTexMDIProgram;         // TexNoLight with per-draw transforms, for mMeshRenderer
+    GLuint							mTexInstancedProgram;   // TexNoLight with per-instance transforms and tints
+    GLuint							mActiveProgram;         // the one the active meshes are drawn with
 
 	std::vector<glsh::Mesh*>        mCreatedMeshes;		// simple geometry created using GLSH functions
     std::vector<glsh::Mesh*>        mGeneratedMeshes;	// procedurally generated geometry
 	std::vector<glsh::Mesh*>        mLoadedMeshes;		// geometry loaded from OBJ file
+	std::vector<glsh::Mesh*>        mInstancedMeshes;	// copies of a small cube drawn with instancing
 	std::vector<glsh::Mesh*>        mActiveMeshes;		// meshes which need to be drawn
 
+    glsh::Mesh*						mInstanceBase;		// the cube the instanced meshes draw copies of
+    glsh::InstancedMesh*			mInstancedCubes;	// a grid of them, respun every frame
+    float							mInstanceAngle;
+
+    glsh::MeshArena*				mMeshArena;			// shared buffers the loaded meshes are allocated from
+    glsh::MeshRenderer*				mMeshRenderer;		// draws the loaded meshes with multi-draw indirect, if the driver can
+    bool							mUseMeshRenderer;	// the active meshes are the ones in mMeshRenderer
+
     glm::mat4						mMeshRotMatrix;
 
     glsh::FreeLookCamera*			mCamera;
 
-    GLuint							mSampler;   
+    glsh::SamplerCache				mSamplers;          // a sampler for every filter setting, created up front
+    GLuint							mSampler;           // the one for the current setting
 
     MatrixTexture*					mMatrixGenerator;     
     bool							mGame2Paused;
@@ -49,8 +62,9 @@ public:
     void							draw()                      override;
     bool							update(float dt)            override;
 
-	void							applyFilteringSettings(GLuint sampler);
+	void							applyFilteringSettings();
 	void							generateGeometry();
+	void							updateInstances(float dt);
 	void							calculateFrustum(glm::mat4 projMatrix, glm::mat4 mdvMatrix);
 };
 
@@ -1,6 +1,34 @@
 #include "TextureManager.h"
+#include "GLSH_Image.h"
+#include "GLSH_ThreadPool.h"
+#include "GLSH_Util.h"
+#include "Util.h"
 
-TextureManager::TextureManager(const std::string& rootDir)
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+static const size_t DEFAULT_UPLOAD_BUDGET = 2 * 1024 * 1024;
+
+// a row of the widest texture GL allows always fits
+static const size_t MIN_UPLOAD_BUDGET = 256 * 1024;
+
+static const unsigned DEFAULT_EVICTION_DELAY = 60;
+
+TextureManager::TextureManager(const std::string& rootDir, bool async)
+    : mTextureBytes(0)
+    , mFrame(0)
+    , mMemoryBudget(0)
+    , mEvictionDelay(DEFAULT_EVICTION_DELAY)
+    , mAsync(async)
+    , mLoader(glsh::GetSharedThreadPool())
+    , mPlaceholder(0)
+    , mUploadBudget(DEFAULT_UPLOAD_BUDGET)
+    , mUploadBufferSize(0)
+    , mNextUploadBuffer(0)
+    , mPrefetchStart(0)
+    , mNumPrefetching(0)
 {
     if (rootDir.empty()) {
         mRootDir = "./";
@@ -11,23 +39,484 @@ TextureManager::TextureManager(const std::string& rootDir)
             mRootDir += '/';
         }
     }
+
+    memset(mUploadBuffers, 0, sizeof(mUploadBuffers));
+    memset(&mStats, 0, sizeof(mStats));
+    mPrefetch.totalSeconds = 0;
 }
 
 TextureManager::~TextureManager()
 {
-    // FIXME: cleanup!
+    // let the workers finish, nothing else will be uploaded
+    mLoader.WaitDecoded();
+
+    for (unsigned i = 0; i < mTextures.size(); i++) {
+        if (mTextures[i].state == TEXTURE_LOADED) {
+            glDeleteTextures(1, &mTextures[i].texId);
+        }
+    }
+
+    // textures that were halfway uploaded
+    std::map<unsigned, PendingTexture>::iterator pit = mPending.begin();
+    for (; pit != mPending.end(); ++pit) {
+        if (pit->second.texId) {
+            glDeleteTextures(1, &pit->second.texId);
+        }
+    }
+
+    if (mPlaceholder) {
+        glDeleteTextures(1, &mPlaceholder);
+    }
+    if (mUploadBuffers[0]) {
+        glDeleteBuffers(NUM_UPLOAD_BUFFERS, mUploadBuffers);
+    }
+
+    std::map<std::string, glsh::TextureArray*>::iterator ait = mArrays.begin();
+    for (; ait != mArrays.end(); ++ait) {
+        delete ait->second;
+    }
 }
 
-GLuint TextureManager::GetTexture(const std::string& fname)
+TextureHandle TextureManager::GetHandle(const std::string& fname)
 {
     std::string path = mRootDir + fname;
 
-    std::map<std::string, GLuint>::iterator it = mTextures.find(path);
-    if (it != mTextures.end()) {
+    std::unordered_map<std::string, TextureHandle>::iterator it = mHandles.find(path);
+    if (it != mHandles.end()) {
         return it->second;
+    }
+
+    TextureHandle handle = (TextureHandle)mTextures.size();
+    mHandles[path] = handle;
+
+    Texture tex;
+    tex.path = path;
+    tex.state = TEXTURE_UNLOADED;
+    tex.texId = 0;
+    tex.size = 0;
+    tex.lastUsed = 0;
+    mTextures.push_back(tex);
+
+    return handle;
+}
+
+GLuint TextureManager::GetTexture(TextureHandle handle)
+{
+    Texture& tex = mTextures[handle];
+
+    if (tex.state == TEXTURE_UNLOADED) {
+        // first use, or the first since it was evicted
+        Load(handle, -1);
+    }
+
+    tex.lastUsed = mFrame;
+    if (tex.state != TEXTURE_FAILED) {
+        mLru.splice(mLru.begin(), mLru, tex.lruPos);
+    }
+    return tex.texId;
+}
+
+GLuint TextureManager::GetTexture(const std::string& fname)
+{
+    return GetTexture(GetHandle(fname));
+}
+
+void TextureManager::Load(TextureHandle handle, int prefetchIndex)
+{
+    const std::string& path = mTextures[handle].path;
+
+    // use the baked version if there is one, it's ready to upload as is
+    std::string baked = glsh::ReplaceFileExtension(path, ".gtex");
+    if (glsh::FileExists(baked)) {
+        double start = glsh::GetPerfTime();
+        GLuint tex = glsh::CreateTexture2D(baked, true, true);
+        if (tex) {
+            SetTexture(handle, TEXTURE_LOADED, tex, glsh::GetTextureMemorySize(tex));
+            FinishPrefetchEntry(prefetchIndex, true, glsh::GetPerfTime() - start);
+            return;
+        }
+        // e.g. compressed in a format this driver doesn't have, the source image will do
+    }
+
+    if (mAsync || prefetchIndex >= 0) {
+        // decode in the background, Update() swaps the real texture in
+        PendingTexture& pending = mPending[mLoader.Load(path, true)];
+        pending.handle = handle;
+        pending.texId = 0;
+        pending.imgFormat = GL_NONE;
+        pending.size = 0;
+        pending.prefetchIndex = prefetchIndex;
+        SetTexture(handle, TEXTURE_LOADING, mAsync ? GetPlaceholder() : 0, 0);
+    } else {
+        GLuint tex = glsh::CreateTexture2D(path, true, true);
+        if (tex) {
+            SetTexture(handle, TEXTURE_LOADED, tex, glsh::GetTextureMemorySize(tex));
+        } else {
+            SetTexture(handle, TEXTURE_FAILED, 0, 0);
+        }
+    }
+}
+
+void TextureManager::SetTexture(TextureHandle handle, TextureState state, GLuint texId, size_t size)
+{
+    Texture& tex = mTextures[handle];
+
+    if (state == TEXTURE_FAILED) {
+        // nothing to evict, so keep it out of Evict's way for good
+        if (tex.state != TEXTURE_UNLOADED) {
+            mLru.erase(tex.lruPos);
+        }
+    } else if (tex.state == TEXTURE_UNLOADED) {
+        mLru.push_front(handle);
+        tex.lruPos = mLru.begin();
+    } else {
+        // one that just finished loading gets a full eviction delay, even if nobody asked for it since
+        mLru.splice(mLru.begin(), mLru, tex.lruPos);
+    }
+
+    mTextureBytes -= tex.size;
+    mTextureBytes += size;
+
+    tex.state = state;
+    tex.texId = texId;
+    tex.size = size;
+    tex.lastUsed = mFrame;
+}
+
+void TextureManager::Evict()
+{
+    // oldest first, and only as far as the ones that haven't been idle long enough
+    std::list<TextureHandle>::iterator lit = mLru.end();
+    while (mTextureBytes > mMemoryBudget && lit != mLru.begin()) {
+        --lit;
+
+        Texture& tex = mTextures[*lit];
+        if (mFrame - tex.lastUsed < mEvictionDelay) {
+            break;
+        }
+        if (tex.state != TEXTURE_LOADED) {
+            continue;   // still loading, nothing to free
+        }
+
+        glDeleteTextures(1, &tex.texId);
+        mTextureBytes -= tex.size;
+        ++mStats.numEvicted;
+        mStats.bytesEvicted += tex.size;
+
+        tex.state = TEXTURE_UNLOADED;
+        tex.texId = 0;
+        tex.size = 0;
+        lit = mLru.erase(lit);
+    }
+}
+
+GLuint TextureManager::GetPlaceholder()
+{
+    if (!mPlaceholder) {
+        // a single mid gray texel
+        glsh::Image img;
+        img.Allocate(1, 1, 4);
+        unsigned char* px = img.getData();
+        px[0] = px[1] = px[2] = 128;
+        px[3] = 255;
+        mPlaceholder = glsh::CreateTexture2D(img, false);
+    }
+    return mPlaceholder;
+}
+
+void TextureManager::SetUploadBudget(size_t bytesPerFrame)
+{
+    mUploadBudget = bytesPerFrame > MIN_UPLOAD_BUDGET ? bytesPerFrame : MIN_UPLOAD_BUDGET;
+}
+
+TextureManager::Stats TextureManager::getStats() const
+{
+    Stats stats = mStats;
+    stats.numPending = (unsigned)mPending.size();
+    stats.textureBytes = mTextureBytes;
+    stats.workerSeconds = mLoader.getWorkerSeconds();
+    return stats;
+}
+
+// a slice staged in the upload buffer, waiting for its glTexSubImage2D
+struct StagedSlice {
+    GLuint      texId;
+    GLenum      imgFormat;
+    int         level;
+    int         y, width, height;
+    size_t      offset;
+};
+
+void TextureManager::Update()
+{
+    ++mFrame;
+
+    if (!mPending.empty()) {
+        double start = glsh::GetPerfTime();
+
+        UploadReady(mUploadBudget, GLEW_ARB_pixel_buffer_object || GLEW_VERSION_2_1);
+
+        double seconds = glsh::GetPerfTime() - start;
+        mStats.updateSeconds += seconds;
+        if (seconds > mStats.maxUpdateSeconds) {
+            mStats.maxUpdateSeconds = seconds;
+        }
+    }
+
+    if (mMemoryBudget > 0 && mTextureBytes > mMemoryBudget) {
+        Evict();
+    }
+}
+
+void TextureManager::UploadReady(size_t budget, bool useBuffers)
+{
+    GLuint buffer = 0;
+    unsigned char* mapped = NULL;
+    size_t offset = 0;
+    std::vector<StagedSlice> staged;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t sent = mLoader.Update(budget, [&](const glsh::AsyncImageLoader::Slice& slice) {
+        std::map<unsigned, PendingTexture>::iterator it = mPending.find(slice.id);
+        if (it == mPending.end()) {
+            return;     // dropped when its texture couldn't be created, the rest of its slices go nowhere
+        }
+        PendingTexture& pending = it->second;
+
+        if (!slice.image) {
+            SetTexture(pending.handle, TEXTURE_FAILED, 0, 0);
+            ++mStats.numFailed;
+            FinishPrefetchEntry(pending.prefetchIndex, false, slice.loadSeconds);
+            mPending.erase(it);
+            return;
+        }
+
+        if (slice.first) {
+            // allocating mustn't see a bound unpack buffer, it would read from it
+            if (mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            pending.texId = glsh::AllocateTexture2D(*slice.image, &pending.imgFormat);
+            if (!pending.texId) {
+                if (mapped) {
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                }
+                SetTexture(pending.handle, TEXTURE_FAILED, 0, 0);
+                ++mStats.numFailed;
+                FinishPrefetchEntry(pending.prefetchIndex, false, slice.loadSeconds);
+                mPending.erase(it);
+                return;
+            }
+            pending.size = 0;
+            for (int level = 0; level < slice.image->numMipmaps(); level++) {
+                pending.size += slice.image->getMipmapSize(level);
+            }
+            if (mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            }
+        }
+
+        int width = slice.image->getMipmapWidth(slice.level);
+
+        if (useBuffers && !mapped) {
+            // next buffer in the ring, orphaned so we never wait for the GPU to finish reading it
+            if (mUploadBufferSize != mUploadBudget) {
+                if (mUploadBuffers[0]) {
+                    glDeleteBuffers(NUM_UPLOAD_BUFFERS, mUploadBuffers);
+                }
+                glGenBuffers(NUM_UPLOAD_BUFFERS, mUploadBuffers);
+                mUploadBufferSize = mUploadBudget;
+            }
+            buffer = mUploadBuffers[mNextUploadBuffer];
+            mNextUploadBuffer = (mNextUploadBuffer + 1) % NUM_UPLOAD_BUFFERS;
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, mUploadBufferSize, NULL, GL_STREAM_DRAW);
+            mapped = static_cast<unsigned char*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+            if (!mapped) {
+                // upload straight from memory this time
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                useBuffers = false;
+            }
+        }
+
+        if (useBuffers) {
+            memcpy(mapped + offset, slice.data, slice.size);
+
+            StagedSlice s = { pending.texId, pending.imgFormat, slice.level, slice.y, width, slice.height, offset };
+            staged.push_back(s);
+            offset += slice.size;
+        } else {
+            glBindTexture(GL_TEXTURE_2D, pending.texId);
+            glTexSubImage2D(GL_TEXTURE_2D, slice.level, 0, slice.y, width, slice.height,
+                            pending.imgFormat, GL_UNSIGNED_BYTE, slice.data);
+        }
+
+        if (slice.last) {
+            // the uploads below go ahead of any draw that uses it
+            SetTexture(pending.handle, TEXTURE_LOADED, pending.texId, pending.size);
+            ++mStats.numLoaded;
+            FinishPrefetchEntry(pending.prefetchIndex, true, slice.loadSeconds);
+            mPending.erase(it);
+        }
+    });
+
+    if (mapped) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        for (unsigned i = 0; i < staged.size(); i++) {
+            const StagedSlice& s = staged[i];
+            glBindTexture(GL_TEXTURE_2D, s.texId);
+            glTexSubImage2D(GL_TEXTURE_2D, s.level, 0, s.y, s.width, s.height,
+                            s.imgFormat, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(s.offset));
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    mStats.bytesUploaded += sent;
+}
+
+bool TextureManager::ReadManifest(const std::string& manifest, std::vector<std::string>& fnames) const
+{
+    std::string path = mRootDir + manifest;
+
+    // LoadStrings gives up on the whole program if the file is missing
+    if (!glsh::FileExists(path)) {
+        std::cerr << "*** Failed to open texture manifest " << path << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> lines = LoadStrings(path);
+
+    // lose trailing whitespace, carriage returns included
+    fnames.clear();
+    for (unsigned i = 0; i < lines.size(); i++) {
+        lines[i].erase(lines[i].find_last_not_of(" \t\r") + 1);
+        if (!lines[i].empty()) {
+            fnames.push_back(lines[i]);
+        }
+    }
+
+    return true;
+}
+
+bool TextureManager::PrefetchManifest(const std::string& manifest)
+{
+    std::vector<std::string> fnames;
+    if (!ReadManifest(manifest, fnames)) {
+        return false;
+    }
+
+    Prefetch(fnames);
+    return true;
+}
+
+void TextureManager::Prefetch(const std::vector<std::string>& fnames)
+{
+    // start a new report, unless the last prefetch is still going
+    if (mNumPrefetching == 0) {
+        mPrefetch.entries.clear();
+        mPrefetch.totalSeconds = 0;
+        mPrefetchStart = glsh::GetPerfTime();
+    }
+
+    for (unsigned i = 0; i < fnames.size(); i++) {
+        if (fnames[i].empty()) {
+            continue;
+        }
+
+        // already loaded, on its way, or listed twice
+        TextureHandle handle = GetHandle(fnames[i]);
+        if (mTextures[handle].state != TEXTURE_UNLOADED) {
+            continue;
+        }
+
+        int index = (int)mPrefetch.entries.size();
+        PrefetchEntry entry;
+        entry.fname = fnames[i];
+        entry.ok = false;
+        entry.loadSeconds = 0;
+        entry.readySeconds = 0;
+        mPrefetch.entries.push_back(entry);
+        ++mNumPrefetching;
+
+        // through the loader even in sync mode, so they decode in parallel
+        Load(handle, index);
+    }
+
+    if (!mAsync) {
+        // wait for all of them and upload in one go
+        mLoader.WaitDecoded();
+        UploadReady((size_t)-1, false);
+    }
+}
+
+void TextureManager::FinishPrefetchEntry(int index, bool ok, double loadSeconds)
+{
+    if (index < 0) {
+        return;
+    }
+
+    double now = glsh::GetPerfTime();
+
+    PrefetchEntry& entry = mPrefetch.entries[index];
+    entry.ok = ok;
+    entry.loadSeconds = loadSeconds;
+    entry.readySeconds = now - mPrefetchStart;
+
+    if (--mNumPrefetching == 0) {
+        mPrefetch.totalSeconds = now - mPrefetchStart;
+    }
+}
+
+void TextureManager::PrintPrefetchReport(std::ostream& out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+
+    for (unsigned i = 0; i < mPrefetch.entries.size(); i++) {
+        const PrefetchEntry& entry = mPrefetch.entries[i];
+        if (entry.ok) {
+            out << std::setw(8) << 1000 * entry.loadSeconds << " ms load "
+                << std::setw(8) << 1000 * entry.readySeconds << " ms ready  " << entry.fname << std::endl;
+        } else if (entry.readySeconds > 0) {
+            out << "  failed                            " << entry.fname << std::endl;
+        } else {
+            out << "  loading                           " << entry.fname << std::endl;
+        }
+    }
+
+    if (isPrefetching()) {
+        out << "Prefetch still in progress: " << mNumPrefetching << " of " << mPrefetch.entries.size() << " textures left" << std::endl;
     } else {
-        GLuint tex = glsh::CreateTexture2D(path, true);
-        mTextures[path] = tex;
-        return tex;
+        out << "Prefetched " << mPrefetch.entries.size() << " textures in " << 1000 * mPrefetch.totalSeconds << " ms" << std::endl;
+    }
+
+    out.flags(flags);
+}
+
+const glsh::TextureArray* TextureManager::GetTextureArray(const std::string& manifest)
+{
+    std::map<std::string, glsh::TextureArray*>::iterator it = mArrays.find(manifest);
+    if (it != mArrays.end()) {
+        return it->second;
     }
+
+    glsh::TextureArray* texArray = NULL;
+
+    std::vector<std::string> fnames;
+    if (ReadManifest(manifest, fnames)) {
+        texArray = new glsh::TextureArray;
+        if (!texArray->Create(fnames, mRootDir, true)) {
+            std::cerr << "*** Failed to create texture array from " << mRootDir + manifest << std::endl;
+            delete texArray;
+            texArray = NULL;
+        }
+    }
+
+    // failures are remembered too, so they aren't retried every frame
+    mArrays[manifest] = texArray;
+    return texArray;
 }
@@ -2,21 +2,206 @@
 #define TEXTURE_MANAGER_H_
 
 #include "GLSH_Texture.h"
+#include "GLSH_AsyncImageLoader.h"
+#include "GLSH_TextureArray.h"
 
+#include <list>
 #include <map>
+#include <ostream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+// compact id for a texture file, from TextureManager::GetHandle
+typedef unsigned TextureHandle;
+
+//
+// Loads textures by file name, once each, and keeps their GPU memory within a budget.
+//
+// Look textures up by handle in per-frame code: GetHandle does the string work once, and
+// GetTexture(handle) is then an array index that never allocates.
+//
+// Update() has to be called once per frame on the GL thread.  When the textures take up more
+// than the memory budget, it deletes the least recently used ones that haven't been asked for
+// in a while; GetTexture loads them again if they're needed after all.  So keep calling GetTexture
+// rather than holding on to what it returned.
+//
+// In async mode, images are decoded on worker threads and GetTexture hands out a placeholder
+// until the real texture is in.  Update() uploads up to the per-frame budget through a ring of
+// pixel buffer objects, and swaps the real textures in when they're complete.  Textures with a
+// baked .gtex sibling load right away in either mode.
+//
+// Destroy the manager while the GL context is still around, it deletes its textures.
+//
+// Prefetch loads a whole list of textures (or a manifest file listing them) in parallel, so a level
+// transition can preload the next scene's textures while the current one is still rendering.
+//
+// GetTextureArray packs the textures of a manifest into the layers of one texture array, for tiles
+// that should draw with a single bind.  Arrays are kept until the manager goes, outside the memory budget.
+//
 class TextureManager {
+public:
+    struct Stats {
+        unsigned                    numLoaded;          // loaded in the background and swapped in
+        unsigned                    numFailed;
+        unsigned                    numPending;         // still decoding or uploading
+        size_t                      bytesUploaded;      // by Update()
+        double                      workerSeconds;      // decoding and mipmapping moved off the render thread
+        double                      updateSeconds;      // render thread time spent in Update()
+        double                      maxUpdateSeconds;   // the slowest single Update()
+        size_t                      textureBytes;       // GPU memory used by the textures now, mipmaps included
+        unsigned                    numEvicted;
+        size_t                      bytesEvicted;
+    };
+
+    struct PrefetchEntry {
+        std::string                 fname;
+        bool                        ok;
+        double                      loadSeconds;        // loading and mipmapping, on a worker
+        double                      readySeconds;       // from the Prefetch call until the texture was in
+    };
+
+    struct PrefetchReport {
+        std::vector<PrefetchEntry>  entries;            // in manifest order, without duplicates
+        double                      totalSeconds;       // from the Prefetch call until the last texture was in
+    };
+
+private:
+    enum TextureState {
+        TEXTURE_UNLOADED,                               // not asked for yet, or evicted
+        TEXTURE_LOADING,                                // the placeholder stands in for it
+        TEXTURE_LOADED,
+        TEXTURE_FAILED,                                 // not retried
+    };
+
+    struct Texture {
+        std::string                 path;
+        TextureState                state;
+        GLuint                      texId;              // the placeholder while loading, 0 unless loaded
+        size_t                      size;               // bytes of GPU memory, 0 unless loaded
+        unsigned                    lastUsed;           // frame number
+        std::list<TextureHandle>::iterator lruPos;      // valid while loading or loaded
+    };
+
+    struct PendingTexture {
+        TextureHandle               handle;
+        GLuint                      texId;              // 0 until the first slice comes in
+        GLenum                      imgFormat;
+        size_t                      size;
+        int                         prefetchIndex;      // entry in mPrefetch, or -1
+    };
+
+    enum { NUM_UPLOAD_BUFFERS = 3 };
 
     std::string                     mRootDir;
-    std::map<std::string, GLuint>   mTextures;
+    std::vector<Texture>            mTextures;          // by handle
+    std::unordered_map<std::string, TextureHandle> mHandles;    // by full path
+    std::list<TextureHandle>        mLru;               // loading and loaded ones, most recently used first
+    size_t                          mTextureBytes;
+    unsigned                        mFrame;
+
+    size_t                          mMemoryBudget;      // 0 means no limit
+    unsigned                        mEvictionDelay;     // frames a texture has to go unused before it can be evicted
+
+    bool                            mAsync;
+    glsh::AsyncImageLoader          mLoader;
+    std::map<unsigned, PendingTexture> mPending;        // by loader id
+    GLuint                          mPlaceholder;
+
+    size_t                          mUploadBudget;      // bytes per Update()
+    GLuint                          mUploadBuffers[NUM_UPLOAD_BUFFERS];
+    size_t                          mUploadBufferSize;
+    unsigned                        mNextUploadBuffer;
+
+    Stats                           mStats;
+
+    PrefetchReport                  mPrefetch;
+    double                          mPrefetchStart;
+    unsigned                        mNumPrefetching;
+
+    std::map<std::string, glsh::TextureArray*> mArrays; // by manifest, NULL if it failed
 
 public:
 
-                                    TextureManager(const std::string& rootDir);
+                                    TextureManager(const std::string& rootDir, bool async = false);
                                     ~TextureManager();
                                     
+    // the handle for a file, relative to the root directory; doesn't load anything by itself
+    TextureHandle                   GetHandle(const std::string& fname);
+
+    // the texture for a handle, loading it if it isn't already
+    GLuint                          GetTexture(TextureHandle handle);
+
+    // slow path: GetTexture(GetHandle(fname))
     GLuint                          GetTexture(const std::string& fname);
+
+    const std::string&              getPath(TextureHandle handle) const     { return mTextures[handle].path; }
+
+    // upload what's ready and evict what's over budget, call once per frame on the GL thread
+    void                            Update();
+
+    // bytes of GPU memory the textures may use before old ones get evicted, 0 (the default) for no limit
+    void                            SetMemoryBudget(size_t bytes)       { mMemoryBudget = bytes; }
+    size_t                          getMemoryBudget() const             { return mMemoryBudget; }
+
+    // frames a texture must go without a GetTexture before it can be evicted, 60 by default
+    void                            SetEvictionDelay(unsigned frames)   { mEvictionDelay = frames; }
+    unsigned                        getEvictionDelay() const            { return mEvictionDelay; }
+
+    size_t                          getTextureBytes() const             { return mTextureBytes; }
+
+    // bytes uploaded per Update(), 2 MB by default
+    void                            SetUploadBudget(size_t bytesPerFrame);
+    size_t                          getUploadBudget() const     { return mUploadBudget; }
+
+    bool                            isLoading() const           { return !mPending.empty(); }
+    Stats                           getStats() const;
+
+    //
+    // Load every texture in a manifest (one file name per line, relative to the root directory,
+    // see LoadStrings) or a list, skipping duplicates and textures already loaded or on their way.
+    // The files are decoded in parallel.  In async mode this returns right away and Update() does
+    // the uploads; otherwise it returns once they're all uploaded.  Prefetched textures are
+    // uncompressed, like async loads.
+    //
+    bool                            PrefetchManifest(const std::string& manifest);
+    void                            Prefetch(const std::vector<std::string>& fnames);
+
+    bool                            isPrefetching() const       { return mNumPrefetching > 0; }
+
+    // per file and total load times of the current (or last) prefetch, complete once isPrefetching() is false
+    const PrefetchReport&           getPrefetchReport() const   { return mPrefetch; }
+    void                            PrintPrefetchReport(std::ostream& out) const;
+
+    //
+    // A texture array with a layer for every texture in a manifest, in order, mipmapped; built on the first
+    // call and cached.  Look layers up with getLayer, by file name as listed in the manifest.  NULL on failure.
+    //
+    const glsh::TextureArray*       GetTextureArray(const std::string& manifest);
+
+private:
+    // the file names in a manifest, without blank lines
+    bool                            ReadManifest(const std::string& manifest, std::vector<std::string>& fnames) const;
+
+    GLuint                          GetPlaceholder();
+
+    // start loading an unloaded texture, with the placeholder standing in for it in async mode
+    void                            Load(TextureHandle handle, int prefetchIndex);
+
+    // put a texture in place (or the placeholder, or nothing if it failed), keeping the memory total up to date
+    void                            SetTexture(TextureHandle handle, TextureState state, GLuint texId, size_t size);
+
+    // delete least recently used textures until we're within budget
+    void                            Evict();
+
+    // upload slices the loader has ready, up to budget bytes
+    void                            UploadReady(size_t budget, bool useBuffers);
+
+    void                            FinishPrefetchEntry(int index, bool ok, double loadSeconds);
+
+                                    // noncopyable
+                                    TextureManager(const TextureManager&);
+                                    TextureManager& operator= (const TextureManager&);
 };
 
 #endif
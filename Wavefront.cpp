@@ -1,13 +1,67 @@
 #include "Wavefront.h"
+#include "GLSH_MeshOptimizer.h"
+#include "GLSH_LODMesh.h"
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 #include <map>
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <unordered_map>
 
-glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
+// a face corner: 1-based position, texcoord, and normal indices, texcoord 0 if there is none
+struct ObjCorner {
+    int p, t, n;
+
+    bool operator== (const ObjCorner& other) const
+    {
+        return p == other.p && t == other.t && n == other.n;
+    }
+};
+
+struct ObjCornerHash {
+    size_t operator() (const ObjCorner& c) const
+    {
+        // the indices are small, so mixing them with odd multipliers spreads them well enough
+        return (size_t)c.p * 73856093u ^ (size_t)c.t * 19349663u ^ (size_t)c.n * 83492791u;
+    }
+};
+
+// in the arena if there is one that can take it, in its own buffers otherwise; with its levels of detail if it has any
+template <typename VertexType>
+static glsh::Mesh* CreateObjMesh(const std::vector<VertexType>& vertices, const std::vector<unsigned>& indices,
+                                 const std::vector<unsigned>& lodIndices, const std::vector<glsh::MeshLODLevel>& lods,
+                                 glsh::MeshArena* arena)
+{
+    if (arena && glsh::MeshArena::IsSupported()) {
+        if (!lods.empty()) {
+            return arena->CreateLODMesh(vertices, lodIndices, lods);
+        }
+        return arena->CreateIndexedMesh(GL_TRIANGLES, vertices, indices);
+    }
+    if (!lods.empty()) {
+        return glsh::CreateLODMesh(vertices, lodIndices, lods);
+    }
+    return glsh::CreateIndexedMesh(GL_TRIANGLES, vertices, indices);
+}
+
+// past this far from the origin, half float positions are off by more than 1/64 of a unit (see GLSH_Vertex.h)
+static const float s_maxPackedExtent = 32.0f;
+
+// one line with the triangles and error of each level
+static void PrintLODs(const std::vector<glsh::MeshLODLevel>& lods)
+{
+    std::cout << "  LODs:";
+    for (unsigned i = 0; i < lods.size(); i++) {
+        std::cout << " " << lods[i].numIndices / 3 << " (" << lods[i].error << ")";
+    }
+    std::cout << std::endl;
+}
+
+glsh::Mesh* LoadWavefrontOBJ(const std::string& path, bool packVertices, glsh::MeshArena* arena, unsigned maxLODs)
 {
     std::cout << "Loading '" << path << "'" << std::endl;
 
@@ -29,10 +83,12 @@ glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
 	std::vector<glm::vec3> vertexNormals;
 	std::vector<glm::vec2> textureCoordinates;
 
-	bool withTextureCoords = true;
-
-	std::vector<glsh::VertexPositionNormalTexture> textureVerts;
-	std::vector<glsh::VertexPositionNormal> noTextureVerts;
+    // every distinct (v, vt, vn) triple becomes one vertex, the faces become indices into them
+    std::vector<ObjCorner> corners;
+    std::unordered_map<ObjCorner, unsigned, ObjCornerHash> cornerIndices;
+    std::vector<unsigned> indices;
+    std::vector<unsigned> faceIndices;
+    bool withTextureCoords = true;     // only if every corner has one
 
     // go through the file one line at a time until the end
     for (;;) {
@@ -128,9 +184,6 @@ glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
         } else if (lineTok[0] == "f") {
             // it's a face
 
-			std::vector<glsh::VertexPositionNormalTexture> verticesPNT;
-			std::vector<glsh::VertexPositionNormal> verticesPN;
-
             // need at least 3 vertices per face
             if (lineTok.size() < 4) {
                 std::cerr << "ERROR: Insufficient number of face elements on line " << lineno << std::endl;
@@ -138,8 +191,10 @@ glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
             }
             //std::cout << "Face with " << lineTok.size() - 1 << " vertices" << std::endl;
 
+            faceIndices.clear();
+
             // process each vertex definition for this face
-            for (unsigned i = 1; i < lineTok .size(); i++) {
+            for (unsigned i = 1; i < lineTok.size(); i++) {
 
                 // split into three parts (v/vt/vn)
                 vertexTok = glsh::Split(lineTok[i], '/');
@@ -150,14 +205,11 @@ glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
                     return NULL;
                 }
 
-                // convert the index strings to ints
-                int positionIndex = 0;
-                int normalIndex = 0;
-                int texcoordIndex = 0;
+                ObjCorner corner = { 0, 0, 0 };
 
                 // get position index (required)
                 if (!vertexTok[0].empty()) {
-                    positionIndex = glsh::FromString<int>(vertexTok[0]);
+                    corner.p = glsh::FromString<int>(vertexTok[0]);
                 } else {
                     std::cerr << "ERROR: Vertex position index not given for vertex " << i << " on line " << lineno << std::endl;
                     return NULL;
@@ -165,106 +217,118 @@ glsh::Mesh* LoadWavefrontOBJ(const std::string& path)
 
                 // get normal index (required)
                 if (!vertexTok[2].empty()) {
-                    normalIndex = glsh::FromString<int>(vertexTok[2]);
+                    corner.n = glsh::FromString<int>(vertexTok[2]);
                 } else {
                     std::cerr << "ERROR: Vertex normal index not given for vertex " << i << " on line " << lineno << std::endl;
                     return NULL;
                 }
 
-                // get texcoord index (optional)
+                // get texcoord index (optional, the mesh goes without texcoords if any corner lacks one)
                 if (!vertexTok[1].empty()) {
-                    texcoordIndex = glsh::FromString<int>(vertexTok[1]);
-
-					if (!withTextureCoords) {
-						withTextureCoords = true;
-					}
-				} else if (withTextureCoords){
-					withTextureCoords = false;
-                    // use a default texcoord of (0, 0)
-                    // ...or create a mesh without texcoords
+                    corner.t = glsh::FromString<int>(vertexTok[1]);
+                } else {
+                    withTextureCoords = false;
                 }
 
-                //std::cout << "  Vertex pos at index " << positionIndex << ", normal at index " << normalIndex << ", texcoord at index " << texcoordIndex << std::endl;
-				
-				if (withTextureCoords) {
-					glsh::VertexPositionNormalTexture vertex = glsh::VertexPositionNormalTexture(
-						vertexPositions[positionIndex - 1].x, vertexPositions[positionIndex - 1].y, vertexPositions[positionIndex - 1].z,
-						vertexNormals[normalIndex - 1].x, vertexNormals[normalIndex - 1].y, vertexNormals[normalIndex - 1].z,
-						textureCoordinates[texcoordIndex - 1].x, textureCoordinates[texcoordIndex - 1].y);
-
-					verticesPNT.push_back(vertex);
-				}
-				else {
-					glsh::VertexPositionNormal vertex = glsh::VertexPositionNormal(
-						vertexPositions[positionIndex - 1].x, vertexPositions[positionIndex - 1].y, vertexPositions[positionIndex - 1].z,
-						vertexNormals[normalIndex - 1].x, vertexNormals[normalIndex - 1].y, vertexNormals[normalIndex - 1].z);
-
-					verticesPN.push_back(vertex);
-				}
+                // negative indices count back from the last one defined so far, -1 being the last
+                if (corner.p < 0) {
+                    corner.p += (int)vertexPositions.size() + 1;
+                }
+                if (corner.n < 0) {
+                    corner.n += (int)vertexNormals.size() + 1;
+                }
+                if (corner.t < 0) {
+                    corner.t += (int)textureCoordinates.size() + 1;
+                }
+
+                // the indices refer to data defined earlier in the file
+                if (corner.p < 1 || corner.p > (int)vertexPositions.size() ||
+                    corner.n < 1 || corner.n > (int)vertexNormals.size() ||
+                    corner.t < (vertexTok[1].empty() ? 0 : 1) || corner.t > (int)textureCoordinates.size())
+                {
+                    std::cerr << "ERROR: Index out of range for vertex " << i << " on line " << lineno << std::endl;
+                    return NULL;
+                }
+
+                //std::cout << "  Vertex pos at index " << corner.p << ", normal at index " << corner.n << ", texcoord at index " << corner.t << std::endl;
+
+                // reuse the vertex if this triple was seen before
+                std::unordered_map<ObjCorner, unsigned, ObjCornerHash>::iterator it = cornerIndices.find(corner);
+                if (it != cornerIndices.end()) {
+                    faceIndices.push_back(it->second);
+                } else {
+                    unsigned index = (unsigned)corners.size();
+                    cornerIndices[corner] = index;
+                    corners.push_back(corner);
+                    faceIndices.push_back(index);
+                }
             }
 
-			switch (withTextureCoords) {
-
-			case true:
-				
-				if (verticesPNT.size() > 3) {
-					triangulate(verticesPNT);
-				}
-				for (unsigned int i = 0; i < verticesPNT.size(); i++) {
-					textureVerts.push_back(verticesPNT[i]);
-				}
-			case false:
-
-				if (verticesPN.size() > 3) {
-					triangulate(verticesPN);
-				}
-				
-				for (unsigned int i = 0; i < verticesPN.size(); i++) {
-					noTextureVerts.push_back(verticesPN[i]);
-				}
-			}
+            // triangulate as a fan around the first corner
+            for (unsigned i = 2; i < faceIndices.size(); i++) {
+                indices.push_back(faceIndices[0]);
+                indices.push_back(faceIndices[i - 1]);
+                indices.push_back(faceIndices[i]);
+            }
         }
     }
 
-	if (withTextureCoords) {
-		return glsh::CreateMesh(GL_TRIANGLES, textureVerts);
-	}
-	else {
-		return glsh::CreateMesh(GL_TRIANGLES, noTextureVerts);
-	}
-}
-
-void triangulate(std::vector<glsh::VertexPositionNormalTexture>& _vertices) {
-
-	glsh::VertexPositionNormalTexture firstVertex = *(_vertices.begin());
-	glsh::VertexPositionNormalTexture previousVertex;
+    if (indices.empty()) {
+        std::cerr << "ERROR: No faces in " << path << std::endl;
+        return NULL;
+    }
 
-	for (unsigned int i = 0; i < _vertices.size(); i++) {
-		
-		if (i && i % 3 == 0) {
-			_vertices.insert(_vertices.begin() + i, firstVertex);
-			_vertices.insert(_vertices.begin() + i + 1, previousVertex);
-			i += 2;
-		}
+    // half floats would move the vertices of a big model around visibly, so it keeps its floats
+    if (packVertices) {
+        float extent = 0.0f;
+        for (unsigned i = 0; i < vertexPositions.size(); i++) {
+            const glm::vec3& pos = vertexPositions[i];
+            extent = std::max(extent, std::max(std::abs(pos.x), std::max(std::abs(pos.y), std::abs(pos.z))));
+        }
+        if (extent > s_maxPackedExtent) {
+            std::cout << "  Not packing vertices: positions reach " << extent << " units from the origin" << std::endl;
+            packVertices = false;
+        }
+    }
 
-		previousVertex = _vertices[i];
-	}
+    // levels of detail, all indexing the same vertices
+    std::vector<unsigned> lodIndices;
+    std::vector<glsh::MeshLODLevel> lods;
+
+    if (withTextureCoords) {
+        std::vector<glsh::VertexPositionNormalTexture> vertices(corners.size());
+        for (unsigned i = 0; i < corners.size(); i++) {
+            const glm::vec3& pos = vertexPositions[corners[i].p - 1];
+            const glm::vec3& normal = vertexNormals[corners[i].n - 1];
+            const glm::vec2& texcoord = textureCoordinates[corners[i].t - 1];
+            vertices[i] = glsh::VertexPositionNormalTexture(pos.x, pos.y, pos.z, normal.x, normal.y, normal.z, texcoord.x, texcoord.y);
+        }
+        glsh::PrintMeshOptimizerReport(std::cout << "  ", glsh::OptimizeMesh(vertices, indices));
+        if (maxLODs > 1) {
+            glsh::GenerateLODs(lodIndices, lods, vertices, indices, maxLODs);
+            PrintLODs(lods);
+        }
+        if (packVertices) {
+            std::vector<glsh::VPNTPacked> packed(vertices.begin(), vertices.end());
+            return CreateObjMesh(packed, indices, lodIndices, lods, arena);
+        }
+        return CreateObjMesh(vertices, indices, lodIndices, lods, arena);
+    } else {
+        std::vector<glsh::VertexPositionNormal> vertices(corners.size());
+        for (unsigned i = 0; i < corners.size(); i++) {
+            const glm::vec3& pos = vertexPositions[corners[i].p - 1];
+            const glm::vec3& normal = vertexNormals[corners[i].n - 1];
+            vertices[i] = glsh::VertexPositionNormal(pos.x, pos.y, pos.z, normal.x, normal.y, normal.z);
+        }
+        glsh::PrintMeshOptimizerReport(std::cout << "  ", glsh::OptimizeMesh(vertices, indices));
+        if (maxLODs > 1) {
+            glsh::GenerateLODs(lodIndices, lods, vertices, indices, maxLODs);
+            PrintLODs(lods);
+        }
+        if (packVertices) {
+            std::vector<glsh::VPNPacked> packed(vertices.begin(), vertices.end());
+            return CreateObjMesh(packed, indices, lodIndices, lods, arena);
+        }
+        return CreateObjMesh(vertices, indices, lodIndices, lods, arena);
+    }
 }
-
-
-void triangulate(std::vector<glsh::VertexPositionNormal>& _vertices) {
-	
-	glsh::VertexPositionNormal firstVertex = *(_vertices.begin());
-	glsh::VertexPositionNormal previousVertex;
-
-	for (unsigned int i = 0; i < _vertices.size(); i++) {
-		
-		if (i && i % 3 == 0) {
-			_vertices.insert(_vertices.begin() + i, firstVertex);
-			_vertices.insert(_vertices.begin() + i + 1, previousVertex);
-			i += 2;
-		}
-
-		previousVertex = _vertices[i];
-	}
-}
\ No newline at end of file
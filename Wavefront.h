@@ -3,9 +3,17 @@
 
 #include "GLSH.h"
 
-glsh::Mesh* LoadWavefrontOBJ(const std::string& path);
-
-void triangulate(std::vector<glsh::VertexPositionNormalTexture>& _vertices);
-void triangulate(std::vector<glsh::VertexPositionNormal>& _vertices);
+//
+// Load a mesh from an OBJ file.  Face corners with the same (v, vt, vn) indices share a vertex,
+// and polygons are split into triangle fans, so the result is an indexed triangle mesh
+// (16-bit indices unless it has more than 65536 vertices), reordered by OptimizeMesh (GLSH_MeshOptimizer.h).
+// With packVertices set, the vertices are stored in the half-size packed formats from GLSH_Vertex.h,
+// unless the positions reach too far from the origin for half floats to hold them closely.
+// Given an arena, the mesh is allocated from it, unless the driver can't draw arena meshes.
+// With maxLODs above 1, the mesh gets up to that many levels of detail: an arena mesh from
+// MeshArena::CreateLODMesh, or an LODMesh (GLSH_LODMesh.h) without an arena.
+//
+glsh::Mesh* LoadWavefrontOBJ(const std::string& path, bool packVertices = false, glsh::MeshArena* arena = NULL,
+                             unsigned maxLODs = 1);
 
 #endif
@@ -0,0 +1,15 @@
+#version 330
+
+// input from rasterizer
+in vec3 var_TexCoord;
+
+// input from application
+uniform sampler2DArray u_TexSampler;
+
+// output to framebuffer
+out vec4 out_Color;
+
+void main()
+{
+    out_Color = texture(u_TexSampler, var_TexCoord);    // the layer in z picks the image
+}
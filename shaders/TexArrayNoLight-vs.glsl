@@ -0,0 +1,18 @@
+#version 330
+
+// vertex attributes
+layout(location = 0) in vec4 in_Vertex;
+layout(location = 3) in vec3 in_TexCoord;     // u, v, and the texture array layer
+
+// transformations
+uniform mat4 u_ProjectionMatrix;
+uniform mat4 u_ModelviewMatrix;
+
+// outputs to rasterizer
+out vec3 var_TexCoord;
+
+void main()
+{
+    gl_Position = u_ProjectionMatrix * u_ModelviewMatrix * in_Vertex;
+    var_TexCoord = in_TexCoord;
+}
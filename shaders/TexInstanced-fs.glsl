@@ -0,0 +1,17 @@
+#version 330
+
+// input from rasterizer
+in vec2 var_TexCoord;
+in vec4 var_Tint;
+
+// input from application
+uniform sampler2D u_TexSampler;
+
+// output to framebuffer
+out vec4 out_Color;
+
+void main()
+{
+    // multiply texel color by the instance's tint
+    out_Color = var_Tint * texture(u_TexSampler, var_TexCoord);
+}
@@ -0,0 +1,24 @@
+#version 330
+
+// vertex attributes
+layout(location = 0) in vec4 in_Vertex;
+layout(location = 3) in vec2 in_TexCoord;
+
+// per-instance attributes, see glsh::InstanceTransformTint
+layout(location = 4) in mat4 in_InstanceTransform;     // takes locations 4 to 7
+layout(location = 8) in vec4 in_InstanceTint;
+
+// transformations
+uniform mat4 u_ProjectionMatrix;
+uniform mat4 u_ModelviewMatrix;
+
+// outputs to rasterizer
+out vec2 var_TexCoord;
+out vec4 var_Tint;
+
+void main()
+{
+    gl_Position = u_ProjectionMatrix * u_ModelviewMatrix * in_InstanceTransform * in_Vertex;
+    var_TexCoord = in_TexCoord;
+    var_Tint = in_InstanceTint;
+}
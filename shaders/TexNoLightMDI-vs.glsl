@@ -0,0 +1,24 @@
+#version 430
+#extension GL_ARB_shader_draw_parameters : require
+
+// vertex attributes
+layout(location = 0) in vec4 in_Vertex;
+layout(location = 3) in vec2 in_TexCoord;
+
+// transformations
+uniform mat4 u_ProjectionMatrix;
+uniform mat4 u_ViewMatrix;
+
+// a model matrix for each draw of the multi-draw, filled by glsh::MeshRenderer
+layout(std430, binding = 0) readonly buffer DrawTransforms {
+    mat4 u_ModelMatrices[];
+};
+
+// outputs to rasterizer
+out vec2 var_TexCoord;
+
+void main()
+{
+    gl_Position = u_ProjectionMatrix * u_ViewMatrix * u_ModelMatrices[gl_DrawIDARB] * in_Vertex;
+    var_TexCoord = in_TexCoord;
+}
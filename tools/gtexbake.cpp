@@ -0,0 +1,99 @@
+//
+// gtexbake: convert .tga and .qoi textures to baked .gtex files
+//
+// usage: gtexbake [-raw] [-nomips] image.tga|image.qoi...
+//
+// Each image is written as image.gtex next to it, with the full mip chain and BCn
+// compression (the same format CreateTexture2D would pick).
+//   -raw       store plain pixels instead of compressed blocks, RGB padded to RGBA
+//   -nomips    store level 0 only
+//
+
+#include "../GLSH_Image.h"
+#include "../GLSH_TextureCompression.h"
+#include "../GLSH_TextureFile.h"
+#include "../GLSH_Util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static bool Bake(const std::string& path, bool compress, bool mipmaps)
+{
+    glsh::Image img;
+    if (!img.Load(path)) {
+        return false;
+    }
+
+    if (mipmaps) {
+        img.GenerateMipmaps(1);
+    }
+
+    std::string outPath = glsh::ReplaceFileExtension(path, ".gtex");
+
+    if (compress) {
+        glsh::CompressedFormat fmt = glsh::ChooseCompressedFormat(img.getBytesPerPixel());
+        glsh::CompressedImage cimg;
+        if (!cimg.Compress(img, fmt)) {
+            std::fprintf(stderr, "*** Failed to compress %s\n", path.c_str());
+            return false;
+        }
+
+        glsh::CompressionError err;
+        glsh::MeasureCompressionError(img, cimg, &err);
+
+        if (!glsh::WriteTextureFile(outPath, cimg)) {
+            return false;
+        }
+
+        std::printf("%s: %dx%d, %d levels, %s, %u -> %u bytes, PSNR %.2f dB, max error %d\n",
+                    outPath.c_str(), img.getWidth(), img.getHeight(), cimg.numLevels(), glsh::GetCompressedFormatName(fmt),
+                    (unsigned)img.getDataSize(), (unsigned)cimg.getDataSize(), err.psnr, err.maxError);
+    } else {
+        // RGB padded to RGBA now, so loading is nothing but an upload straight from the mapping
+        glsh::Image scratch;
+        const glsh::Image* src = glsh::PrepareTextureImage(img, mipmaps, scratch);
+        if (!src || !glsh::WriteTextureFile(outPath, *src)) {
+            return false;
+        }
+
+        std::printf("%s: %dx%d, %d levels, %d bytes per pixel, %u bytes\n",
+                    outPath.c_str(), src->getWidth(), src->getHeight(), src->numMipmaps(), src->getBytesPerPixel(),
+                    (unsigned)src->getDataSize());
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool compress = true;
+    bool mipmaps = true;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-raw") == 0) {
+            compress = false;
+        } else if (std::strcmp(argv[i], "-nomips") == 0) {
+            mipmaps = false;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.empty()) {
+        std::fprintf(stderr, "usage: gtexbake [-raw] [-nomips] image.tga|image.qoi...\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for (unsigned i = 0; i < files.size(); i++) {
+        if (!Bake(files[i], compress, mipmaps)) {
+            std::fprintf(stderr, "*** Failed to bake %s\n", files[i].c_str());
+            ++failed;
+        }
+    }
+
+    return failed ? 1 : 0;
+}